@@ -0,0 +1,43 @@
+#!/bin/sh
+#  bench.sh - time the input scan of each build of tilebench
+#
+#  Runs every program on $BENCHINPUT, or on a made up input of
+#  $BENCHMB megabytes (128 by default) of short path lines, with a
+#  comment line now and then, like a large pattern.
+#  A program named *avx2 is skipped on a CPU without AVX2.
+#  Usage: bench.sh <tilebench program>...
+
+input=$BENCHINPUT
+made=
+
+if [ -z "$input" ]
+then	input=${TMPDIR:-/tmp}/tilebench.$$.ps
+	made=$input
+	awk -v size=`expr ${BENCHMB:-128} \* 1048576` 'BEGIN {
+		print "%!PS-Adobe-3.0"
+		print "%%BoundingBox: 0 0 2000 3000"
+		print "%%EndComments"
+		for (n = 0; n < size; n += length( line) + 1)
+		{	if (n % 4096 < 24)
+				line = "% " n
+			else
+				line = sprintf( "%d.%d %d.%d l", n % 2000, n % 7, n % 3000, n % 9)
+			print line
+		}
+		print "%%EOF"
+	}' >"$input" || exit 1
+fi
+
+for prog
+do	case "$prog" in
+	  *avx2) if [ -r /proc/cpuinfo ] && ! grep -qw avx2 /proc/cpuinfo
+		then	echo "$prog: skipped, no AVX2 on this CPU"
+			continue
+		fi ;;
+	esac
+	printf "%s\t" "$prog"
+	$prog "$input"
+done
+
+[ -n "$made" ] && rm -f "$made"
+exit 0
@@ -0,0 +1,427 @@
+#!/bin/sh
+#  check.sh - run tile on the inputs in this directory
+#
+#  Each output is run through ghostscript when it is installed;
+#  without it only what can be seen in the output is checked.
+#  Usage: check.sh <tile program>
+
+tile=${1:-../tile}
+dir=`dirname "$0"`
+out=${TMPDIR:-/tmp}/tilecheck.$$
+failed=0
+
+fail()
+{	echo "FAIL: $*"
+	failed=1
+}
+
+# run the output, if ghostscript is there
+render()
+{	if command -v gs >/dev/null 2>&1
+	then	gs -q -dBATCH -dNOPAUSE -sDEVICE=nullpage "$1" >"$out.gs" 2>&1
+		grep -q "Error" "$out.gs" && fail "$2: ghostscript: `grep Error "$out.gs" | head -1`"
+	fi
+}
+
+# the DSC structure of an output: %%Pages tells the %%Page comments,
+# which count from 1, or as many as $3 when given; every document of
+# the input ends, and so does the output
+dsc()
+{	n=`grep -c '^%%Page:' "$1"`
+	sed -n 1p "$1" | grep -q '^%!PS-Adobe-3.0$' || fail "$2: not DSC"
+	grep -q "^%%Pages: $n\$" "$1" || fail "$2: `grep -a '^%%Pages:' "$1"` of $n pages"
+	[ -z "$3" ] || [ "$n" = "$3" ] || fail "$2: $n pages, not $3"
+	grep -a '^%%Page:' "$1" | awk '$3 != NR { bad = 1 } END { exit bad }' ||
+		fail "$2: pages not in order"
+	for c in EndComments EndProlog EndSetup
+	do	[ "`grep -c "^%%$c\$" "$1"`" = 1 ] || fail "$2: not one %%$c"
+	done
+	[ "`grep -c '^%%BeginDocument' "$1"`" = "`grep -c '^%%EndDocument' "$1"`" ] ||
+		fail "$2: a document of the input does not end"
+	[ "`tail -n 1 "$1"`" = "%%EOF" ] || fail "$2: does not end in %%EOF"
+}
+
+# an output but for the name of the input
+unnamed()
+{	sed -e '/^% Print poster/d' -e '/^%%BeginDocument:/d'
+}
+
+# standard input, a file or a pipe, makes the poster of the file
+$tile -p2x2A4 "$dir/shadow.eps" | unnamed >"$out"
+$tile -p2x2A4 - <"$dir/shadow.eps" | unnamed | cmp -s - "$out" ||
+	fail "- from a file: not the poster of the input"
+cat "$dir/shadow.eps" | $tile -p2x2A4 - | unnamed | cmp -s - "$out" ||
+	fail "- from a pipe: not the poster of the input"
+
+# -e has a single copy of the input, which every page replays
+for opts in "-p2x2A4" "-p2x2A4 -e" "-p3x3A4 -e"
+do	if ! $tile $opts "$dir/shadow.eps" >"$out" 2>"$out.err"
+	then	fail "shadow.eps $opts: `cat "$out.err"`"
+		continue
+	fi
+	dsc "$out" "shadow.eps $opts"
+	pages=`grep -c '^%%Page:' "$out"`
+	copies=`grep -c '^newpath 10 10 moveto' "$out"`
+	case "$opts" in
+	  *-e*) pages=1 ;;
+	esac
+	[ "$copies" = "$pages" ] || fail "shadow.eps $opts: $copies copies of the input"
+	render "$out" "shadow.eps $opts"
+done
+
+# -z deflates every copy of the input, in ASCII85 so the output
+# stays text; -Z in binary, as does -e with either in its one copy
+for opts in "-p2x2A4 -z" "-p2x2A4 -Z" "-p2x2A4 -e -z" "-p2x2A4 -e -Z"
+do	if ! $tile $opts "$dir/shadow.eps" >"$out" 2>"$out.err"
+	then	fail "shadow.eps $opts: `cat "$out.err"`"
+		continue
+	fi
+	dsc "$out" "shadow.eps $opts"
+	grep -q '^newpath 10 10 moveto' "$out" &&
+		fail "shadow.eps $opts: the input is not compressed"
+	flates=`grep -ac 'FlateDecode' "$out"`
+	case "$opts" in
+	  *-e*) pages=1 ;;
+	  *) pages=`grep -c '^%%Page:' "$out"` ;;
+	esac
+	[ "$flates" = "$pages" ] || fail "shadow.eps $opts: $flates copies of $pages"
+	case "$opts" in
+	  *-z*)	LC_ALL=C grep -q '[^[:print:][:space:]]' "$out" &&
+			fail "shadow.eps $opts: binary in the output"
+		grep -q 'ASCII85Decode' "$out" || fail "shadow.eps $opts: not ASCII85" ;;
+	  *)	LC_ALL=C grep -q '[^[:print:][:space:]]' "$out" ||
+			fail "shadow.eps $opts: no binary in the output" ;;
+	esac
+	render "$out" "shadow.eps $opts"
+done
+
+# -F embeds the input once, as a form that every page draws
+for opts in "-p2x2A4 -F" "-p3x2A4 -F -z"
+do	if ! $tile $opts "$dir/shadow.eps" >"$out" 2>"$out.err"
+	then	fail "shadow.eps $opts: `cat "$out.err"`"
+		continue
+	fi
+	dsc "$out" "shadow.eps $opts"
+	[ "`grep -c '^	/FormType 1$' "$out"`" = 1 ] || fail "shadow.eps $opts: not one form"
+	grep -q '^/tileinput { tileform execform } bind def$' "$out" ||
+		fail "shadow.eps $opts: the pages do not draw the form"
+	[ "`grep -c '^tileinput$' "$out"`" = "`grep -c '^%%Page:' "$out"`" ] ||
+		fail "shadow.eps $opts: not every page draws the input"
+	render "$out" "shadow.eps $opts"
+done
+
+# more than the 400 pages of old, and -n splitting the output into
+# documents of their own, with the labels of the pages running on
+$tile -p25x20A4 "$dir/shadow.eps" >"$out" 2>"$out.err" || fail "-p25x20A4: `cat "$out.err"`"
+dsc "$out" "-p25x20A4"
+[ "`grep -c '^%%Page:' "$out"`" -gt 400 ] || fail "-p25x20A4: not over 400 pages"
+mkdir "$out.d"
+if $tile -p3x3A4 -n4 -o "$out.d/poster.ps" "$dir/shadow.eps" 2>"$out.err"
+then	for f in 1:5 2:4 3:1
+	do	dsc "$out.d/poster-${f%%:*}.ps" "-n4 poster-${f%%:*}.ps" ${f#*:}
+	done
+	[ "`cat "$out.d"/poster-?.ps | grep '^%%Page:' | awk '{ printf "%s ", $2 }'`" = \
+	  "1 2 3 4 5 6 7 8 9 10 " ] || fail "-n4: the pages are not labelled 1 to 10"
+else	fail "-n4: `cat "$out.err"`"
+fi
+rm -rf "$out.d"
+
+# a directory of -o has a file for every tile, and a template names
+# them by their row and column; the cover goes with the first tile
+mkdir "$out.d" "$out.d/rc"
+if $tile -p4x3A4 -o "$out.d/" "$dir/shadow.eps" 2>"$out.err" &&
+   $tile -p4x3A4 -o "$out.d/rc/r%r-c%c.ps" "$dir/shadow.eps" 2>"$out.err"
+then	[ "`cd "$out.d" && echo tile-*.ps`" = "tile-01.ps tile-02.ps tile-03.ps \
+tile-04.ps tile-05.ps tile-06.ps tile-07.ps tile-08.ps tile-09.ps tile-10.ps \
+tile-11.ps tile-12.ps" ] ||
+		fail "-o dir/: `cd "$out.d" && echo *.ps`"
+	[ "`cd "$out.d/rc" && echo *.ps`" = "r1-c1.ps r1-c2.ps r1-c3.ps r1-c4.ps \
+r2-c1.ps r2-c2.ps r2-c3.ps r2-c4.ps r3-c1.ps r3-c2.ps r3-c3.ps r3-c4.ps" ] ||
+		fail "-o r%r-c%c.ps: `cd "$out.d/rc" && echo *.ps`"
+	for f in "$out.d"/tile-*.ps "$out.d"/rc/*.ps
+	do	case "$f" in
+		  */tile-01.ps|*/r1-c1.ps) dsc "$f" "-o `basename "$f"`" 2 ;;
+		  *) dsc "$f" "-o `basename "$f"`" 1 ;;
+		esac
+	done
+else	fail "-o dir/: `cat "$out.err"`"
+fi
+rm -rf "$out.d"
+
+# -P prints some pages, which keep their labels, and -X tells where
+# each one is: the bytes at its offset are the blank line and the
+# %%Page that begin it, and the pages run from the prolog of the
+# file to its trailer
+at()
+{	tail -c +`expr $2 + 1` "$1" | head -n 2 | tr '\n' '|'
+}
+mkdir "$out.d"
+if $tile -p3x3A4 -P1,3-5,9- -n3 -X "$out.x" -o "$out.d/poster.ps" \
+	"$dir/shadow.eps" 2>"$out.err"
+then	[ "`cat "$out.d"/poster-?.ps | grep '^%%Page:' | awk '{ printf "%s ", $2 }'`" = \
+	  "1 3 4 5 9 10 " ] || fail "-P1,3-5,9-: not the pages 1 3 4 5 9 10"
+	dsc "$out.d/poster-1.ps" "-P poster-1.ps" 4
+	dsc "$out.d/poster-2.ps" "-P poster-2.ps" 2
+	grep -e '^file' -e '^page' "$out.x" >"$out.gs"
+	while read kind a b c d e f
+	do	case $kind in
+		  file)	eval "file$a=\$e"
+			[ "`wc -c <"$e"`" -eq "$d" ] || fail "-X: $e is not $d bytes"
+			at "$e" $b | grep -q '^|%%Page:' ||
+				fail "-X: no page at $b of $e"
+			[ "`at "$e" $c`" = "%%EOF|" ] ||
+				fail "-X: no trailer at $c of $e" ;;
+		  page)	eval "name=\$file$b"
+			at "$name" $e | grep -q "^|%%Page: $a " ||
+				fail "-X: page $a is not at $e of $name"
+			at "$name" `expr $e + $f` | grep -q -e '^|%%Page:' -e '^%%EOF|$' ||
+				fail "-X: page $a is not $f bytes" ;;
+		esac
+	done <"$out.gs"
+	[ "`grep -c '^page' "$out.x"`" = 6 ] || fail "-X: not 6 pages"
+else	fail "-P -X: `cat "$out.err"`"
+fi
+rm -rf "$out.d" "$out.x"
+
+# an input of several pages has a poster of each, sized by its own
+# %%PageBoundingBox, of only that page; -I picks some of them
+boxes()
+{	awk '/^%%Page:/ { p = $3 } /^[0-9]+ [0-9]+ box$/ { printf "%s:%s ", p, $1 }' "$1"
+}
+for f in :1,2,3 -I2:2 -I1,3:1,3 -I2-:2,3
+do	opts=${f%%:*}
+	pages=${f#*:}
+	if ! $tile -p2x2A4 $opts "$dir/pages.ps" >"$out" 2>"$out.err"
+	then	fail "pages.ps $opts: `cat "$out.err"`"
+		continue
+	fi
+	want= n=0
+	for i in `echo $pages | tr , ' '`
+	do	case $i in
+		  1) scale=1.07 box=100 ;;
+		  2) scale=0.758 box=1500 ;;
+		  3) scale=1.07 box=200 ;;
+		esac
+		grep -q -e "^% Print page $i of .* with $scale magnification$" \
+		  -e "^% Print poster .* with $scale magnification$" "$out" ||
+			fail "pages.ps $opts: page $i not at $scale"
+		for k in 1 2 3 4 5
+		do	n=`expr $n + 1`
+			want="$want$n:$box "
+		done
+	done
+	dsc "$out" "pages.ps $opts" $n
+	[ "`boxes "$out"`" = "$want" ] ||
+		fail "pages.ps $opts: `boxes "$out"`, not $want"
+	render "$out" "pages.ps $opts"
+done
+
+# several media of -m give an output each, as each media by itself
+mkdir "$out.d"
+for opts in "-p3x3A4" "-p3x3A4 -e"
+do	if ! $tile -mA4,Letter $opts -o "$out.d/poster.ps" "$dir/shadow.eps" 2>"$out.err"
+	then	fail "-mA4,Letter $opts: `cat "$out.err"`"
+		continue
+	fi
+	for m in A4 Letter
+	do	dsc "$out.d/poster-$m.ps" "-mA4,Letter $opts: poster-$m.ps"
+		grep -q "^%%DocumentMedia: $m " "$out.d/poster-$m.ps" ||
+			fail "-mA4,Letter $opts: poster-$m.ps is not on $m"
+		$tile -m$m $opts "$dir/shadow.eps" 2>"$out.err" |
+			cmp -s - "$out.d/poster-$m.ps" ||
+			fail "-mA4,Letter $opts: poster-$m.ps is not the poster of -m$m"
+	done
+done
+rm -rf "$out.d"
+
+# the threads of -j change nothing in the output
+for opts in "-p4x4A4" "-p4x4A4 -C" "-p4x4A4 -z" "-p4x4A4 -C -Z -B"
+do	$tile -j1 $opts "$dir/crop.eps" >"$out" 2>"$out.err" ||
+		fail "crop.eps -j1 $opts: `cat "$out.err"`"
+	$tile -j4 $opts "$dir/crop.eps" 2>"$out.err" | cmp -s - "$out" ||
+		fail "crop.eps $opts: -j4 is not the output of -j1"
+done
+
+# a prolog that saves, and a trailer that restores it: the
+# prolog stays on every page, so every page restores its own save
+for opts in "-p2x2A4" "-p2x2A4 -e" "-p3x3A4 -B" "-p2x2A4 -F"
+do	if ! $tile $opts "$dir/saveprolog.eps" >"$out" 2>"$out.err"
+	then	fail "saveprolog.eps $opts: `cat "$out.err"`"
+		continue
+	fi
+	pages=`grep -c '^%%Page:' "$out"`
+	saves=`grep -c '^save$' "$out"`
+	restores=`grep -c '^end restore$' "$out"`
+	case "$opts" in
+	  *-e*|*-F*) pages=1 ;;	# embedded once, and replayed
+	esac
+	[ "$saves" = "$pages" ] || fail "saveprolog.eps $opts: $saves saves in $pages pages"
+	[ "$restores" = "$pages" ] || fail "saveprolog.eps $opts: $restores restores in $pages pages"
+	grep -q 'count tileops sub 2 sub dup 0 lt' "$out" ||
+		fail "saveprolog.eps $opts: tileepilog counts below the input"
+	render "$out" "saveprolog.eps $opts"
+done
+
+# a prolog that begins a dict of its own: the filter of a
+# compressed page is bound in tiledict, where the input's end
+# after the page can't take it away before it is flushed
+for opts in "-p2x2A4 -z" "-p2x2A4 -Z"
+do	if ! $tile $opts "$dir/dictprolog.eps" >"$out" 2>"$out.err"
+	then	fail "dictprolog.eps $opts: `cat "$out.err"`"
+		continue
+	fi
+	grep -q '^/tilesource' "$out" &&
+		fail "dictprolog.eps $opts: tilesource defined in the dict of the input"
+	filters=`grep -c 'currentfile /ASCII85Decode filter put$' "$out"`
+	flushes=`grep -c '^tiledict /tilesource get flushfile$' "$out"`
+	[ "$filters" = "$flushes" ] ||
+		fail "dictprolog.eps $opts: $flushes flushes of $filters filters"
+	render "$out" "dictprolog.eps $opts"
+done
+
+# the prolog is printed once, and with -K kept on every page
+for opts in "-p2x2A4" "-p2x2A4 -K"
+do	if ! $tile $opts "$dir/dictprolog.eps" >"$out" 2>"$out.err"
+	then	fail "dictprolog.eps $opts: `cat "$out.err"`"
+		continue
+	fi
+	pages=`grep -c '^%%Page:' "$out"`
+	prologs=`grep -c '^/mydict 20 dict def$' "$out"`
+	case "$opts" in
+	  *-K*) ;;
+	  *) pages=1 ;;
+	esac
+	[ "$prologs" = "$pages" ] ||
+		fail "dictprolog.eps $opts: the prolog $prologs times, not $pages"
+	render "$out" "dictprolog.eps $opts"
+done
+
+# a procedure of the input under the name of a shorthand: the
+# line of f crosses every tile, so none is blank or left out;
+# nor are any with an operator the scan does not know, that
+# may move the square it draws after it to any other tile
+for f in shadow.eps unknownctm.eps
+do	all=`$tile -p3x3A4 "$dir/$f" | grep -c '^%%Page:'`
+	for opts in "-p3x3A4 -C" "-p3x3A4 -B"
+	do	if ! $tile -v -v $opts "$dir/$f" >"$out" 2>"$out.err"
+		then	fail "$f $opts: `cat "$out.err"`"
+			continue
+		fi
+		pages=`grep -c '^%%Page:' "$out"`
+		[ "$pages" = "$all" ] || fail "$f $opts: $pages pages of $all"
+		grep -q 'Culling: [1-9]' "$out.err" && fail "$f $opts: `grep Culling "$out.err"`"
+		grep -q 'Skipping [1-9]' "$out.err" && fail "$f $opts: `grep Skipping "$out.err"`"
+		render "$out" "$f $opts"
+	done
+done
+
+# -A crops to what is drawn, and not at all when a path is in
+# doubt: an f of its own, or a procedure the scan does not know
+for f in crop.eps:100,200,300,400 shadow.eps: cropdoubt.eps: unknownctm.eps:
+do	bb=${f#*:}
+	f=${f%%:*}
+	if ! $tile -v -p2x2A4 -A "$dir/$f" >"$out" 2>"$out.err"
+	then	fail "$f -A: `cat "$out.err"`"
+		continue
+	fi
+	if [ -n "$bb" ]
+	then	grep -q "^Cropped input image \[0,0,1000,1000\] to \[$bb\]" "$out.err" ||
+			fail "$f -A: not cropped to [$bb]: `grep -i crop "$out.err"`"
+	else	grep -q "^Not cropping, since not all marks could be located" "$out.err" ||
+			fail "$f -A: `grep -i crop "$out.err"`"
+	fi
+	render "$out" "$f -A"
+done
+
+# the labels of -l: a file of the language in the current directory,
+# else the table of en and nl, else English; a broken file fails;
+# several languages give an output each
+labels()
+{	(cd "$out.d" && "$abstile" -p2x2A4 -l$1 "$absdir/shadow.eps" >"$out" 2>"$out.err") ||
+		fail "-l $1: `cat "$out.err"`"
+	grep -q "^	($2 ) show$" "$out" || fail "-l $1: no label '$2'"
+}
+abstile=`cd "\`dirname "$tile"\`" && pwd`/`basename "$tile"`
+absdir=`cd "$dir" && pwd`
+mkdir "$out.d"
+labels nl Pagina
+labels fr Page
+printf '"%s": "%s"\n' "cover page" Kaft x y Page Blad row rij column kolom >"$out.d/tile.nl.yml"
+labels nl Blad
+echo '"Page": "Seite' >"$out.d/tile.de.yml"
+(cd "$out.d" && "$abstile" -p2x2A4 -lde "$absdir/shadow.eps" >"$out" 2>"$out.err") &&
+	fail "-lde: a broken language file is used"
+grep -q "^Error in language file tile.de.yml!$" "$out.err" ||
+	fail "-lde: `cat "$out.err"`"
+rm -f "$out.d/tile.nl.yml" "$out.d/tile.de.yml"
+(cd "$out.d" && "$abstile" -p2x2A4 -len,nl -o poster-%l.ps "$absdir/shadow.eps" 2>"$out.err") ||
+	fail "-len,nl: `cat "$out.err"`"
+grep -q "^	(Page ) show$" "$out.d/poster-en.ps" || fail "-len,nl: no English poster"
+grep -q "^	(Pagina ) show$" "$out.d/poster-nl.ps" || fail "-len,nl: no Dutch poster"
+rm -rf "$out.d"
+
+# a poster of -p takes the sheets that cover 95% of it, as tile
+# always did; with -M or -B, which weigh layouts, whole sheets
+for f in :19 -B:20 -M:20
+do	opts=${f%%:*}
+	rows=${f#*:}
+	$tile -v $opts -p20x1A4 "$dir/shadow.eps" 2>"$out.err" >"$out" ||
+		fail "-p20x1A4 $opts: `cat "$out.err"`"
+	grep -q "^Deciding for 1 column and $rows rows" "$out.err" ||
+		fail "-p20x1A4 $opts: `grep '^Deciding for 1' "$out.err"`, not $rows rows"
+done
+
+# compressed input, from a file or a pipe, makes the poster
+# of what it unpacks to
+if command -v gzip >/dev/null 2>&1
+then	$tile -p2x2A4 "$dir/shadow.eps" | unnamed >"$out"
+	gzip -c "$dir/shadow.eps" >"$out.gz"
+	$tile -p2x2A4 "$out.gz" | unnamed | cmp -s - "$out" ||
+		fail "gzip file: not the poster of the input"
+	$tile -p2x2A4 - <"$out.gz" | unnamed | cmp -s - "$out" ||
+		fail "gzip pipe: not the poster of the input"
+	rm -f "$out.gz"
+fi
+
+# the server answers a request with what the command line would
+# print, for a file and for data on the connection, and refuses
+# a request that would have it write a file
+ask()
+{	perl -MIO::Socket::UNIX -e '$s = IO::Socket::UNIX->new( Peer => shift) or die "$!\n";
+		local $/; print $s <STDIN>; shutdown( $s, 1); print <$s>' "$out.sock"
+}
+if command -v perl >/dev/null 2>&1
+then	rm -f "$out.sock"
+	$tile -S "$out.sock" -mA4 2>"$out.err" &
+	server=$!
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do	[ -S "$out.sock" ] && break
+		sleep 1
+	done
+	$tile -p2x2A4 "$dir/shadow.eps" >"$out" 2>/dev/null
+	printf '%s\n' -p2x2A4 "file $dir/shadow.eps" | ask >"$out.gs"
+	{ sed -n 1p "$out.gs" | grep -q '^OK$' && sed 1d "$out.gs" | cmp -s - "$out"; } ||
+		fail "-S file: `head -2 "$out.gs"`"
+	{ printf '%s\n' -p2x2A4 "data `wc -c <"$dir/shadow.eps"` $dir/shadow.eps"
+	  cat "$dir/shadow.eps"; } | ask >"$out.gs"
+	{ sed -n 1p "$out.gs" | grep -q '^OK$' && sed 1d "$out.gs" | cmp -s - "$out"; } ||
+		fail "-S data: `head -2 "$out.gs"`"
+	printf '%s\n' -p2x2A4 "-X$out.x" "file $dir/shadow.eps" | ask >"$out.gs"
+	{ grep -q '^ERROR 6$' "$out.gs" && [ ! -e "$out.x" ]; } ||
+		fail "-S -X: `head -2 "$out.gs"`"
+	# a few kilobytes that unpack to more than the server takes
+	if command -v gzip >/dev/null 2>&1
+	then	head -c 70000000 /dev/zero | gzip -c >"$out.x"
+		{ printf '%s\n' -p2x2A4 "data `wc -c <"$out.x"` bomb"
+		  cat "$out.x"; } | ask >"$out.gs"
+		grep -q '^ERROR 2$' "$out.gs" || fail "-S gzip: `head -2 "$out.gs"`"
+		rm -f "$out.x"
+	fi
+	kill $server
+	wait $server 2>/dev/null
+	rm -f "$out.sock"
+fi
+
+rm -f "$out" "$out.err" "$out.gs"
+[ $failed = 0 ] && echo "All checks passed"
+exit $failed
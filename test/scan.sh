@@ -0,0 +1,61 @@
+#!/bin/sh
+#  scan.sh - the comment line search of each build of tilebench
+#
+#  Makes inputs with the edge cases of the search, and checks that
+#  every program lists the same segments for them as the first.
+#  A program named *avx2 is skipped on a CPU without AVX2.
+#  Usage: scan.sh <tilebench program>...
+
+out=${TMPDIR:-/tmp}/tilescan.$$
+failed=0
+
+fail()
+{	echo "FAIL: $*"
+	failed=1
+}
+
+# n x's, to move what follows across the 16 and 32 byte blocks
+pad()
+{	printf "%$1s" "" | tr ' ' x
+}
+
+mkdir -p "$out" || exit 1
+printf '%%!PS\nbody\n\004\n' >"$out/ctrld-nl"
+printf '%%!PS\nbody\n\004' >"$out/ctrld"
+printf '%%!PS\nbody\n%%%%EOF\n' >"$out/trailer-nl"
+printf '%%!PS\nbody\n%%%%EOF' >"$out/trailer"
+printf '%%!PS\nbody\n%%' >"$out/percent"
+printf '%%!PS\r\nbody\r\n%%%%Page: 1 1\r\nmore\r\n%%%%EOF\r\n' >"$out/crlf"
+printf '\n\n%%a\n\n\nbody\n\n%%b\n\n' >"$out/empty"
+printf 'a%%b\n%%\n%%c\nd\n' >"$out/inline"
+printf '' >"$out/nothing"
+n=0
+while [ $n -le 70 ]
+do	{ pad $n; printf '\n%%c\nbody\n'; pad $n; printf '\n%%'; } >"$out/block$n"
+	{ pad $n; printf '\n%%c\r\n'; pad $n; printf '\n\004'; } >"$out/blockd$n"
+	n=`expr $n + 1`
+done
+
+first=
+for prog
+do	case "$prog" in
+	  *avx2) if [ -r /proc/cpuinfo ] && ! grep -qw avx2 /proc/cpuinfo
+		then	echo "$prog: skipped, no AVX2 on this CPU"
+			continue
+		fi ;;
+	esac
+	for f in "$out"/*
+	do	[ -f "$f" ] || continue
+		case "$f" in *.seg) continue ;; esac
+		if [ -z "$first" ]
+		then	$prog -s "$f" >"$f.seg" || fail "$prog: `basename "$f"`"
+		else	$prog -s "$f" | cmp -s - "$f.seg" ||
+				fail "$prog: `basename "$f"`: not the segments of $first"
+		fi
+	done
+	[ -z "$first" ] && first=$prog
+done
+
+rm -rf "$out"
+[ $failed = 0 ] && echo "All scans agree"
+exit $failed
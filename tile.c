@@ -10,12 +10,13 @@
 #  (encapsulated postscript) conventions but it will work for many
 #  'normal' postscript files as well.
 #
-#  Compile this program with:
-#        cc -O -o tile tile.c -lm
-#  or something alike.
+#  This is the tile library: TileRun() does all of the above for
+#  one job, described by a struct tilejob (see tile.h). The command
+#  line program in tilemain.c is one user of it. Build both with:
+#        make
 #
 #  Maybe you want to change the `DefaultMedia' and `DefaultImage'
-#  settings in the few lines below, to reflect your local situation.
+#  settings in tile.h, to reflect your local situation.
 #  Names can to be chosen from the `mediatable' further down.
 #
 #  The `Gv_gs_orientbug 1' disables a feature of this program to
@@ -32,7 +33,8 @@
 #  I (joost) have yet to make this optional, and update the man page.
 #
 #  Tile has now support for language files
-#  (tile.<2 letter language code>.yml, "tile.en.yml")
+#  (tile.<2 letter language code>.yml, "tile.en.yml"), and has
+#  English and Dutch built in
 #
 # --------------------------------------------------------------
 #  Tile is a fork of 'poster' by Jos T.J. van Eijndhoven
@@ -47,72 +49,251 @@
 */
 
 #define Gv_gs_orientbug 1
-#define DefaultMedia  "A4"
-#define DefaultImage  "A4"
-#define DefaultCutMargin "5%"
-#define DefaultWhiteMargin "0"
 #define BUFSIZE 1024
-#define DefaultLanguage "en"
+#define EmbedMarker "%TileEndOfInput"
+#define TRAILERMAX 65536
+#define MAXSHEETS 100000	/* more seems ridiculous */
+#define MAXPLANS 64	/* layouts weighed by postersize() */
+#define GRIDSTEPS 5	/* places of the image on the grid tried each way with -B, odd */
+#define NUMLEN 11	/* the widest int, "-2147483648", in a part name */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <string.h>
+#include <errno.h>
 #include <ctype.h>
 #include <math.h>
+#include <pthread.h>
 
+#include "tile.h"
 #include "tilelang.h"
+#include "tileinput.h"
+#include "tilegeom.h"
+#include "tilepage.h"
+
+/* everything about one poster */
+struct tilejob
+{	struct tileoptions opt;	/* as given, with the defaults filled in */
+	struct tileinput input;
+	int gotinput;
+	struct tileoutput out;
+	struct tilecache *cache;
+	struct tilegeom geom;
+	int scanned;		/* GeomScan() has been run */
+
+	int rotate, nrows, ncols;
+	int tail_cntl_D;
+	struct tilesegment *dsc;	/* input DSC lines for the output header */
+	int ndsc, dscroom;
+	int *rowfirst;		/* printed tiles before each row, [nrows] all */
+	struct tilejob *root;	/* the job that prints this poster, or itself */
+	int inpage;		/* the page of the input of this poster */
+	struct tilejob **variants;	/* of several media, a job each, */
+	int nvariants;
+	char *medialist;	/* with the media names in here */
+	char *made[2];		/* outname and indexname of a variant */
+	struct inputpage *inpages;	/* of -I, of an input with several, */
+	int ninpages;		/* this many, */
+	size_t inhead, intrailer;	/* and where its pages and trailer start */
+	struct tilejob **posters;	/* the posters the root prints, of the */
+	int nposters;		/* input pages, or just the root itself */
+	int *posterfirst;	/* pages before each poster, [nposters] all */
+	int *pick;		/* of the pages these, with -P, */
+	int npick;		/* this many */
+	int *partfirst;		/* pages of pick before each part, [nparts] all */
+	struct edition *editions;	/* of the languages of -l, the output */
+	int neditions;		/* in each, */
+	char *langlist;		/* with the language codes in here */
+	struct tilepage setup;	/* the document setup, the same in every file */
+	char *outname;		/* TileOutputFiles(), */
+	int nparts;		/* and the number of files */
+	double posterbb[4];	/* final image in ps units */
+	double imagebb[4];	/* original image in ps units */
+	double mediasize[4];	/* [34] = size of media to print on, [01] not used! */
+	double cutmargin[2];
+	double whitemargin[2];
+	double scale;		/* linear scaling factor */
+
+	int code;		/* what went wrong, */
+	char error[2048];	/* and the details */
+};
+
+/* the output in one language of -l: all editions have */
+/* the same pages, only their prologs differ */
+struct edition
+{	char *code;		/* of the language, */
+	struct tilelang *lang;	/* and its prompts, NULL the English ones */
+	struct tilelang own;	/* read for this job, without a cache */
+	struct tilepage prolog;
+	char *outname;		/* the files of this edition, */
+	char *indexname;	/* and its index of -X */
+	struct pageindex *index;	/* with -X, where the pages went, */
+	struct fileindex *files;	/* and what is around them */
+};
+
+/* one document of the output, as printpart() writes it */
+struct tilepart
+{	struct tilejob *j;
+	struct tileoutput *out;	/* of each edition */
+	int part;		/* 1.. of j->nparts, 0 for TileOutputFd() */
+	int first, npages;	/* the pages of pick in it */
+	int code;		/* what went wrong */
+};
+
+/* the files that the writer threads of printposter() share */
+struct partpool
+{	struct tilejob *j;
+	pthread_mutex_t lock;
+	int next;		/* part to take */
+	int threads;		/* to build the pages of a part */
+	int code;		/* the first failure, */
+	char *name;		/* and the file it could not open */
+};
+
+/* a page of the output, for the index of -X */
+struct pageindex
+{	int page, part;
+	int row, col;
+	size_t off, len;	/* in the file of the part */
+};
+
+/* a file of the output: the pages are after its prolog */
+/* and before its trailer */
+struct fileindex
+{	size_t prolog, trailer, size;
+};
+
+/* a page of the input, as inputpages() finds it */
+struct inputpage
+{	int number;		/* 1.. */
+	size_t off, end;
+	double bb[4];		/* of its %%PageBoundingBox, */
+	int gotbb;		/* if it has one */
+};
+
+/* the posters that the threads of planposters() share, */
+/* or the media of variants() */
+struct planpool
+{	struct tilejob *j;
+	pthread_mutex_t lock;
+	int next;		/* poster or media to take */
+	int failed;
+};
 
+/* one way to lay out the poster, as postersize() weighs them */
+struct tileplan
+{	char *media;		/* name and size of the media */
+	double mediasize[4];
+	double cutmargin[2];
+	double whitemargin[2];
+	int rotate, ncols, nrows;
+	double scale;
+	double posterbb[4];
+	int sheets;		/* in the grid, */
+	int printed;		/* and of those the ones that show anything */
+};
 
-extern char *optarg;        /* silently set by getopt() */
-extern int optind, opterr;  /* silently set by getopt() */
-
-static void usage();
-static void dsc_head1();
-static int dsc_infile( double ps_bb[4]);
-static void dsc_head2( void);
-static void printposter( void );
-static void printprolog();
-static void tile ( int row, int col, int nrows, int ncols);
-static void cover ( int row, int col);
-static void printfile( void);
-static void postersize( char *scalespec, char *posterspec);
-static void box_convert( char *boxspec, double psbox[4]);
-static void boxerr( char *spec);
-static void margin_convert( char *spec, double margin[2]);
+static void dsc_head1( struct tilejob *j, struct tileoutput *o);
+static int dsc_infile( struct tilejob *j, double ps_bb[4]);
+static size_t findtrailer( struct tileinput *in);
+static void dsc_head2( struct tilejob *j, struct tileoutput *o, int pages, int part);
+static int dscline( struct tilejob *j, size_t pos, size_t end);
+static int hoist( struct tilejob *j);
+static int vmcheck( struct tilejob *j);
+static int mediasetup( struct tilejob *j);
+static int printmedia( struct tilejob *j, struct tilejob *from);
+static int variants( struct tilejob *j);
+static void *mediarunner( void *arg);
+static char *withcode( char *name, int key, char *code);
+static int languages( struct tilejob *j);
+static int editionnames( struct tilejob *j);
+static char *editionname( struct tilejob *j, char *name, char *code);
+static void unlinkparts( struct tilejob *j);
+static int inputpages( struct tilejob *j);
+static int makeposters( struct tilejob *j, struct tilejob *from);
+static int planposters( struct tilejob *j);
+static void *planner( void *arg);
+static int plan( struct tilejob *j);
+static void *writer( void *arg);
+static int printpart( struct tilepart *pt, int threads);
+static int partlist( struct tilejob *j, int per);
+static char *partname( struct tilejob *j, struct edition *e, int part);
+static int digits( int n);
+static int partfail( struct tilejob *j, int code, char *name);
+static void tileof( struct tilejob *j, int n, int *row, int *col);
+static int pageof( struct tilejob *j, int page, int *n);
+static char *pagebits( struct tilejob *j, char *spec, int pages, char *what);
+static int pagelist( struct tilejob *j, int pages);
+static int indexroom( struct tilejob *j, int files);
+static int printindex( struct tilejob *j);
+static int indexfile( struct tilejob *j, struct edition *e);
+static int printposter( struct tilejob *j);
+static void printprolog( struct tilejob *j, struct edition *e);
+static void printsetup( struct tilejob *j, struct tilepage *s);
+static void posterdefs( struct tilejob *j, struct tilepage *s);
+static void embed( struct tilejob *j, struct tilepage *s, int k);
+static void prolog( struct tilejob *j, struct tilelang *lang, struct tilepage *p);
+static const char *cachedprolog( struct tilejob *j, struct tilelang *lang,
+	size_t *len);
+static int cachedlang( struct tilejob *j, char *code, struct tilelang **lang);
+static int langread( struct tilejob *j, int r, char *code, char *why);
+static void tile ( void *arg, struct tilepage *p, int n);
+static void cover ( struct tilejob *j, struct tilepage *p, int rows, int cols);
+static int emit ( void *arg, struct tilepage *p, int n);
+static void printbody( struct tilejob *j, struct tilepage *p, int row, int col);
+static void printfile( struct tilejob *j, struct tilepage *p, int row, int col);
+static void pageinput( struct tilejob *j, struct tilepage *p,
+	struct tilesegment *seg, int nseg);
+static int geomsetup( struct tilejob *j);
+static int skipped( struct tilejob *j, int row, int col);
+static int postersize( struct tilejob *j);
+static int planmedia( struct tilejob *j, int media, struct tileplan *pl);
+static void plangrid( struct tilejob *j, struct tileplan *pl, double poster[4]);
+static int planblank( struct tilejob *j, struct tileplan *pl);
+static int better( struct tileplan *a, struct tileplan *b);
+static void getplan( struct tilejob *j, struct tileplan *pl);
+static void useplan( struct tilejob *j, struct tileplan *pl);
+static void tilegrid( struct tilejob *j, double grid[5]);
+static int scan( struct tilejob *j);
+static int autocrop( struct tilejob *j);
+static int box_convert( struct tilejob *j, char *boxspec, double psbox[4]);
+static int boxerr( struct tilejob *j, char *spec);
+static int margin_convert( struct tilejob *j, char *spec, double margin[2]);
+static int fail( struct tilejob *j, int code, const char *fmt, ...);
+static int toobig( struct tilejob *j, char *name);
 static int mystrncasecmp( const char *s1, const char *s2, int n);
 
-int verbose;
-int alignment = 0;
-char *myname;
-char *infile;
-int rotate, nrows, ncols;
-int manualfeed = 0;
-int tail_cntl_D = 0;
 #define Xl 0
 #define Yb 1
 #define Xr 2
 #define Yt 3
 #define X 0
 #define Y 1
-double posterbb[4];	/* final image in ps units */
-double imagebb[4];	/* original image in ps units */
-double mediasize[4];	/* [34] = size of media to print on, [01] not used! */
-double cutmargin[2];
-double whitemargin[2];
-double scale;		/* linear scaling factor */
-
-/* defaults: */
-char *imagespec = NULL;
-char *posterspec = NULL;
-char *mediaspec = NULL;
-char *cutmarginspec = NULL;
-char *whitemarginspec = NULL;
-char *scalespec = NULL;
-char *filespec = NULL;
-char *patterntitle = NULL;
-char *patternurl = NULL;
-char *language = NULL;
+
+/* what the jobs using a cache share: languages and prologs */
+/* are added once, and kept until TileCacheFree() */
+struct cachelang
+{	char code[3];
+	struct tilelang lang;
+	struct cachelang *next;
+};
+
+struct cacheprolog
+{	struct tilelang *lang;	/* NULL for the English prompts */
+	int alignment, skipblank;
+	char *text;
+	size_t len;
+	struct cacheprolog *next;
+};
+
+struct tilecache
+{	pthread_mutex_t lock;
+	struct cachelang *langs;
+	struct cacheprolog *prologs;
+};
 
 /* media sizes in ps units (1/72 inch) */
 static char *mediatable[][2] =
@@ -148,570 +329,2387 @@ static char *mediatable[][2] =
 };
 
 
-int main( int argc, char *argv[])
+/*********************************************/
+/* options as the command line has them      */
+/* without any flags                         */
+/*********************************************/
+void TileDefaults( struct tileoptions *opt)
+{
+	memset( opt, 0, sizeof( *opt));
+	opt->nthreads = 1;
+	opt->creator = "tile";
+}
+
+/*********************************************/
+/* set the option of a command line flag,    */
+/* arg is kept; returns non-zero when the    */
+/* flag is not a job option                  */
+/*********************************************/
+int TileOption( struct tileoptions *opt, int flag, char *arg)
 {
-	int opt;
-	double ps_bb[4];
-	int got_bb;
-
-	myname = argv[0];
-
-	while ((opt = getopt( argc, argv, "vafi:c:l:w:m:p:s:o:t:h:u:")) != EOF)
-	{	switch( opt)
-		{ case 'v':	verbose++; break;
-		  case 'f': manualfeed = 1; break;
-		  case 'a': alignment = 1; break;
-		  case 'l': language = optarg; break;
-		  case 'i':	imagespec = optarg; break;
-		  case 'c':	cutmarginspec = optarg; break;
-		  case 'w':	whitemarginspec = optarg; break;
-		  case 'm':	mediaspec = optarg; break;
-		  case 'p':	posterspec = optarg; break;
-		  case 's':	scalespec = optarg; break;
-		  case 'o': filespec = optarg; break;
-		  case 't': patterntitle = optarg; break;
-		  case 'u': patternurl = optarg; break;
-		  default:	usage(); break;
+	switch( flag)
+	{ case 'v':	opt->verbose++; break;
+	  case 'f': opt->manualfeed = 1; break;
+	  case 'a': opt->alignment = 1; break;
+	  case 'e': opt->embed = 1; break;
+	  case 'F': opt->form = 1; break;
+	  case 'z': opt->compress = 1; break;
+	  case 'Z': opt->compress = 2; break;
+	  case 'K': opt->keepprolog = 1; break;
+	  case 'A': opt->autocrop = 1; break;
+	  case 'C': opt->cull = 1; break;
+	  case 'B': opt->skipblank = 1; break;
+	  case 'M': opt->anymedia = 1; break;
+	  case 'j': opt->nthreads = atoi( arg); break;
+	  case 'n': opt->splitpages = atoi( arg); break;
+	  case 'l': opt->language = arg; break;
+	  case 'i':	opt->imagespec = arg; break;
+	  case 'c':	opt->cutmarginspec = arg; break;
+	  case 'w':	opt->whitemarginspec = arg; break;
+	  case 'm':	opt->mediaspec = arg; break;
+	  case 'p':	opt->posterspec = arg; break;
+	  case 's':	opt->scalespec = arg; break;
+	  case 't': opt->patterntitle = arg; break;
+	  case 'u': opt->patternurl = arg; break;
+	  case 'P': opt->pagespec = arg; break;
+	  case 'I': opt->inpagespec = arg; break;
+	  case 'X': opt->indexname = arg; break;
+	  case 'V': opt->vmspec = arg; break;
+	  default:	return 1;
+	}
+	return 0;
+}
+
+/*********************************************/
+/* a new job, NULL when out of memory        */
+/*********************************************/
+struct tilejob *TileNew( struct tileoptions *opt)
+{
+	struct tilejob *j;
+
+	if (!(j = calloc( 1, sizeof( *j))))
+		return NULL;
+	j->opt = *opt;
+	if (!j->opt.creator)
+		j->opt.creator = "tile";
+	j->input.fd = -1;
+	j->out.fd = 1;
+	j->root = j;
+	return j;
+}
+
+/*********************************************/
+/* the input: a file, "-" is standard input  */
+/*********************************************/
+int TileInputFile( struct tilejob *j, char *name)
+{
+	if (j->gotinput)
+		InputClose( &j->input);
+	j->gotinput = 0;
+	if (InputOpen( &j->input, name, j->opt.maxinput))
+		return errno == EFBIG ? toobig( j, name) :
+			fail( j, TILE_EINPUT, "%s: fail to open file '%s'!",
+			j->opt.creator, name);
+	j->gotinput = 1;
+	if (j->input.size == 0)
+		return fail( j, TILE_EINPUT, "%s: failed to read from file '%s'!",
+			j->opt.creator, name);
+	return TILE_OK;
+}
+
+/* an input that unpacks to more than maxinput */
+static int toobig( struct tilejob *j, char *name)
+{
+	return fail( j, TILE_EINPUT, "%s: file '%s' unpacks to more than %zu bytes!",
+		j->opt.creator, name, j->opt.maxinput);
+}
+
+/*********************************************/
+/* the input, from memory the caller keeps   */
+/* until TileFree(); name is for comments    */
+/*********************************************/
+int TileInputMemory( struct tilejob *j, char *data, size_t size, char *name)
+{
+	if (j->gotinput)
+		InputClose( &j->input);
+	j->gotinput = 0;
+	if (InputMemory( &j->input, data, size, name, j->opt.maxinput))
+		return errno == EFBIG ? toobig( j, name) :
+			fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	j->gotinput = 1;
+	if (j->input.size == 0)
+		return fail( j, TILE_EINPUT, "%s: failed to read from file '%s'!",
+			j->opt.creator, name);
+	return TILE_OK;
+}
+
+/*********************************************/
+/* the output: a file descriptor (the        */
+/* default is 1), or a callback returning 0  */
+/* on success                                */
+/*********************************************/
+void TileOutputFd( struct tilejob *j, int fd)
+{
+	j->out.fd = fd;
+	j->out.copy = 0;
+	j->out.write = NULL;
+	j->out.arg = NULL;
+}
+
+void TileOutputCallback( struct tilejob *j,
+	int (*write)( void *arg, const char *buf, size_t len), void *arg)
+{
+	j->out.fd = -1;
+	j->out.write = write;
+	j->out.arg = arg;
+}
+
+/*********************************************/
+/* the output to a file of this name, and    */
+/* with opt.splitpages to several, numbered  */
+/* before the extension: name-1.ps, ...;     */
+/* these are removed again when TileRun()    */
+/* fails                                     */
+/*********************************************/
+void TileOutputFiles( struct tilejob *j, char *name)
+{
+	j->outname = name;
+	j->out.fd = -1;
+	j->out.write = NULL;
+	j->out.arg = NULL;
+}
+
+/*********************************************/
+/* share the language files and prologs of   */
+/* a cache with other jobs, so these are     */
+/* read and formatted once                   */
+/*********************************************/
+void TileUseCache( struct tilejob *j, struct tilecache *c)
+{
+	j->cache = c;
+}
+
+const char *TileError( struct tilejob *j)
+{
+	return j->error;
+}
+
+void TileFree( struct tilejob *j)
+{
+	struct edition *e;
+	int i;
+
+	if (!j)
+		return;
+	for (i = 0; i < j->nposters; i++)
+		if (j->posters[i] != j)
+			TileFree( j->posters[i]);
+	free( j->posters);
+	for (i = 0; i < j->nvariants; i++)
+		TileFree( j->variants[i]);
+	free( j->variants);
+	free( j->medialist);
+	free( j->made[0]);
+	free( j->made[1]);
+	free( j->inpages);
+	free( j->posterfirst);
+	free( j->partfirst);
+	for (i = 0; i < j->neditions; i++)
+	{	e = j->editions + i;
+		LangClose( &e->own);
+		PageFree( &e->prolog);
+		free( e->outname);
+		free( e->indexname);
+		free( e->index);
+		free( e->files);
+	}
+	free( j->editions);
+	free( j->langlist);
+	GeomFree( &j->geom);
+	if (j->gotinput)
+		InputClose( &j->input);
+	OutputClose( &j->out);
+	free( j->dsc);
+	free( j->rowfirst);
+	free( j->pick);
+	PageFree( &j->setup);
+	free( j);
+}
+
+/*********************************************/
+/* a cache for TileUseCache(), for any       */
+/* number of jobs on any number of threads;  */
+/* NULL when out of memory                   */
+/*********************************************/
+struct tilecache *TileCacheNew( void)
+{
+	struct tilecache *c;
+
+	if (!(c = calloc( 1, sizeof( *c))))
+		return NULL;
+	pthread_mutex_init( &c->lock, NULL);
+	return c;
+}
+
+/* after the last job using it is freed */
+void TileCacheFree( struct tilecache *c)
+{
+	struct cachelang *l;
+	struct cacheprolog *p;
+
+	if (!c)
+		return;
+	while ((l = c->langs))
+	{	c->langs = l->next;
+		LangClose( &l->lang);
+		free( l);
+	}
+	while ((p = c->prologs))
+	{	c->prologs = p->next;
+		free( p->text);
+		free( p);
+	}
+	pthread_mutex_destroy( &c->lock);
+	free( c);
+}
+
+/* a language of the job, read at its first use; one that */
+/* cannot be read is not kept, the next job tries again    */
+static int cachedlang( struct tilejob *j, char *code, struct tilelang **lang)
+{
+	struct tilecache *c = j->cache;
+	struct cachelang *l;
+	char why[ 128];
+	int r = LANG_OK;
+
+	pthread_mutex_lock( &c->lock);
+	for (l = c->langs; l; l = l->next)
+		if (!strcmp( l->code, code))
+			break;
+	if (!l && !(l = calloc( 1, sizeof( *l))))
+	{	r = LANG_NOMEM;
+		snprintf( why, sizeof( why), "%s: out of memory!", j->opt.creator);
+	}
+	else if (!l->code[ 0])
+	{	strcpy( l->code, code);
+		r = LangRead( &l->lang, l->code, why, sizeof( why));
+		if (r == LANG_BADFILE || r == LANG_NOMEM)
+		{	free( l);
+			l = NULL;
 		}
+		else
+		{	l->next = c->langs;
+			c->langs = l;
+		}
+	}
+	pthread_mutex_unlock( &c->lock);
+	*lang = l ? &l->lang : NULL;
+	return langread( j, r, code, why);
+}
+
+/* what LangRead() returned for code, as a result of the job */
+static int langread( struct tilejob *j, int r, char *code, char *why)
+{
+	switch (r)
+	{
+	case LANG_NOFILE:
+		if (j->opt.verbose)
+			fprintf( stderr,
+				"Error reading language file for '%s'. Using default language of 'en'\n",
+				code);
+		return TILE_OK;
+	case LANG_BADFILE:
+		return fail( j, TILE_ESPEC, "%s", why);
+	case LANG_NOMEM:
+		return fail( j, TILE_ENOMEM, "%s", why);
 	}
+	return TILE_OK;
+}
 
-	/*** check command line arguments ***/
-	if (scalespec && posterspec)
-	{	fprintf( stderr, "Please don't specify both -s and -o, ignoring -s!\n");
-		scalespec = NULL;
+/* the prolog of the job in a language, formatted at its first use */
+static const char *cachedprolog( struct tilejob *j, struct tilelang *lang,
+	size_t *len)
+{
+	struct tilecache *c = j->cache;
+	struct cacheprolog *p, *q;
+	struct tilepage page;
+
+	pthread_mutex_lock( &c->lock);
+	for (p = c->prologs; p; p = p->next)
+		if (p->lang == lang && p->alignment == j->opt.alignment &&
+		    p->skipblank == j->opt.skipblank)
+			break;
+	pthread_mutex_unlock( &c->lock);
+	if (p)
+	{	*len = p->len;
+		return p->text;
 	}
 
-	if (optind < argc)
-		infile = argv[ optind];
-	else
-	{	fprintf( stderr, "Filename argument missing!\n");
-		usage();
+	/* not under the lock, another job may do the same */
+	memset( &page, 0, sizeof( page));
+	prolog( j, lang, &page);
+	if (page.failed || !(p = malloc( sizeof( *p))))
+	{	PageFree( &page);
+		return NULL;
+	}
+	p->lang = lang;
+	p->alignment = j->opt.alignment;
+	p->skipblank = j->opt.skipblank;
+	p->text = page.text;
+	p->len = page.ntext;
+	page.text = NULL;
+	PageFree( &page);
+
+	pthread_mutex_lock( &c->lock);
+	for (q = c->prologs; q; q = q->next)
+		if (q->lang == lang && q->alignment == p->alignment &&
+		    q->skipblank == p->skipblank)
+			break;
+	if (q)
+	{	free( p->text);
+		free( p);
+		p = q;
+	} else
+	{	p->next = c->prologs;
+		c->prologs = p;
+	}
+	pthread_mutex_unlock( &c->lock);
+	*len = p->len;
+	return p->text;
+}
+
+/*********************************************/
+/* make the poster                           */
+/* returns TILE_OK, or an error code with    */
+/* the reason in TileError()                 */
+/*********************************************/
+int TileRun( struct tilejob *j)
+{
+	double ps_bb[4];
+	int got_bb, several, rc;
+
+	if (!j->gotinput)
+		return fail( j, TILE_EUSAGE, "%s: no input given!", j->opt.creator);
+
+	/*** check the options; what is put right is only told with -v, ***/
+	/*** as a process of many jobs cannot tell whose stderr it was ***/
+	if (j->opt.scalespec && j->opt.posterspec)
+	{	if (j->opt.verbose)
+			fprintf( stderr, "Please don't specify both -s and -o, ignoring -s!\n");
+		j->opt.scalespec = NULL;
+	}
+	if (j->opt.form)
+		j->opt.embed = 1;
+	if (j->opt.embed && j->opt.cull)
+	{	if (j->opt.verbose)
+			fprintf( stderr, "Please don't specify both -%c and -C, ignoring -%c!\n",
+				j->opt.form ? 'F' : 'e', j->opt.form ? 'F' : 'e');
+		j->opt.embed = j->opt.form = 0;
+	}
+	if (j->opt.nthreads < 1)
+	{	if (j->opt.verbose)
+			fprintf( stderr, "Number of threads should be at least 1, using 1!\n");
+		j->opt.nthreads = 1;
 	}
 
 	/*** decide on media size ***/
-	if (!mediaspec)
-	{	mediaspec = DefaultMedia;
-		if (verbose)
+	if (!j->opt.mediaspec)
+	{	j->opt.mediaspec = DefaultMedia;
+		if (j->opt.verbose)
 			fprintf( stderr,
 				"Using default media of %s\n",
-				mediaspec);
+				j->opt.mediaspec);
 	}
-	box_convert( mediaspec, mediasize);
-	if (mediasize[3] < mediasize[2])
-	{	fprintf( stderr, "Media should always be specified in portrait format!\n");
-		exit(1);
+	several = strchr( j->opt.mediaspec, ',') != NULL;
+	if (several && !j->outname)
+		return fail( j, TILE_EUSAGE, "Several media need output files, "
+			"one for each!");
+	if (!several && (rc = mediasetup( j)))
+		return rc;
+	/* %m in the names is the media, of several in variants() */
+	if (!several && j->outname && strstr( j->outname, "%m") &&
+	    !(j->outname = j->made[0] = withcode( j->outname, 'm', j->opt.mediaspec)))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	if (!several && j->opt.indexname && strstr( j->opt.indexname, "%m") &&
+	    !(j->opt.indexname = j->made[1] = withcode( j->opt.indexname,
+		'm', j->opt.mediaspec)))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+
+	/*** get the language codes ***/
+	if ((rc = languages( j)))
+		return rc;
+
+	/******* I might need to read some input to find picture size ********/
+	/* keep input DSC lines for the output, get BoundingBox spec if there */
+	got_bb = dsc_infile( j, ps_bb);
+	if (j->code)
+		return j->code;
+	/* and its prolog, to print once */
+	if (!j->opt.keepprolog && (rc = hoist( j)))
+		return rc;
+	if ((j->opt.verbose || j->opt.vmspec) && (rc = vmcheck( j)))
+		return rc;
+
+	/**** decide the input image bounding box ****/
+	if (!got_bb && !j->opt.imagespec)
+	{	j->opt.imagespec = DefaultImage;
+		if (j->opt.verbose)
+			fprintf( stderr,
+				"Using default input image of %s\n",
+				j->opt.imagespec);
 	}
-	if (mediasize[2]-mediasize[0] <= 10.0 || mediasize[3]-mediasize[1] <= 10.0)
-	{	fprintf( stderr, "Media size is ridiculous!\n");
-		exit(1);
+	if (j->opt.imagespec)
+	{	if ((rc = box_convert( j, j->opt.imagespec, j->imagebb)))
+			return rc;
+	} else
+	{	int i;
+		for (i=0; i<4; i++)
+			j->imagebb[i] = ps_bb[i];
 	}
 
+	if (j->opt.verbose > 1)
+		fprintf( stderr, "   Input image is: [%g,%g,%g,%g]\n",
+			j->imagebb[0], j->imagebb[1], j->imagebb[2], j->imagebb[3]);
+
+	if (j->imagebb[2]-j->imagebb[0] <= 0.0 || j->imagebb[3]-j->imagebb[1] <= 0.0)
+		return fail( j, TILE_ESIZE, "Input image should have positive size!");
+
+	/*** the pages of an input of several, a poster each ***/
+	if ((rc = inputpages( j)))
+		return rc;
+
+	if (several)
+		return variants( j);
+	return printmedia( j, j);
+}
+
+/*********************************************/
+/* the media, and the margins and poster     */
+/* size that depend on it                    */
+/*********************************************/
+static int mediasetup( struct tilejob *j)
+{
+	int rc;
+
+	if ((rc = box_convert( j, j->opt.mediaspec, j->mediasize)))
+		return rc;
+	if (j->mediasize[3] < j->mediasize[2])
+		return fail( j, TILE_ESIZE, "Media should always be specified in portrait format!");
+	if (j->mediasize[2]-j->mediasize[0] <= 10.0 || j->mediasize[3]-j->mediasize[1] <= 10.0)
+		return fail( j, TILE_ESIZE, "Media size is ridiculous!");
+
 	/*** defaulting poster size ? **/
-	if (!scalespec && !posterspec)
+	if (!j->opt.scalespec && !j->opt.posterspec)
 	{	/* inherit postersize from given media size */
-		posterspec = mediaspec;
-		if (verbose)
+		j->opt.posterspec = j->opt.mediaspec;
+		if (j->opt.verbose)
 			fprintf( stderr,
 				"Defaulting poster size to media size of %s\n",
-				mediaspec);
+				j->opt.mediaspec);
 	}
 
 	/*** decide the cutmargin size, after knowing media size ***/
-	if (!cutmarginspec)
+	if (!j->opt.cutmarginspec)
 	{	/* if (!strcmp( posterspec, mediaspec)) */
 			/* zero cutmargin if printing to 1 sheet */
 		/*	marginspec = "0%";
-		else */	cutmarginspec = DefaultCutMargin;
-		if (verbose)
+		else */	j->opt.cutmarginspec = DefaultCutMargin;
+		if (j->opt.verbose)
 			fprintf( stderr,
 				"Using default cutmargin of %s\n",
-				cutmarginspec);
+				j->opt.cutmarginspec);
 	}
-	margin_convert( cutmarginspec, cutmargin);
+	if ((rc = margin_convert( j, j->opt.cutmarginspec, j->cutmargin)))
+		return rc;
 
 	/*** decide the whitemargin size, after knowing media size ***/
-	if (!whitemarginspec)
-	{	whitemarginspec = DefaultWhiteMargin;
-		if (verbose)
+	if (!j->opt.whitemarginspec)
+	{	j->opt.whitemarginspec = DefaultWhiteMargin;
+		if (j->opt.verbose)
 			fprintf( stderr,
 				"Using default whitemargin of %s\n",
-				whitemarginspec);
+				j->opt.whitemarginspec);
 	}
-	margin_convert( whitemarginspec, whitemargin);
+	if ((rc = margin_convert( j, j->opt.whitemarginspec, j->whitemargin)))
+		return rc;
+	return TILE_OK;
+}
 
-	/*** get the language code ***/
-	if (!language)
-	{	language = DefaultLanguage;
-		if (verbose)
-			fprintf( stderr,
-				"Using default language of %s\n",
-				language);
+/*********************************************/
+/* print the posters of the job on its       */
+/* media, of the input pages that from has   */
+/* found                                     */
+/*********************************************/
+static int printmedia( struct tilejob *j, struct tilejob *from)
+{
+	int rc;
+
+	if ((rc = makeposters( j, from)))
+		return rc;
+	if (j->nposters)
+	{	if ((rc = planposters( j)))
+			return rc;
+		return printposter( j);
 	}
-	if( strlen( language ) != 2 )
-	{
-		fprintf( stderr,
-			"Invalid language code '%s''\n",
-			language);
+
+	if (!(j->posters = malloc( sizeof( *j->posters))))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	j->posters[ j->nposters++] = j;
+	if ((rc = plan( j)))
+		return rc;
+	return printposter( j);
+}
+
+/*********************************************/
+/* lay out the poster of a job: the scale,   */
+/* the grid, and the tiles that are printed  */
+/*********************************************/
+static int plan( struct tilejob *j)
+{
+	int row, col, n, rc;
+
+	/*** decide on the scale factor and poster size ***/
+	if (j->opt.skipblank && (rc = scan( j)))
+		return rc;
+	if (j->opt.autocrop)
+	{	if ((rc = autocrop( j)))
+			return rc;
+	} else if ((rc = postersize( j)))
+		return rc;
+
+	if (j->opt.verbose > 1)
+		fprintf( stderr, "   Output image is: [%g,%g,%g,%g]\n",
+			j->posterbb[0], j->posterbb[1], j->posterbb[2], j->posterbb[3]);
+
+
+	if (j->opt.cull || j->opt.skipblank)
+		if ((rc = geomsetup( j)))
+			return rc;
+
+	/* the tiles to print, counted per row: memory by the row, */
+	/* not by the tile, however large the poster */
+	if (!(j->rowfirst = malloc( (j->nrows + 1) * sizeof( *j->rowfirst))))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	for (n = 0, row = 1; row <= j->nrows; row++)
+	{	j->rowfirst[row-1] = n;
+		for (col = 1; col <= j->ncols; col++)
+			if (!skipped( j, row, col))
+				n++;
 	}
-	else if( LangRead( language ) )
-	{
-		fprintf( stderr,
-			"Error reading language file for '%s'. Using default language of 'en'\n",
-			language);
+	j->rowfirst[ j->nrows] = n;
+	return TILE_OK;
+}
+
+/* record what went wrong, returns code */
+static int fail( struct tilejob *j, int code, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start( ap, fmt);
+	vsnprintf( j->error, sizeof( j->error), fmt, ap);
+	va_end( ap);
+	j->code = code;
+	return code;
+}
+
+#define exch( x, y)	{double h; h=x; x=y; y=h;}
+
+/*********************************************/
+/* decide on the media, orientation, grid    */
+/* and scale: every candidate layout is laid */
+/* out, and the best of them is taken        */
+/*********************************************/
+static int postersize( struct tilejob *j)
+{	/* exactly one of scalespec and posterspec is NULL ! */
+	/* media and image sizes are fixed already */
+
+	struct tileplan plan[ MAXPLANS], *pl, *best;
+	double tmpposter[4], *poster;
+	int nplan, occupancy, i, rc;
+
+	poster = NULL;
+	if (j->opt.scalespec)
+	{	/* user specified scale factor */
+		j->scale = atof( j->opt.scalespec);
+		if (j->scale < 0.01 || j->scale > 1.0e6)
+			return fail( j, TILE_ESPEC, "Illegal scale value %s!", j->opt.scalespec);
+	} else
+	{	/* user specified output size */
+		if ((rc = box_convert( j, j->opt.posterspec, tmpposter)))
+			return rc;
+		if (tmpposter[0]!=0.0 || tmpposter[1]!=0.0)
+		{	if (j->opt.verbose)
+				fprintf( stderr, "Poster lower-left coordinates are assumed 0!\n");
+			tmpposter[0] = tmpposter[1] = 0.0;
+		}
+		if (tmpposter[2]-tmpposter[0] <= 0.0 || tmpposter[3]-tmpposter[1] <= 0.0)
+			return fail( j, TILE_ESIZE, "Poster should have positive size!");
+
+		if ((tmpposter[3]-tmpposter[1]) < (tmpposter[2]-tmpposter[0]))
+		{	/* hmmm... landscape spec, change to portrait for now */
+			exch( tmpposter[0], tmpposter[1]);
+			exch( tmpposter[2], tmpposter[3]);
+		}
+
+
+		/* Should we tilt the poster to landscape style? */
+		if ((j->imagebb[3] - j->imagebb[1]) < (j->imagebb[2] - j->imagebb[0]))
+		{	/* image has landscape format ==> make landscape poster */
+			exch( tmpposter[0], tmpposter[1]);
+			exch( tmpposter[2], tmpposter[3]);
+		}
+		poster = tmpposter;
 	}
 
-	/******************* now start doing things **************************/
-	/* open output file */
-	if (filespec)
-	{	if (!freopen( filespec, "w", stdout))
-		{	fprintf( stderr, "Cannot open '%s' for writing!\n",
-				 filespec);
-			exit(1);
-		} else if (verbose)
-			fprintf( stderr, "Opened '%s' for writing\n",
-				 filespec);
+	/* the media of -m, and with -M the smaller ones of the table, */
+	/* each without and with rotation (which is considered as media */
+	/* versus image, totally independent of the portrait or */
+	/* landscape style of the final poster) */
+	for (nplan = 0, i = -1; i < 0 || (j->opt.anymedia &&
+	     strcmp( mediatable[i][0], "p") && nplan + 2 <= MAXPLANS); i++)
+	{	pl = plan + nplan;
+		if (planmedia( j, i, pl))
+			continue;
+		pl[1] = pl[0];
+		pl[1].rotate = 1;
+		plangrid( j, pl, poster);
+		plangrid( j, pl + 1, poster);
+		nplan += 2;
 	}
 
-	/******* I might need to read some input to find picture size ********/
-	/* start DSC header on output */
-	dsc_head1();
+	/* with -B, count the sheets that would be left out */
+	occupancy = j->opt.skipblank && j->scanned && j->geom.ok && !j->geom.unlocated;
+	for (i = 0; occupancy && i < nplan; i++)
+		if (plan[i].sheets <= MAXSHEETS && planblank( j, plan + i))
+			return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+
+	/* the first of the best, so a tie keeps portrait pages */
+	for (best = plan, i = 1; i < nplan; i++)
+		if (better( plan + i, best))
+			best = plan + i;
+	useplan( j, best);
+
+	if (j->opt.verbose)
+	{	fprintf( stderr,
+			"Deciding for %d column%s and %d row%s of %s%s%s pages.\n",
+			j->ncols, (j->ncols==1)?"":"s", j->nrows, (j->nrows==1)?"":"s",
+			j->rotate?"landscape":"portrait",
+			j->opt.anymedia ? " " : "", j->opt.anymedia ? best->media : "");
+		if (occupancy && best->sheets <= MAXSHEETS)
+			fprintf( stderr, "Placing the image at %g,%g on the grid "
+				"leaves %d of %d sheets blank\n",
+				best->posterbb[0], best->posterbb[1],
+				best->sheets - best->printed, best->sheets);
+		for (pl = plan; pl < plan + nplan; pl++)
+			if (pl != best)
+				fprintf( stderr, "Rejected %d column%s and %d row%s of %s %s pages: "
+					"%d sheet%s%s\n",
+					pl->ncols, (pl->ncols==1)?"":"s", pl->nrows, (pl->nrows==1)?"":"s",
+					pl->rotate?"landscape":"portrait", pl->media,
+					pl->printed, (pl->printed==1)?"":"s",
+					pl->printed < pl->sheets ? " printed" : "");
+	}
 
-	/* pass input DSC lines to output, get BoundingBox spec if there */
-	got_bb = dsc_infile( ps_bb);
+	if (j->nrows * j->ncols > MAXSHEETS)
+		return fail( j, TILE_ESIZE, "However %dx%d pages seems ridiculous to me!",
+			j->ncols, j->nrows);
 
-	/**** decide the input image bounding box ****/
-	if (!got_bb && !imagespec)
-	{	imagespec = DefaultImage;
-		if (verbose)
-			fprintf( stderr,
-				"Using default input image of %s\n",
-				imagespec);
+	if (!j->opt.scalespec && j->opt.verbose)
+		fprintf( stderr,
+			"Deciding for a scale factor of %g\n", j->scale);
+
+	return TILE_OK;
+}
+
+/* the media of a layout: -1 for the one of -m, or an entry of */
+/* the table that is smaller; returns non-zero when not usable */
+static int planmedia( struct tilejob *j, int media, struct tileplan *pl)
+{
+	struct tileplan m;
+	int i, rc;
+
+	getplan( j, pl);
+	pl->rotate = 0;
+	if (media < 0)
+		return 0;
+
+	pl->media = mediatable[media][0];
+	sscanf( mediatable[media][1], "%lf,%lf", pl->mediasize + 2, pl->mediasize + 3);
+	if (pl->mediasize[2] > j->mediasize[2] || pl->mediasize[3] > j->mediasize[3] ||
+	    (pl->mediasize[2] == j->mediasize[2] && pl->mediasize[3] == j->mediasize[3]))
+		return 1;
+	/* the same paper under another name */
+	for (i = 0; i < media; i++)
+		if (!strcmp( mediatable[i][1], mediatable[media][1]))
+			return 1;
+
+	/* margins in % are of the media */
+	getplan( j, &m);
+	memcpy( j->mediasize, pl->mediasize, sizeof( j->mediasize));
+	rc = margin_convert( j, j->opt.cutmarginspec, pl->cutmargin) ||
+	     margin_convert( j, j->opt.whitemarginspec, pl->whitemargin);
+	useplan( j, &m);
+	j->code = 0;
+	return rc;
+}
+
+/* the grid and scale of a layout, with the image in the centre */
+static void plangrid( struct tilejob *j, struct tileplan *pl, double poster[4])
+{
+	double mw, mh, cx, cy;  /* media and cutmargin along the poster */
+	double sizex, sizey;    /* size of the scaled image in ps units */
+	double drawablex, drawabley; /* effective drawable size of media */
+	double mediax, mediay;
+	double scalex, scaley;
+
+	mw = pl->mediasize[2];
+	mh = pl->mediasize[3];
+	cx = pl->cutmargin[0];
+	cy = pl->cutmargin[1];
+	if (pl->rotate)
+	{	exch( mw, mh);
+		exch( cx, cy);
 	}
-	if (imagespec)
-		box_convert( imagespec, imagebb);
-	else
-	{	int i;
-		for (i=0; i<4; i++)
-			imagebb[i] = ps_bb[i];
+	/* available drawing area per sheet: */
+	drawablex = mw - 2.0*cx;
+	drawabley = mh - 2.0*cy;
+
+	if (!poster)
+	{	pl->scale = j->scale;
+		sizex = (j->imagebb[2] - j->imagebb[0]) * pl->scale + 2*pl->whitemargin[0];
+		sizey = (j->imagebb[3] - j->imagebb[1]) * pl->scale + 2*pl->whitemargin[1];
+		pl->ncols = ceil( sizex / drawablex);
+		pl->nrows = ceil( sizey / drawabley);
+	} else if (!j->opt.anymedia && !j->opt.skipblank)
+	{	/* the media of -m only: as many sheets as tile */
+		/* always took, 5% short of the poster */
+		pl->ncols = ceil( 0.95 * poster[2] / mw);
+		pl->nrows = ceil( 0.95 * poster[3] / mh);
+	} else
+	{	/* whole sheets, which the poster may overhang by */
+		/* the cut margins: those are cut off anyway */
+		pl->ncols = ceil( (poster[2] - 2.0*cx) / mw);
+		pl->nrows = ceil( (poster[3] - 2.0*cy) / mh);
+	}
+	if (pl->ncols < 1) pl->ncols = 1;
+	if (pl->nrows < 1) pl->nrows = 1;
+
+	mediax = pl->ncols * drawablex;
+	mediay = pl->nrows * drawabley;
+
+	if (poster)
+	{	scalex = (mediax - 2*pl->whitemargin[0]) / (j->imagebb[2] - j->imagebb[0]);
+		scaley = (mediay - 2*pl->whitemargin[1]) / (j->imagebb[3] - j->imagebb[1]);
+		pl->scale = (scalex < scaley) ? scalex : scaley;
+		sizex = pl->scale * (j->imagebb[2] - j->imagebb[0]);
+		sizey = pl->scale * (j->imagebb[3] - j->imagebb[1]);
 	}
 
-	if (verbose > 1)
-		fprintf( stderr, "   Input image is: [%g,%g,%g,%g]\n",
-			imagebb[0], imagebb[1], imagebb[2], imagebb[3]);
+	/* set poster size as if it were a continuous surface without margins */
+	pl->posterbb[0] = (mediax - sizex) / 2.0; /* center picture on paper */
+	pl->posterbb[1] = (mediay - sizey) / 2.0; /* center picture on paper */
+	pl->posterbb[2] = pl->posterbb[0] + sizex;
+	pl->posterbb[3] = pl->posterbb[1] + sizey;
+
+	pl->sheets = pl->printed = pl->ncols * pl->nrows;
+}
+
+/* with -B: the place of the image on the grid, of GRIDSTEPS */
+/* by GRIDSTEPS, that leaves the most sheets blank; the centre */
+/* is tried first, and kept on a tie */
+static int planblank( struct tilejob *j, struct tileplan *pl)
+{
+	struct tileplan m, cand;
+	double grid[5], slackx, slacky, w, h;
+	char *used;
+	int kx, ky, n;
+
+	if (!(used = malloc( pl->sheets)))
+		return -1;
+	getplan( j, &m);
+	slackx = 2.0 * pl->posterbb[0];
+	slacky = 2.0 * pl->posterbb[1];
+	w = pl->posterbb[2] - pl->posterbb[0];
+	h = pl->posterbb[3] - pl->posterbb[1];
+	cand = *pl;
+	for (ky = 0; ky < GRIDSTEPS; ky++)
+		for (kx = 0; kx < GRIDSTEPS; kx++)
+		{	cand.posterbb[0] = slackx * ((kx + GRIDSTEPS/2) % GRIDSTEPS) / (GRIDSTEPS-1);
+			cand.posterbb[1] = slacky * ((ky + GRIDSTEPS/2) % GRIDSTEPS) / (GRIDSTEPS-1);
+			cand.posterbb[2] = cand.posterbb[0] + w;
+			cand.posterbb[3] = cand.posterbb[1] + h;
+			useplan( j, &cand);
+			tilegrid( j, grid);
+			n = GeomCount( &j->geom, grid[0], grid[1], grid[2], grid[3], grid[4],
+				cand.ncols, cand.nrows, used);
+			if ((kx == 0 && ky == 0) || n < pl->printed)
+			{	*pl = cand;
+				pl->printed = n;
+			}
+		}
+	useplan( j, &m);
+	free( used);
+	return 0;
+}
+
+/* whether layout a is better than b: the fewest sheets printed, */
+/* then (with -M) the least paper, then the fewest in the grid */
+static int better( struct tileplan *a, struct tileplan *b)
+{
+	double pa, pb;
+
+	if (a->printed != b->printed)
+		return a->printed < b->printed;
+	pa = a->printed * a->mediasize[2] * a->mediasize[3];
+	pb = b->printed * b->mediasize[2] * b->mediasize[3];
+	if (pa != pb)
+		return pa < pb;
+	return a->sheets < b->sheets;
+}
+
+/* the layout of the job, and back */
+static void getplan( struct tilejob *j, struct tileplan *pl)
+{
+	memset( pl, 0, sizeof( *pl));
+	pl->media = j->opt.mediaspec;
+	memcpy( pl->mediasize, j->mediasize, sizeof( pl->mediasize));
+	memcpy( pl->cutmargin, j->cutmargin, sizeof( pl->cutmargin));
+	memcpy( pl->whitemargin, j->whitemargin, sizeof( pl->whitemargin));
+	pl->rotate = j->rotate;
+	pl->ncols = j->ncols;
+	pl->nrows = j->nrows;
+	pl->scale = j->scale;
+	memcpy( pl->posterbb, j->posterbb, sizeof( pl->posterbb));
+	pl->sheets = pl->printed = j->ncols * j->nrows;
+}
+
+static void useplan( struct tilejob *j, struct tileplan *pl)
+{
+	j->opt.mediaspec = pl->media;
+	memcpy( j->mediasize, pl->mediasize, sizeof( j->mediasize));
+	memcpy( j->cutmargin, pl->cutmargin, sizeof( j->cutmargin));
+	memcpy( j->whitemargin, pl->whitemargin, sizeof( j->whitemargin));
+	j->rotate = pl->rotate;
+	j->ncols = pl->ncols;
+	j->nrows = pl->nrows;
+	j->scale = pl->scale;
+	memcpy( j->posterbb, pl->posterbb, sizeof( j->posterbb));
+}
+
+/* the tile grid in input coordinates: origin, cell size and the */
+/* margin of a cell, with the values (and roundings) that */
+/* printprolog() passes on to tileprolog */
+static void tilegrid( struct tilejob *j, double grid[5])
+{
+	double pw, ph, s;
+
+	pw = (int)(j->mediasize[2]-2.0*j->cutmargin[0]);
+	ph = (int)(j->mediasize[3]-2.0*j->cutmargin[1]);
+	if (j->rotate)
+		exch( pw, ph);
+	s = j->scale;
+	grid[0] = (int)j->imagebb[0] - (int)j->posterbb[0] / s;
+	grid[1] = (int)j->imagebb[1] - (int)j->posterbb[1] / s;
+	grid[2] = pw / s;
+	grid[3] = ph / s;
+	grid[4] = (6.0 + 1.0) / s;	/* clipmargin, and some slack */
+}
+
+static int margin_convert( struct tilejob *j, char *spec, double margin[2])
+{	double x;
+	int i, n, rc;
 
-	if (imagebb[2]-imagebb[0] <= 0.0 || imagebb[3]-imagebb[1] <= 0.0)
-	{	fprintf( stderr, "Input image should have positive size!\n");
-		exit(1);
+	if (1==sscanf( spec, "%lf%n", &x, &n) && x==0.0 && n==strlen(spec))
+	{	/* margin spec of 0, dont bother about a otherwise mandatory unit */
+		margin[0] = margin[1] = 0.0;
+	} else if (spec[ strlen( spec) - 1] == '%')
+	{	/* margin relative to media size */
+		if (1 != sscanf( spec, "%lf%%", &x))
+			return fail( j, TILE_ESPEC, "Illegal margin specification!");
+		margin[0] = 0.01 * x * j->mediasize[2];
+		margin[1] = 0.01 * x * j->mediasize[3];
+	} else
+	{	/* absolute margin value */
+		double marg[4];
+		if ((rc = box_convert( j, spec, marg)))
+			return rc;
+		margin[0] = marg[2];
+		margin[1] = marg[3];
 	}
 
+	for (i=0; i<2; i++)
+	{	if (margin[i] < 0 || 2.0*margin[i] >= j->mediasize[i+2])
+			return fail( j, TILE_ESIZE, "Margin value '%s' out of range!",
+				spec);
+	}
+	return TILE_OK;
+}
 
-	/*** decide on the scale factor and poster size ***/
-	postersize( scalespec, posterspec);
+static int box_convert( struct tilejob *j, char *boxspec, double psbox[4])
+{	/* convert user textual box spec into numbers in ps units */
+	/* box = [fixed x fixed][+ fixed , fixed] unit */
+	/* fixed = digits [ . digits] */
+	/* unit = medianame | i | cm | mm | m | p */
 
-	if (verbose > 1)
-		fprintf( stderr, "   Output image is: [%g,%g,%g,%g]\n",
-			posterbb[0], posterbb[1], posterbb[2], posterbb[3]);
+	double mx, my, ox, oy, ux, uy;
+	int n, r, i, l, inx;
+	char *spec;
+
+	mx = my = 1.0;
+	ox = oy = 0.0;
+
+	spec = boxspec;
+	/* read 'fixed x fixed' */
+	if (isdigit( spec[0]))
+	{	r = sscanf( spec, "%lfx%lf%n", &mx, &my, &n);
+		if (r != 2)
+		{	r = sscanf( spec, "%lf*%lf%n", &mx, &my, &n);
+			if (r != 2) return boxerr( j, boxspec);
+		}
+		spec += n;
+	}
+
+	/* read '+ fixed , fixed' */
+	if (1 < (r = sscanf( spec, "+%lf,%lf%n", &ox, &oy, &n)))
+	{	if (r != 2) return boxerr( j, boxspec);
+		spec += n;
+	}
+
+	/* read unit */
+	l = strlen( spec);
+	for (n=i=0; mediatable[i][0]; i++)
+	{	if (!mystrncasecmp( mediatable[i][0], spec, l))
+		{	/* found */
+			n++;
+			inx = i;
+			if (l == strlen( mediatable[i][0]))
+			{	/* match is exact */
+				n = 1;
+				break;
+			}
+		}
+	}
+	if (!n) return boxerr( j, boxspec);
+	if (n>1)
+		return fail( j, TILE_ESPEC, "Your box spec '%s' is not unique! (give more chars)",
+			spec);
+	sscanf( mediatable[inx][1], "%lf,%lf", &ux, &uy);
+
+	psbox[0] = ox * ux;
+	psbox[1] = oy * uy;
+	psbox[2] = mx * ux;
+	psbox[3] = my * uy;
+
+	if (j->opt.verbose > 1)
+		fprintf( stderr, "   Box_convert: '%s' into [%g,%g,%g,%g]\n",
+			boxspec, psbox[0], psbox[1], psbox[2], psbox[3]);
 
+	for (i=0; i<2; i++)
+	{	if (psbox[i] < 0.0 || psbox[i+2] < psbox[i])
+			return fail( j, TILE_ESPEC, "Your specification `%s' leads to "
+				"negative values!", boxspec);
+	}
+	return TILE_OK;
+}
 
-	dsc_head2();
+static int boxerr( struct tilejob *j, char *spec)
+{	size_t n, room = sizeof( j->error);
+	char *e = j->error;
+	int i;
 
-	printposter();
+	fail( j, TILE_ESPEC, "I don't understand your box specification `%.200s'!\n"
+		"The proper format is: ([text] meaning optional text)\n"
+		"  [multiplier][offset]unit\n"
+		"  with multiplier:  numberxnumber\n"
+		"  with offset:      +number,number\n"
+		"  with unit one of:", spec);
 
-	LangClose();
+	/* the table fits, with the spec cut short as above */
+	n = strlen( e);
+	for (i=0; mediatable[i][0]; i++)
+		n += snprintf( e + n, room - n, "%c%-10s", (i%7)?' ':'\n', mediatable[i][0]);
+	snprintf( e + n, room - n, "\nYou can use a shorthand for these unit names,\n"
+		"provided it resolves unique.");
+	return TILE_ESPEC;
+}
 
-	exit (0);
+/*********************************************/
+/* output first part of DSC header           */
+/*********************************************/
+static void dsc_head1( struct tilejob *j, struct tileoutput *o)
+{
+	OutputPrintf( o, "%%!PS-Adobe-3.0\n");
+	OutputPrintf( o, "%%%%Creator: %s\n", j->opt.creator);
 }
 
-static void usage()
+/*********************************************/
+/* pass some DSC info from the infile in the new DSC header */
+/* such as document fonts and */
+/* extract BoundingBox info from the PS file */
+/*********************************************/
+static int dsc_infile( struct tilejob *j, double ps_bb[4])
 {
-	fprintf( stderr, "Usage: %s <options> infile\n\n", myname);
-	fprintf( stderr, "options are:\n");
-	fprintf( stderr, "   -v:         be verbose\n");
-	fprintf( stderr, "   -a:         add alignment marks\n");
-	fprintf( stderr, "   -f:         ask manual feed on plotting/printing device\n");
-	fprintf( stderr, "   -l<lang>:   specify language code (en, nl, fr)\n");
-	fprintf( stderr, "   -i<box>:    specify input image size\n");
-	fprintf( stderr, "   -c<margin>: horizontal and vertical cutmargin\n");
-	fprintf( stderr, "   -w<margin>: horizontal and vertical additional white margin\n");
-	fprintf( stderr, "   -m<box>:    media paper size\n");
-	fprintf( stderr, "   -p<box>:    output poster size\n");
-	fprintf( stderr, "   -s<number>: linear scale factor for poster\n");
-	fprintf( stderr, "   -o<file>:   output redirection to named file\n");
-	fprintf( stderr, "   -t<title>:  title for the cover page\n");
-	fprintf( stderr, "   -u<title>:  url/link for the cover page\n\n");
-	fprintf( stderr, "   At least one of -s -p -m is mandatory, and don't give both -s and -p\n");
-	fprintf( stderr, "   <box> is like 'A4', '3x3letter', '10x25cm', '200x200+10,10p'\n");
-	fprintf( stderr, "   <margin> is either a simple <box> or <number>%%\n\n");
+	char *c, buf[BUFSIZE];
+	int gotall, atend, level, dsc_cont, inbody, got_bb, looked;
+	size_t pos, end, len, trailer;
+
+	j->tail_cntl_D = j->input.tail_cntl_D;
+
+	got_bb = 0;
+	dsc_cont = inbody = gotall = level = atend = looked = 0;
+	trailer = 0;
+	for (pos = 0; !gotall && pos < j->input.size; pos = end)
+	{
+		end = InputLineEnd( &j->input, pos);
+
+		/* a private copy for the parsing below, */
+		/* lines passed to the output are copied in full */
+		len = end - pos;
+		if (len >= BUFSIZE) len = BUFSIZE - 1;
+		memcpy( buf, j->input.data + pos, len);
+		buf[len] = '\0';
+
+		if (buf[0] != '%')
+		{	dsc_cont = 0;
+			if (!inbody) inbody = 1;
+			if (!atend) gotall = 1;
+			else if (!looked)
+			{	/* once only, a miss falls back to reading on */
+				looked = 1;
+				if ((trailer = findtrailer( &j->input)))
+				{	end = trailer;
+					inbody = 2;
+				}
+			}
+			continue;
+		}
 
-	fprintf( stderr, "   Defaults are: '-m%s', '-c%s', '-i<box>' read from input file.\n",
-		DefaultMedia, DefaultCutMargin);
-	fprintf( stderr, "                 and output written to stdout.\n");
+		if (!strncmp( buf, "%%+",3) && dsc_cont)
+		{	if (dscline( j, pos, end))
+				return 0;
+			continue;
+		}
 
-	exit(1);
+		dsc_cont = 0;
+		if      (!strncmp( buf, "%%EndComments", 13))
+		{	inbody = 1;
+			if (!atend) gotall = 1;
+			else if (!looked)
+			{	looked = 1;
+				if ((trailer = findtrailer( &j->input)))
+				{	end = trailer;
+					inbody = 2;
+				}
+			}
+		}
+		else if (!strncmp( buf, "%%BeginDocument", 15) ||
+		         !strncmp( buf, "%%BeginData", 11)) level++;
+		else if (!strncmp( buf, "%%EndDocument", 13) ||
+		         !strncmp( buf, "%%EndData", 9)) level--;
+		else if (!strncmp( buf, "%%Trailer", 9) && level == 0)
+			inbody = 2;
+		else if (!strncmp( buf, "%%BoundingBox:", 14) &&
+			 inbody!=1 && !level)
+		{	for (c=buf+14; *c==' ' || *c=='\t'; c++);
+			if (!strncmp( c, "(atend)", 7)) atend = 1;
+			else
+			{	sscanf( c, "%lf %lf %lf %lf",
+				       ps_bb, ps_bb+1, ps_bb+2, ps_bb+3);
+				got_bb = 1;
+			}
+		}
+		else if (!strncmp( buf, "%%Document", 10) &&
+			 inbody!=1 && !level)  /* several kinds of doc props */
+		{	for (c=buf+10; *c && *c!=' ' && *c!='\t'; c++);
+			for (; *c==' ' || *c=='\t'; c++);
+			if (!strncmp( c, "(atend)", 7)) atend = 1;
+			else
+			{	/* pass this DSC to output */
+				if (dscline( j, pos, end))
+					return 0;
+				dsc_cont = 1;
+			}
+		}
+	}
+	return got_bb;
 }
 
-#define exch( x, y)	{double h; h=x; x=y; y=h;}
+/* keep a DSC line of the input for the output header */
+static int dscline( struct tilejob *j, size_t pos, size_t end)
+{
+	struct tilesegment *d;
 
-static void postersize( char *scalespec, char *posterspec)
-{	/* exactly one the arguments is NULL ! */
-	/* media and image sizes are fixed already */
+	if (j->ndsc && j->dsc[ j->ndsc-1].off + j->dsc[ j->ndsc-1].len == pos)
+	{	j->dsc[ j->ndsc-1].len += end - pos;
+		return 0;
+	}
+	if (j->ndsc == j->dscroom)
+	{	j->dscroom = j->dscroom ? 2 * j->dscroom : 16;
+		if (!(d = realloc( j->dsc, j->dscroom * sizeof( *d))))
+			return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+		j->dsc = d;
+	}
+	j->dsc[ j->ndsc].off = pos;
+	j->dsc[ j->ndsc].len = end - pos;
+	j->ndsc++;
+	return 0;
+}
 
-	int nx0, ny0, nx1, ny1;
-	double sizex, sizey;    /* size of the scaled image in ps units */
-	double drawablex, drawabley; /* effective drawable size of media */
-	double mediax, mediay;
-	double tmpposter[4];
+/*********************************************/
+/* take the prolog of the input, and the     */
+/* resources (fonts, procsets) before its    */
+/* setup, out of the page body, to print     */
+/* them once in the document setup; what     */
+/* comes later may need the setup, or code   */
+/* before it, and stays; so does a part that */
+/* saves or restores, or leaves operands, as */
+/* the pages end such a save (like cairo's   */
+/* `save ... end restore'), and what follows */
+/* it; the comment lines find the parts, the */
+/* code of a part is read by InputBalanced() */
+/*********************************************/
+static int hoist( struct tilejob *j)
+{
+	struct tileinput *in = &j->input;
+	struct tilesegment *range, *r;
+	char buf[BUFSIZE];
+	size_t pos, end, gap, len, start, total;
+	int k, n, room, level, depth, inprolog, loose, ended, done, rc;
+
+	range = NULL;
+	n = room = 0;
+	level = depth = inprolog = loose = done = 0;
+	start = 0;
+	for (k = 0; k <= in->nseg && !done; k++)
+	{	/* code of the body before, not in a resource */
+		if (k && !depth && !inprolog)
+			loose = 1;
+		pos = k ? in->seg[k-1].off + in->seg[k-1].len : 0;
+		gap = k < in->nseg ? in->seg[k].off : in->size;
+		for (; pos < gap && !done; pos = end)
+		{	end = InputLineEnd( in, pos);
+			len = end - pos;
+			if (len >= BUFSIZE) len = BUFSIZE - 1;
+			memcpy( buf, in->data + pos, len);
+			buf[len] = '\0';
+
+			ended = 0;
+			if      (!strncmp( buf, "%%BeginDocument", 15) ||
+			         !strncmp( buf, "%%BeginData", 11)) level++;
+			else if (!strncmp( buf, "%%EndDocument", 13) ||
+			         !strncmp( buf, "%%EndData", 9)) level--;
+			else if (level)
+				;
+			else if (!strncmp( buf, "%%BeginProlog", 13))
+			{	/* not after code it may need */
+				inprolog = !loose;
+				done = loose;
+				start = pos;
+			}
+			else if (!strncmp( buf, "%%EndProlog", 11))
+			{	/* without a begin, all before it is the prolog */
+				if (!inprolog)
+					n = start = 0;
+				ended = done = 1;
+			}
+			else if (inprolog)
+				;
+			else if (!strncmp( buf, "%%BeginResource", 15) ||
+			         !strncmp( buf, "%%BeginFont", 11) ||
+			         !strncmp( buf, "%%BeginProcSet", 14))
+			{	if (depth++ == 0)
+					start = pos;
+			}
+			else if (!strncmp( buf, "%%EndResource", 13) ||
+			         !strncmp( buf, "%%EndFont", 9) ||
+			         !strncmp( buf, "%%EndProcSet", 12))
+				ended = depth > 0 && --depth == 0 && !loose;
+			else if (!strncmp( buf, "%%BeginSetup", 12) ||
+			         !strncmp( buf, "%%Page:", 7) ||
+			         !strncmp( buf, "%%Trailer", 9))
+				done = 1;
+			if (!ended)
+				continue;
+
+			/* a resource, or the prolog, ends here */
+			if (!InputBalanced( in, start, end - start))
+			{	if (j->opt.verbose > 1)
+					fprintf( stderr, "   Prolog of the input: saves, restores or "
+						"leaves operands, printed on every page\n");
+				done = 1;
+				break;
+			}
+			if (n == room)
+			{	room = room ? 2 * room : 16;
+				if (!(r = realloc( range, room * sizeof( *r))))
+				{	free( range);
+					return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+				}
+				range = r;
+			}
+			range[n].off = start;
+			range[n++].len = end - start;
+		}
+	}
 
-	/* available drawing area per sheet: */
-	drawablex = mediasize[2] - 2.0*cutmargin[0];
-	drawabley = mediasize[3] - 2.0*cutmargin[1];
+	rc = TILE_OK;
+	if (n && InputHoist( in, range, n))
+		rc = fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	free( range);
+	if (!rc && j->opt.verbose > 1 && in->nres)
+	{	for (total = 0, k = 0; k < in->nres; k++)
+			total += in->res[k].len;
+		fprintf( stderr, "   Prolog of the input: %lu bytes, printed once\n",
+			(unsigned long)total);
+	}
+	return rc;
+}
 
-	/*** decide on number of pages  ***/
-	if (scalespec)
-	{	/* user specified scale factor */
-		scale = atof( scalespec);
-		if (scale < 0.01 || scale > 1.0e6)
-		{	fprintf( stderr, "Illegal scale value %s!\n", scalespec);
-			exit(1);
+/*********************************************/
+/* the printer VM the input takes, as far as */
+/* InputVM() can tell: its prolog for good,  */
+/* and its body until the restore at the end */
+/* of every page; against the budget of -V   */
+/*********************************************/
+static int vmcheck( struct tilejob *j)
+{
+	struct tileinput *in = &j->input;
+	size_t once, page;
+	double budget;
+	char *c;
+	int i;
+
+	once = InputVM( in, in->res, in->nres);
+	page = InputVM( in, in->seg, in->nseg);
+	/* -e keeps the input itself in VM, at most this much */
+	if (j->opt.embed)
+		for (i = 0; i < in->nseg; i++)
+			once += in->seg[i].len;
+	if (j->opt.verbose)
+		fprintf( stderr, "Printer VM of the input: about %lu bytes, "
+			"and %lu more on every page\n",
+			(unsigned long)once, (unsigned long)page);
+
+	if (!j->opt.vmspec)
+		return TILE_OK;
+	budget = strtod( j->opt.vmspec, &c);
+	switch (*c)
+	{ case 'k': case 'K': budget *= 1024; c++; break;
+	  case 'm': case 'M': budget *= 1024 * 1024; c++; break;
+	  case 'g': case 'G': budget *= 1024 * 1024 * 1024; c++; break;
+	}
+	if (*c || c == j->opt.vmspec || budget <= 0)
+		return fail( j, TILE_ESPEC, "The VM budget '%.64s' is not understood!",
+			j->opt.vmspec);
+	if (once + page > budget)
+		return fail( j, TILE_ESIZE, "The input takes about %lu bytes of "
+			"printer VM, more than the %.0f of -V!",
+			(unsigned long)(once + page), budget);
+	return TILE_OK;
+}
+
+/*********************************************/
+/* a job for each media of a list like       */
+/* "A4,Letter", that all print the input as  */
+/* this job has read it, at the same time,   */
+/* each to the files of its own name         */
+/*********************************************/
+static int variants( struct tilejob *j)
+{
+	struct planpool pp;
+	struct tilejob *v;
+	pthread_t *tid;
+	char *c, *next;
+	int n, nw, i, k, rc;
+
+	if (!(j->medialist = strdup( j->opt.mediaspec)))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	for (n = 1, c = j->medialist; *c; c++)
+		if (*c == ',')
+			n++;
+	nw = j->opt.nthreads < n ? j->opt.nthreads : n;
+	if (!(j->variants = malloc( n * sizeof( *j->variants))) ||
+	    !(tid = malloc( nw * sizeof( *tid))))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+
+	for (c = j->medialist; c; c = next)
+	{	if ((next = strchr( c, ',')))
+			*next++ = '\0';
+		if (!*c)
+		{	free( tid);
+			return fail( j, TILE_ESPEC, "The media '%.200s' are not understood!",
+				j->opt.mediaspec);
+		}
+		if (!(v = TileNew( &j->opt)))
+			break;
+		j->variants[ j->nvariants++] = v;
+		v->opt.mediaspec = c;
+		v->opt.nthreads = j->opt.nthreads / nw;
+		v->cache = j->cache;
+		v->tail_cntl_D = j->tail_cntl_D;
+		v->inpage = j->inpage;
+		memcpy( v->imagebb, j->imagebb, sizeof( v->imagebb));
+		if (InputShare( &v->input, &j->input))
+			break;
+		v->gotinput = 1;
+		/* in the languages this job has read */
+		if (!(v->editions = calloc( j->neditions, sizeof( *v->editions))))
+			break;
+		for (k = 0; k < j->neditions; k++)
+		{	v->editions[k].code = j->editions[k].code;
+			v->editions[k].lang = j->editions[k].lang;
 		}
-		sizex = (imagebb[2] - imagebb[0]) * scale + 2*whitemargin[0];
-		sizey = (imagebb[3] - imagebb[1]) * scale + 2*whitemargin[1];
+		v->neditions = j->neditions;
+		if (j->ndsc && !(v->dsc = malloc( j->ndsc * sizeof( *v->dsc))))
+			break;
+		memcpy( v->dsc, j->dsc, j->ndsc * sizeof( *v->dsc));
+		v->ndsc = v->dscroom = j->ndsc;
+		if (!(v->outname = v->made[0] = withcode( j->outname, 'm', c)))
+			break;
+		if (j->opt.indexname &&
+		    !(v->opt.indexname = v->made[1] = withcode( j->opt.indexname, 'm', c)))
+			break;
+		v->out.fd = -1;
+	}
+	if (c)
+	{	free( tid);
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	}
 
-		/* without rotation */
-		nx0 = ceil( sizex / drawablex);
-		ny0 = ceil( sizey / drawabley);
+	memset( &pp, 0, sizeof( pp));
+	pp.j = j;
+	pthread_mutex_init( &pp.lock, NULL);
+	/* this thread is one of the runners */
+	for (i = 1; i < nw; i++)
+		if (pthread_create( tid + i, NULL, mediarunner, &pp))
+			break;
+	mediarunner( &pp);
+	while (--i > 0)
+		pthread_join( tid[i], NULL);
+	pthread_mutex_destroy( &pp.lock);
+	free( tid);
+
+	rc = TILE_OK;
+	for (i = 0; i < j->nvariants && !rc; i++)
+		if ((v = j->variants[i])->code)
+			rc = fail( j, v->code, "Media %s: %.1900s",
+				v->opt.mediaspec, v->error);
+
+	/* all media, or none */
+	for (i = 0; rc && i < j->nvariants; i++)
+		if (!(v = j->variants[i])->code && v->partfirst)
+		{	unlinkparts( v);
+			for (k = 0; k < v->neditions; k++)
+				if (v->editions[k].indexname)
+					unlink( v->editions[k].indexname);
+		}
+	return rc;
+}
 
-		/* with rotation */
-		nx1 = ceil( sizex / drawabley);
-		ny1 = ceil( sizey / drawablex);
+/* print the media that are not taken yet, one at a time */
+static void *mediarunner( void *arg)
+{
+	struct planpool *pp = arg;
+	struct tilejob *j = pp->j;
+	struct tilejob *v;
+	int i;
 
-	} else
-	{	/* user specified output size */
-		box_convert( posterspec, tmpposter);
-		if (tmpposter[0]!=0.0 || tmpposter[1]!=0.0)
-		{	fprintf( stderr, "Poster lower-left coordinates are assumed 0!\n");
-			tmpposter[0] = tmpposter[1] = 0.0;
+	for (;;)
+	{	pthread_mutex_lock( &pp->lock);
+		i = (pp->failed || pp->next >= j->nvariants) ? -1 : pp->next++;
+		pthread_mutex_unlock( &pp->lock);
+		if (i < 0)
+			break;
+		v = j->variants[i];
+		if (mediasetup( v) || printmedia( v, j))
+		{	pthread_mutex_lock( &pp->lock);
+			pp->failed = 1;
+			pthread_mutex_unlock( &pp->lock);
 		}
-		if (tmpposter[2]-tmpposter[0] <= 0.0 || tmpposter[3]-tmpposter[1] <= 0.0)
-		{	fprintf( stderr, "Poster should have positive size!\n");
-			exit(1);
+	}
+	return NULL;
+}
+
+/*********************************************/
+/* the name of a file for one of several     */
+/* media or languages: %m or %l in it, as    */
+/* key tells, is the code, or else the code  */
+/* goes before its extension, like           */
+/* poster-A4.ps; a directory gets it in the  */
+/* names of DefaultPartName                  */
+/* NULL when out of memory                   */
+/*********************************************/
+static char *withcode( char *name, int key, char *code)
+{
+	char *dir, *buf, *t, *c, *base, *ext;
+	char pat[3];
+	size_t len;
+	int n;
+
+	sprintf( pat, "%%%c", key);
+	dir = NULL;
+	len = strlen( name);
+	if (len && name[ len-1] == '/')
+	{	if (!(dir = malloc( len + strlen( DefaultPartName) + 1)))
+			return NULL;
+		sprintf( dir, "%s%s", name, DefaultPartName);
+		name = dir;
+		len = strlen( name);
+	}
+	for (n = 1, c = name; (c = strstr( c, pat)); c += 2)
+		n++;
+	if (!(buf = malloc( len + n * strlen( code) + 2)))
+	{	free( dir);
+		return NULL;
+	}
+
+	if (n > 1)
+	{	for (t = buf, c = name; *c; )
+			if (c[0] == '%' && c[1] == key)
+			{	t += sprintf( t, "%s", code);
+				c += 2;
+			} else
+				*t++ = *c++;
+		*t = '\0';
+	} else
+	{	/* poster.ps to poster-A4.ps */
+		base = strrchr( name, '/');
+		ext = strrchr( base ? base : name, '.');
+		if (!ext || ext == name || ext == base + 1)
+			ext = name + len;
+		sprintf( buf, "%.*s-%s%s", (int)(ext - name), name, code, ext);
+	}
+	free( dir);
+	return buf;
+}
+
+/*********************************************/
+/* the languages of -l, like "en,nl": an     */
+/* edition of the output in each, with the   */
+/* prompts of its language read once         */
+/*********************************************/
+static int languages( struct tilejob *j)
+{
+	struct edition *e;
+	char *c, *next, why[ 128];
+	int n, r;
+
+	if (!j->opt.language)
+	{	j->opt.language = DefaultLanguage;
+		if (j->opt.verbose)
+			fprintf( stderr,
+				"Using default language of %s\n",
+				j->opt.language);
+	}
+	if (!(j->langlist = strdup( j->opt.language)))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	for (n = 1, c = j->langlist; *c; c++)
+		if (*c == ',')
+			n++;
+	if (n > 1 && !j->outname)
+		return fail( j, TILE_EUSAGE, "Several languages need output files, "
+			"one for each!");
+	if (!(j->editions = calloc( n, sizeof( *j->editions))))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+
+	for (c = j->langlist; c; c = next)
+	{	if ((next = strchr( c, ',')))
+			*next++ = '\0';
+		if (!*c)
+			return fail( j, TILE_ESPEC, "The languages '%.200s' are not understood!",
+				j->opt.language);
+		if( strlen( c ) != 2 )
+			return fail( j, TILE_ESPEC, "Invalid language code '%.64s'!", c);
+		e = j->editions + j->neditions++;
+		e->code = c;
+		if (j->cache)
+			r = cachedlang( j, c, &e->lang);
+		else
+		{	e->lang = &e->own;
+			r = langread( j, LangRead( &e->own, c, why, sizeof( why)), c, why);
 		}
+		if (r)
+			return r;
+	}
+	return TILE_OK;
+}
 
-		if ((tmpposter[3]-tmpposter[1]) < (tmpposter[2]-tmpposter[0]))
-		{	/* hmmm... landscape spec, change to portrait for now */
-			exch( tmpposter[0], tmpposter[1]);
-			exch( tmpposter[2], tmpposter[3]);
+/* the files of each edition, and its index */
+static int editionnames( struct tilejob *j)
+{
+	struct edition *e;
+	int i;
+
+	for (i = 0; i < j->neditions; i++)
+	{	e = j->editions + i;
+		if (j->outname &&
+		    !(e->outname = editionname( j, j->outname, e->code)))
+			return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+		if (j->opt.indexname &&
+		    !(e->indexname = editionname( j, j->opt.indexname, e->code)))
+			return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	}
+	return TILE_OK;
+}
+
+/* a name with the language in it, of several */
+/* or for %l; NULL when out of memory */
+static char *editionname( struct tilejob *j, char *name, char *code)
+{
+	if (j->neditions == 1 && !strstr( name, "%l"))
+		return strdup( name);
+	return withcode( name, 'l', code);
+}
+
+/* remove the files of the parts again */
+static void unlinkparts( struct tilejob *j)
+{
+	char *name;
+	int i, k;
+
+	for (k = 0; k < j->neditions; k++)
+		for (i = 1; i <= j->nparts; i++)
+			if ((name = partname( j, j->editions + k, i)))
+			{	unlink( name);
+				free( name);
+			}
+}
+
+/*********************************************/
+/* the pages of the input, by its %%Page:    */
+/* comments: with more than one, the pages   */
+/* of -I, each with the image of its         */
+/* %%PageBoundingBox unless -i is given, for */
+/* makeposters()                             */
+/*********************************************/
+static int inputpages( struct tilejob *j)
+{
+	struct tileinput *in = &j->input;
+	struct inputpage *page, *pg;
+	char buf[BUFSIZE], *want;
+	size_t pos, end, gap, len, trailer;
+	int k, n, room, level;
+
+	page = NULL;
+	n = room = level = 0;
+	trailer = in->size;
+	for (k = 0; k <= in->nseg && trailer == in->size; k++)
+	{	pos = k ? in->seg[k-1].off + in->seg[k-1].len : 0;
+		gap = k < in->nseg ? in->seg[k].off : in->size;
+		for (; pos < gap && trailer == in->size; pos = end)
+		{	end = InputLineEnd( in, pos);
+			len = end - pos;
+			if (len >= BUFSIZE) len = BUFSIZE - 1;
+			memcpy( buf, in->data + pos, len);
+			buf[len] = '\0';
+
+			if      (!strncmp( buf, "%%BeginDocument", 15) ||
+			         !strncmp( buf, "%%BeginData", 11)) level++;
+			else if (!strncmp( buf, "%%EndDocument", 13) ||
+			         !strncmp( buf, "%%EndData", 9)) level--;
+			else if (level)
+				;
+			else if (!strncmp( buf, "%%Page:", 7))
+			{	if (n == room)
+				{	room = room ? 2 * room : 16;
+					if (!(pg = realloc( page, room * sizeof( *pg))))
+					{	free( page);
+						return fail( j, TILE_ENOMEM, "%s: out of memory!",
+							j->opt.creator);
+					}
+					page = pg;
+				}
+				if (n)
+					page[n-1].end = pos;
+				page[n].number = n + 1;
+				page[n].off = pos;
+				page[n++].gotbb = 0;
+			}
+			/* (atend) is in the page trailer, found later */
+			else if (!strncmp( buf, "%%PageBoundingBox:", 18) && n &&
+			         !page[n-1].gotbb)
+			{	pg = page + n - 1;
+				pg->gotbb = sscanf( buf + 18, "%lf %lf %lf %lf",
+					pg->bb, pg->bb+1, pg->bb+2, pg->bb+3) == 4 &&
+					pg->bb[2] > pg->bb[0] && pg->bb[3] > pg->bb[1];
+			}
+			else if (!strncmp( buf, "%%Trailer", 9))
+				trailer = pos;
 		}
+	}
+	if (n)
+		page[n-1].end = trailer;
+
+	want = NULL;
+	if (j->opt.inpagespec &&
+	    !(want = pagebits( j, j->opt.inpagespec, n ? n : 1, "input")))
+	{	free( page);
+		return j->code;
+	}
+	j->inpage = 1;
+	if (n <= 1)
+	{	free( want);
+		free( page);
+		return TILE_OK;
+	}
 
+	j->inpages = page;
+	j->inhead = page[0].off;
+	j->intrailer = trailer;
+	for (j->ninpages = k = 0; k < n; k++)
+	{	if (want && !want[k+1])
+			continue;
+		pg = page + j->ninpages++;
+		*pg = page[k];
+		if (!pg->gotbb || j->opt.imagespec)
+			memcpy( pg->bb, j->imagebb, sizeof( pg->bb));
+		if (j->opt.verbose > 1)
+			fprintf( stderr, "   Input page %d is: [%g,%g,%g,%g]\n", pg->number,
+				pg->bb[0], pg->bb[1], pg->bb[2], pg->bb[3]);
+	}
+	free( want);
+	return TILE_OK;
+}
 
-		/* Should we tilt the poster to landscape style? */
-		if ((imagebb[3] - imagebb[1]) < (imagebb[2] - imagebb[0]))
-		{	/* image has landscape format ==> make landscape poster */
-			exch( tmpposter[0], tmpposter[1]);
-			exch( tmpposter[2], tmpposter[3]);
+/*********************************************/
+/* a poster of each page that inputpages()   */
+/* found in the input of from: a job that    */
+/* sees the input before the first page,     */
+/* that page, and the trailer                */
+/*********************************************/
+static int makeposters( struct tilejob *j, struct tilejob *from)
+{
+	struct inputpage *pg;
+	struct tilesegment view[3];
+	struct tilejob *c;
+	int k, nview;
+
+	if (!from->ninpages)
+		return TILE_OK;
+	if (!(j->posters = malloc( from->ninpages * sizeof( *j->posters))))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	for (k = 0; k < from->ninpages; k++)
+	{	pg = from->inpages + k;
+		nview = 0;
+		if (from->inhead)
+		{	view[ nview].off = 0;
+			view[ nview++].len = from->inhead;
+		}
+		view[ nview].off = pg->off;
+		view[ nview++].len = pg->end - pg->off;
+		if (from->intrailer < j->input.size)
+		{	view[ nview].off = from->intrailer;
+			view[ nview++].len = j->input.size - from->intrailer;
 		}
 
-		/* without rotation */ /* assuming tmpposter[0],[1] = 0,0 */
-		nx0 = ceil( 0.95 * tmpposter[2] / mediasize[2]);
-		ny0 = ceil( 0.95 * tmpposter[3] / mediasize[3]);
+		if (!(c = TileNew( &j->opt)))
+			return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+		j->posters[ j->nposters++] = c;
+		if (InputView( &c->input, &j->input, view, nview))
+			return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+		c->gotinput = 1;
+		c->root = j;
+		c->inpage = pg->number;
+		c->cache = j->cache;
+		c->tail_cntl_D = j->tail_cntl_D;
+		memcpy( c->mediasize, j->mediasize, sizeof( c->mediasize));
+		memcpy( c->cutmargin, j->cutmargin, sizeof( c->cutmargin));
+		memcpy( c->whitemargin, j->whitemargin, sizeof( c->whitemargin));
+		memcpy( c->imagebb, pg->bb, sizeof( c->imagebb));
+	}
+	return TILE_OK;
+}
 
-		/* with rotation */
-		nx1 = ceil( 0.95 * tmpposter[2] / mediasize[3]);
-		ny1 = ceil( 0.95 * tmpposter[3] / mediasize[2]);
-		/* (rotation is considered as media versus image, which is totally */
-		/*  independent of the portrait or landscape style of the final poster) */
+/*********************************************/
+/* lay out the posters of the input pages,   */
+/* as many at the same time as -j            */
+/*********************************************/
+static int planposters( struct tilejob *j)
+{
+	struct planpool pp;
+	struct tilejob *c;
+	pthread_t *tid;
+	int nw, i;
+
+	nw = j->opt.nthreads < j->nposters ? j->opt.nthreads : j->nposters;
+	if (!(tid = malloc( nw * sizeof( *tid))))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	memset( &pp, 0, sizeof( pp));
+	pp.j = j;
+	pthread_mutex_init( &pp.lock, NULL);
+
+	/* this thread is one of the planners */
+	for (i = 1; i < nw; i++)
+		if (pthread_create( tid + i, NULL, planner, &pp))
+			break;
+	planner( &pp);
+	while (--i > 0)
+		pthread_join( tid[i], NULL);
+	pthread_mutex_destroy( &pp.lock);
+	free( tid);
+
+	/* the first page that failed */
+	for (i = 0; i < j->nposters; i++)
+		if ((c = j->posters[i])->code)
+			return fail( j, c->code, "Page %d of the input: %.1900s",
+				c->inpage, c->error);
+	return TILE_OK;
+}
+
+/* plan the posters that are not taken yet, one at a time */
+static void *planner( void *arg)
+{
+	struct planpool *pp = arg;
+	struct tilejob *j = pp->j;
+	int i;
+
+	for (;;)
+	{	pthread_mutex_lock( &pp->lock);
+		i = (pp->failed || pp->next >= j->nposters) ? -1 : pp->next++;
+		pthread_mutex_unlock( &pp->lock);
+		if (i < 0)
+			break;
+		if (plan( j->posters[i]))
+		{	pthread_mutex_lock( &pp->lock);
+			pp->failed = 1;
+			pthread_mutex_unlock( &pp->lock);
+		}
 	}
+	return NULL;
+}
 
-	/* decide for rotation to get the minimum page count */
-	rotate = nx0*ny0 > nx1*ny1;
+/*********************************************/
+/* where the %%Trailer of the input starts,  */
+/* looking back from its end, so the (atend) */
+/* values are found without reading it all;  */
+/* 0 if not in the last TRAILERMAX bytes     */
+/*********************************************/
+static size_t findtrailer( struct tileinput *in)
+{
+	size_t pos, stop;
+
+	stop = in->size > TRAILERMAX ? in->size - TRAILERMAX : 0;
+	for (pos = in->size; pos > stop; )
+	{	pos = InputLineStart( in, pos);
+		if (pos >= stop && in->size - pos >= 9 &&
+		    !strncmp( in->data + pos, "%%Trailer", 9))
+			return pos;
+	}
+	return 0;
+}
 
-	ncols = rotate ? nx1 : nx0;
-	nrows = rotate ? ny1 : ny0;
+/*********************************************/
+/* output last part of DSC header            */
+/*********************************************/
+static void dsc_head2( struct tilejob *j, struct tileoutput *o, int pages, int part)
+{
+	struct tilejob *pj;
+	int i, k, w, h;
 
-	if (verbose)
-		fprintf( stderr,
-			"Deciding for %d column%s and %d row%s of %s pages.\n",
-			ncols, (ncols==1)?"":"s", nrows, (nrows==1)?"":"s",
-			rotate?"landscape":"portrait");
+	OutputPrintf( o, "%%%%Pages: %d\n", pages);
+	/* SubFileDecode, ReusableStreamDecode and FlateDecode */
+	if (j->opt.embed || j->opt.compress)
+		OutputPrintf( o, "%%%%LanguageLevel: 3\n");
 
-	if (nrows * ncols > 400)
-	{	fprintf( stderr, "However %dx%d pages seems ridiculous to me!\n",
-			ncols, nrows);
-		exit(1);
+#ifndef Gv_gs_orientbug
+	OutputPrintf( o, "%%%%Orientation: %s\n", j->rotate?"Landscape":"Portrait");
+#endif
+	/* the media of the posters, each once */
+	for (w = h = i = 0; i < j->nposters; i++)
+	{	pj = j->posters[i];
+		for (k = 0; k < i; k++)
+			if (!strcmp( j->posters[k]->opt.mediaspec, pj->opt.mediaspec))
+				break;
+		if (k == i)
+			OutputPrintf( o, "%s %s %d %d 0 white ()\n",
+				i ? "%%+" : "%%DocumentMedia:", pj->opt.mediaspec,
+				(int)(pj->mediasize[2]), (int)(pj->mediasize[3]));
+		if (w < (int)(pj->mediasize[2])) w = (int)(pj->mediasize[2]);
+		if (h < (int)(pj->mediasize[3])) h = (int)(pj->mediasize[3]);
+	}
+	OutputPrintf( o, "%%%%BoundingBox: 0 0 %d %d\n", w, h);
+	OutputPrintf( o, "%%%%EndComments\n\n");
+
+	for (i = 0; i < j->nposters; i++)
+	{	pj = j->posters[i];
+		if (j->nposters == 1)
+			OutputPrintf( o, "%% Print poster %s in %dx%d tiles with %.3g magnification\n",
+				j->input.name, pj->nrows, pj->ncols, pj->scale);
+		else
+			OutputPrintf( o, "%% Print page %d of %s in %dx%d tiles with %.3g magnification\n",
+				pj->inpage, j->input.name, pj->nrows, pj->ncols, pj->scale);
+	}
+	if (j->nparts > 1)
+		OutputPrintf( o, "%% Part %d of %d\n", part, j->nparts);
+}
+
+/*********************************************/
+/* output the poster, create tiles if needed */
+/* in one file, or in parts of at most       */
+/* splitpages tiles, written at the same     */
+/* time by as many threads as -j             */
+/*********************************************/
+static int printposter( struct tilejob *j)
+{
+	struct tilepart pt;
+	struct partpool pp;
+	struct tilejob *pj;
+	pthread_t *tid;
+	char *name, *tmpl;
+	int n, i, nw, per, rc;
+
+	/* the pages: of each poster its cover, and its tiles */
+	if (!(j->posterfirst = malloc( (j->nposters + 1) * sizeof( *j->posterfirst))))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	for (n = i = 0; i < j->nposters; i++)
+	{	pj = j->posters[i];
+		j->posterfirst[i] = n;
+		n += 1 + pj->rowfirst[ pj->nrows];
+	}
+	j->posterfirst[ j->nposters] = n;
+
+	/* the pages of -P, or all of them */
+	j->npick = n;
+	if (j->opt.pagespec && (rc = pagelist( j, n)))
+		return rc;
+
+	/* of the editions only the prologs differ */
+	if ((rc = editionnames( j)))
+		return rc;
+	for (i = 0; i < j->neditions; i++)
+	{	printprolog( j, j->editions + i);
+		if (j->editions[i].prolog.failed)
+			return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	}
+	printsetup( j, &j->setup);
+	if (j->setup.failed)
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+
+	/* one edition, languages() sees to that */
+	if (!j->outname)
+	{	memset( &pt, 0, sizeof( pt));
+		pt.j = j;
+		pt.out = &j->out;
+		pt.npages = j->npick;
+		if ((rc = indexroom( j, 1)))
+			return rc;
+		if (printpart( &pt, j->opt.nthreads))
+			return partfail( j, pt.code, NULL);
+		return j->opt.indexname ? printindex( j) : TILE_OK;
 	}
 
-	mediax = ncols * (rotate ? drawabley : drawablex);
-	mediay = nrows * (rotate ? drawablex : drawabley);
-
-	if (!scalespec)  /* no scaling number given by user */
-	{	double scalex, scaley;
-		scalex = (mediax - 2*whitemargin[0]) / (imagebb[2] - imagebb[0]);
-		scaley = (mediay - 2*whitemargin[1]) / (imagebb[3] - imagebb[1]);
-		scale = (scalex < scaley) ? scalex : scaley;
+	/* a directory or a name with %, a file per tile by default; */
+	/* the names of the editions differ in the language only */
+	memset( &pp, 0, sizeof( pp));
+	pp.j = j;
+	pp.next = 1;
+	name = j->editions[0].outname;
+	tmpl = strchr( name, '%');
+	per = j->opt.splitpages;
+	if (per <= 0)
+		per = (tmpl || (*name && name[ strlen( name)-1] == '/')) ? 1 : 0;
+	if ((rc = partlist( j, per)))
+		return rc;
+	if (j->nparts > 1 && tmpl && !strstr( name, "%p") &&
+	    !(strstr( name, "%r") && strstr( name, "%c") &&
+	      (j->nposters == 1 || strstr( name, "%i"))))
+		return fail( j, TILE_EUSAGE, "The output name '%.200s' should have %%p, "
+			"or %%r and %%c%s, to tell the files apart!", j->outname,
+			j->nposters == 1 ? "" : " and %i");
+	if ((rc = indexroom( j, j->nparts + 1)))
+		return rc;
+
+	nw = j->opt.nthreads < j->nparts ? j->opt.nthreads : j->nparts;
+	if (nw < 1)
+		nw = 1;
+	pp.threads = j->opt.nthreads / nw;
+	if (!(tid = malloc( nw * sizeof( *tid))))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	pthread_mutex_init( &pp.lock, NULL);
+
+	/* this thread is one of the writers */
+	for (i = 1; i < nw; i++)
+		if (pthread_create( tid + i, NULL, writer, &pp))
+			break;
+	writer( &pp);
+	while (--i > 0)
+		pthread_join( tid[i], NULL);
+	pthread_mutex_destroy( &pp.lock);
+	free( tid);
+
+	if (!(rc = pp.code) && !(j->opt.indexname && (rc = printindex( j))))
+		return TILE_OK;
+
+	/* no half posters */
+	if (pp.code)
+		rc = partfail( j, rc, pp.name);
+	free( pp.name);
+	unlinkparts( j);
+	return rc;
+}
 
-		if (verbose)
-			fprintf( stderr,
-				"Deciding for a scale factor of %g\n", scale);
-		sizex = scale * (imagebb[2] - imagebb[0]);
-		sizey = scale * (imagebb[3] - imagebb[1]);
+/* write the parts that are not taken yet, one at a time */
+static void *writer( void *arg)
+{
+	struct partpool *pp = arg;
+	struct tilejob *j = pp->j;
+	struct tileoutput *out;
+	struct tilepart pt;
+	char *name;
+	int part, opened, k;
+
+	/* a file of each edition */
+	if (!(out = calloc( j->neditions, sizeof( *out))))
+	{	pthread_mutex_lock( &pp->lock);
+		if (!pp->code)
+			pp->code = TILE_ENOMEM;
+		pthread_mutex_unlock( &pp->lock);
+		return NULL;
 	}
 
-	/* set poster size as if it were a continuous surface without margins */
-	posterbb[0] = (mediax - sizex) / 2.0; /* center picture on paper */
-	posterbb[1] = (mediay - sizey) / 2.0; /* center picture on paper */
-	posterbb[2] = posterbb[0] + sizex;
-	posterbb[3] = posterbb[1] + sizey;
-
-}
-
-static void margin_convert( char *spec, double margin[2])
-{	double x;
-	int i, n;
+	for (;;)
+	{	pthread_mutex_lock( &pp->lock);
+		part = (pp->code || pp->next > j->nparts) ? 0 : pp->next++;
+		pthread_mutex_unlock( &pp->lock);
+		if (!part)
+			break;
+
+		memset( out, 0, j->neditions * sizeof( *out));
+		memset( &pt, 0, sizeof( pt));
+		pt.j = j;
+		pt.out = out;
+		pt.part = part;
+		pt.first = j->partfirst[ part-1];
+		pt.npages = j->partfirst[ part] - pt.first;
+
+		name = NULL;
+		for (k = 0; k < j->neditions; k++)
+			out[k].fd = -1;
+		for (k = 0; k < j->neditions && !pt.code; k++)
+		{	free( name);
+			if (!(name = partname( j, j->editions + k, part)))
+				pt.code = TILE_ENOMEM;
+			else if ((out[k].fd = open( name, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0)
+				pt.code = TILE_EOUTPUT;
+			else if (j->opt.verbose)
+				fprintf( stderr, "Opened '%s' for writing\n", name);
+		}
+		if ((opened = !pt.code))
+			printpart( &pt, pp->threads);
+		for (k = 0; k < j->neditions; k++)
+		{	if (out[k].fd >= 0 && close( out[k].fd) && !pt.code)
+				pt.code = TILE_EOUTPUT;
+			OutputClose( out + k);
+		}
 
-	if (1==sscanf( spec, "%lf%n", &x, &n) && x==0.0 && n==strlen(spec))
-	{	/* margin spec of 0, dont bother about a otherwise mandatory unit */
-		margin[0] = margin[1] = 0.0;
-	} else if (spec[ strlen( spec) - 1] == '%')
-	{	/* margin relative to media size */
-		if (1 != sscanf( spec, "%lf%%", &x))
-		{	fprintf( stderr, "Illegal margin specification!\n");
-			exit( 1);
+		pthread_mutex_lock( &pp->lock);
+		if (pt.code && !pp->code)
+		{	pp->code = pt.code;
+			if (!opened && name)
+			{	pp->name = name;	/* for the message */
+				name = NULL;
+			}
 		}
-		margin[0] = 0.01 * x * mediasize[2];
-		margin[1] = 0.01 * x * mediasize[3];
-	} else
-	{	/* absolute margin value */
-		double marg[4];
-		box_convert( spec, marg);
-		margin[0] = marg[2];
-		margin[1] = marg[3];
+		pthread_mutex_unlock( &pp->lock);
+		free( name);
 	}
+	free( out);
+	return NULL;
+}
 
-	for (i=0; i<2; i++)
-	{	if (margin[i] < 0 || 2.0*margin[i] >= mediasize[i+2])
-		{	fprintf( stderr, "Margin value '%s' out of range!\n",
-				spec);
-			exit(1);
+/*********************************************/
+/* the parts of the pages of pick: a part is */
+/* full at per tiles, or never with per 0;   */
+/* a cover page goes with the tiles after it */
+/*********************************************/
+static int partlist( struct tilejob *j, int per)
+{
+	int k, t, tiles;
+
+	if (!(j->partfirst = malloc( (j->npick + 1) * sizeof( *j->partfirst))))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	j->nparts = 0;
+	for (tiles = k = 0; k < j->npick; k++)
+	{	if (k == 0 || (per > 0 && tiles == per))
+		{	j->partfirst[ j->nparts++] = k;
+			tiles = 0;
 		}
+		pageof( j, j->pick ? j->pick[k] : k, &t);
+		if (t)
+			tiles++;
 	}
+	if (!j->nparts)
+		j->partfirst[ j->nparts++] = 0;
+	j->partfirst[ j->nparts] = j->npick;
+	return TILE_OK;
 }
 
-static void box_convert( char *boxspec, double psbox[4])
-{	/* convert user textual box spec into numbers in ps units */
-	/* box = [fixed x fixed][+ fixed , fixed] unit */
-	/* fixed = digits [ . digits] */
-	/* unit = medianame | i | cm | mm | m | p */
-
-	double mx, my, ox, oy, ux, uy;
-	int n, r, i, l, inx;
-	char *spec;
-
-	mx = my = 1.0;
-	ox = oy = 0.0;
+/*********************************************/
+/* the file name of a part: %p in the name   */
+/* of TileOutputFiles() is the number of the */
+/* part, %r and %c the row and column of its */
+/* first tile, and %i its page of the input; */
+/* a directory gets the names of             */
+/* DefaultPartName, and a name without % the */
+/* number before its extension, if it needs  */
+/* one; of the files of edition e, NULL when */
+/* out of memory                             */
+/*********************************************/
+static char *partname( struct tilejob *j, struct edition *e, int part)
+{
+	struct tilejob *pj;
+	char *out, *tmpl, *name, *t, *c, *ext, *base;
+	size_t len;
+	int row, col, inpage, rows, cols, n, k, i;
+
+	out = e->outname;
+	len = strlen( out);
+	if (len && out[ len-1] == '/')
+	{	if (!(tmpl = malloc( len + strlen( DefaultPartName) + 1)))
+			return NULL;
+		sprintf( tmpl, "%s%s", out, DefaultPartName);
+	} else if (strchr( out, '%'))
+		tmpl = strdup( out);
+	else if (j->nparts <= 1)
+		return strdup( out);
+	else
+	{	/* poster.ps to poster-%p.ps */
+		base = strrchr( out, '/');
+		ext = strrchr( base ? base : out, '.');
+		if (!ext || ext == out || ext == base + 1)
+			ext = out + len;
+		if (!(tmpl = malloc( len + 4)))
+			return NULL;
+		sprintf( tmpl, "%.*s-%%p%s", (int)(ext - out), out, ext);
+	}
+	if (!tmpl)
+		return NULL;
+
+	/* room for every escape as the widest int, sign and all */
+	for (len = strlen( tmpl) + 1, c = tmpl; *c; c++)
+		if (*c == '%' && c[1])
+			len += NUMLEN, c++;
+	if (!(name = malloc( len)))
+	{	free( tmpl);
+		return NULL;
+	}
 
-	spec = boxspec;
-	/* read 'fixed x fixed' */
-	if (isdigit( spec[0]))
-	{	r = sscanf( spec, "%lfx%lf%n", &mx, &my, &n);
-		if (r != 2)
-		{	r = sscanf( spec, "%lf*%lf%n", &mx, &my, &n);
-			if (r != 2) boxerr( boxspec);
+	/* of the first tile, or the first page without tiles */
+	row = col = 0;
+	inpage = j->inpage;
+	for (k = j->partfirst[ part-1]; k < j->partfirst[ part]; k++)
+	{	pj = j->posters[ pageof( j, j->pick ? j->pick[k] : k, &n)];
+		if (k == j->partfirst[ part-1] || n)
+			inpage = pj->inpage;
+		if (n)
+		{	tileof( pj, n - 1, &row, &col);
+			break;
 		}
-		spec += n;
 	}
-
-	/* read '+ fixed , fixed' */
-	if (1 < (r = sscanf( spec, "+%lf,%lf%n", &ox, &oy, &n)))
-	{	if (r != 2) boxerr( boxspec);
-		spec += n;
+	for (rows = cols = i = 0; i < j->nposters; i++)
+	{	pj = j->posters[i];
+		if (rows < pj->nrows) rows = pj->nrows;
+		if (cols < pj->ncols) cols = pj->ncols;
 	}
 
-	/* read unit */
-	l = strlen( spec);
-	for (n=i=0; mediatable[i][0]; i++)
-	{	if (!mystrncasecmp( mediatable[i][0], spec, l))
-		{	/* found */
-			n++;
-			inx = i;
-			if (l == strlen( mediatable[i][0]))
-			{	/* match is exact */
-				n = 1;
-				break;
-			}
+	/* numbers as wide as the largest, so the names sort */
+	for (t = name, c = tmpl; *c; c++)
+	{	if (*c != '%' || !c[1])
+		{	*t++ = *c;
+			continue;
 		}
+		switch (*++c)
+		{ case 'p': n = sprintf( t, "%0*d", digits( j->nparts), part); break;
+		  case 'r': n = sprintf( t, "%0*d", digits( rows), row); break;
+		  case 'c': n = sprintf( t, "%0*d", digits( cols), col); break;
+		  case 'i': n = sprintf( t, "%0*d", digits(
+				j->posters[ j->nposters-1]->inpage), inpage); break;
+		  default:  *t = *c; n = 1; break;
+		}
+		t += n;
 	}
-	if (!n) boxerr( boxspec);
-	if (n>1)
-	{	fprintf( stderr, "Your box spec '%s' is not unique! (give more chars)\n",
-			spec);
-		exit(1);
-	}
-	sscanf( mediatable[inx][1], "%lf,%lf", &ux, &uy);
+	*t = '\0';
+	free( tmpl);
+	return name;
+}
 
-	psbox[0] = ox * ux;
-	psbox[1] = oy * uy;
-	psbox[2] = mx * ux;
-	psbox[3] = my * uy;
+/* record the failure of a part, with its message */
+static int partfail( struct tilejob *j, int code, char *name)
+{
+	if (code == TILE_ENOMEM)
+		return fail( j, code, "%s: out of memory!", j->opt.creator);
+	if (name)
+		return fail( j, code, "Cannot open '%.200s' for writing!", name);
+	return fail( j, code, "%s: failed to write output!", j->opt.creator);
+}
 
-	if (verbose > 1)
-		fprintf( stderr, "   Box_convert: '%s' into [%g,%g,%g,%g]\n",
-			boxspec, psbox[0], psbox[1], psbox[2], psbox[3]);
+/*********************************************/
+/* one document: the header, prolog, and its */
+/* pages, covers and tiles;                  */
+/* returns 0, or the code of what went wrong */
+/*********************************************/
+static int printpart( struct tilepart *pt, int threads)
+{
+	struct tilejob *j = pt->j;
+	struct tileoutput *o;
+	struct edition *e;
+	struct fileindex *f;
+	int i, k;
+
+	for (k = 0; k < j->neditions; k++)
+	{	o = pt->out + k;
+		e = j->editions + k;
+		dsc_head1( j, o);
+		for (i = 0; i < j->ndsc; i++)
+			OutputWrite( o, j->input.data + j->dsc[i].off, j->dsc[i].len);
+		dsc_head2( j, o, pt->npages, pt->part);
+
+		PageWrite( &e->prolog, &j->input, o);
+		PageWrite( &j->setup, &j->input, o);
+		if (e->files)
+			e->files[ pt->part].prolog = OutputTell( o);
+	}
 
-	for (i=0; i<2; i++)
-	{	if (psbox[i] < 0.0 || psbox[i+2] < psbox[i])
-		{	fprintf( stderr, "Your specification `%s' leads to "
-				"negative values!\n", boxspec);
-			exit(1);
+	/* the pages are built once, for all editions; */
+	/* emit() tells why, if it was emit() */
+	if (PageRun( pt->npages, threads, tile, emit, pt) && !pt->code)
+		pt->code = TILE_ENOMEM;
+	if (pt->code)
+		return pt->code;
+
+	for (k = 0; k < j->neditions; k++)
+	{	o = pt->out + k;
+		f = j->editions[k].files ? j->editions[k].files + pt->part : NULL;
+		if (f)
+			f->trailer = OutputTell( o);
+		OutputPrintf( o, "%%%%EOF\n");
+
+		if (j->tail_cntl_D)
+		{	OutputPrintf( o, "%c", 0x4);
 		}
+
+		if (OutputFlush( o) && !pt->code)
+			pt->code = TILE_EOUTPUT;
+		if (f)
+			f->size = OutputTell( o);
 	}
+	return pt->code;
 }
 
-static void boxerr( char *spec)
-{	int i;
-
-	fprintf( stderr, "I don't understand your box specification `%s'!\n",
-		spec);
+/* digits of a positive number */
+static int digits( int n)
+{
+	int d;
 
-	fprintf( stderr, "The proper format is: ([text] meaning optional text)\n");
-	fprintf( stderr, "  [multiplier][offset]unit\n");
-	fprintf( stderr, "  with multiplier:  numberxnumber\n");
-	fprintf( stderr, "  with offset:      +number,number\n");
-	fprintf( stderr, "  with unit one of:");
+	for (d = 1; n >= 10; n /= 10)
+		d++;
+	return d;
+}
 
-	for (i=0; mediatable[i][0]; i++)
-		fprintf( stderr, "%c%-10s", (i%7)?' ':'\n', mediatable[i][0]);
-	fprintf( stderr, "\nYou can use a shorthand for these unit names,\n"
-		"provided it resolves unique.\n");
-	exit( 1);
+/* row and column of the n-th printed tile */
+static void tileof( struct tilejob *j, int n, int *row, int *col)
+{
+	int lo, hi, mid, k;
+
+	/* the last row with fewer printed tiles before it */
+	for (lo = 0, hi = j->nrows - 1; lo < hi; )
+	{	mid = (lo + hi + 1) / 2;
+		if (j->rowfirst[mid] <= n)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	*row = lo + 1;
+	for (k = n - j->rowfirst[lo], *col = 1; ; (*col)++)
+		if (!skipped( j, *row, *col) && k-- == 0)
+			break;
 }
 
-/*********************************************/
-/* output first part of DSC header           */
-/*********************************************/
-static void dsc_head1()
+/* the poster of a page, and in n the page in */
+/* it: 0 its cover, the tiles from 1 */
+static int pageof( struct tilejob *j, int page, int *n)
 {
-	printf ("%%!PS-Adobe-3.0\n");
-	printf ("%%%%Creator: %s\n", myname);
+	int lo, hi, mid;
+
+	for (lo = 0, hi = j->nposters - 1; lo < hi; )
+	{	mid = (lo + hi + 1) / 2;
+		if (j->posterfirst[mid] <= page)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	*n = page - j->posterfirst[lo];
+	return lo;
 }
 
 /*********************************************/
-/* pass some DSC info from the infile in the new DSC header */
-/* such as document fonts and */
-/* extract BoundingBox info from the PS file */
+/* the pages of a list like "1,3-7,12-", of  */
+/* as many pages: a flag for each from [1],  */
+/* or NULL when it is not understood, or out */
+/* of memory                                 */
 /*********************************************/
-static int dsc_infile( double ps_bb[4])
+static char *pagebits( struct tilejob *j, char *spec, int pages, char *what)
 {
-	char *c, buf[BUFSIZE];
-	int gotall, atend, level, dsc_cont, inbody, got_bb;
+	char *want, *c, *e;
+	long lo, hi, k;
+	int bad;
 
-	if (freopen (infile, "r", stdin) == NULL) {
-		fprintf (stderr, "%s: fail to open file '%s'!\n",
-			myname, infile);
-		exit (1);
+	if (!(want = calloc( pages + 1, 1)))
+	{	fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+		return NULL;
 	}
-
-	got_bb = 0;
-	dsc_cont = inbody = gotall = level = atend = 0;
-	//while (!gotall && (gets(buf) != NULL))
-	while (!gotall && (fgets(buf,BUFSIZE,stdin) != NULL))
-	{
-		if (buf[0] != '%')
-		{	dsc_cont = 0;
-			if (!inbody) inbody = 1;
-			if (!atend) gotall = 1;
-			continue;
-		}
-
-		if (!strncmp( buf, "%%+",3) && dsc_cont)
-		{	puts( buf);
-			continue;
-		}
-
-		dsc_cont = 0;
-		if      (!strncmp( buf, "%%EndComments", 13))
-		{	inbody = 1;
-			if (!atend) gotall = 1;
+	for (bad = 0, c = spec; !bad; c = e + 1)
+	{	lo = strtol( c, &e, 10);
+		if ((bad = e == c || lo < 1))
+			break;
+		hi = lo;
+		if (*e == '-')
+		{	c = e + 1;
+			hi = strtol( c, &e, 10);
+			if (e == c)
+				hi = pages;
 		}
-		else if (!strncmp( buf, "%%BeginDocument", 15) ||
-		         !strncmp( buf, "%%BeginData", 11)) level++;
-		else if (!strncmp( buf, "%%EndDocument", 13) ||
-		         !strncmp( buf, "%%EndData", 9)) level--;
-		else if (!strncmp( buf, "%%Trailer", 9) && level == 0)
-			inbody = 2;
-		else if (!strncmp( buf, "%%BoundingBox:", 14) &&
-			 inbody!=1 && !level)
-		{	for (c=buf+14; *c==' ' || *c=='\t'; c++);
-			if (!strncmp( c, "(atend)", 7)) atend = 1;
-			else
-			{	sscanf( c, "%lf %lf %lf %lf",
-				       ps_bb, ps_bb+1, ps_bb+2, ps_bb+3);
-				got_bb = 1;
-			}
+		if ((bad = hi < lo))
+			break;
+		if (hi > pages)
+		{	free( want);
+			fail( j, TILE_ESPEC, "Page %ld is past the end of the "
+				"%s, it has %d pages!", hi, what, pages);
+			return NULL;
 		}
-		else if (!strncmp( buf, "%%Document", 10) &&
-			 inbody!=1 && !level)  /* several kinds of doc props */
-		{	for (c=buf+10; *c && *c!=' ' && *c!='\t'; c++);
-			for (; *c==' ' || *c=='\t'; c++);
-			if (!strncmp( c, "(atend)", 7)) atend = 1;
-			else
-			{	/* pass this DSC to output */
-				puts( buf);
-				dsc_cont = 1;
-			}
+		for (k = lo; k <= hi; k++)
+			want[k] = 1;
+		if (*e != ',')
+		{	bad = *e != '\0';
+			break;
 		}
 	}
-	return got_bb;
+	if (bad)
+	{	free( want);
+		fail( j, TILE_ESPEC, "The pages '%.200s' are not understood!", spec);
+		return NULL;
+	}
+	return want;
 }
 
 /*********************************************/
-/* output last part of DSC header            */
+/* the pages of -P: of each poster the cover */
+/* page, and its tiles in the order they are */
+/* printed in                                */
 /*********************************************/
-static void dsc_head2()
+static int pagelist( struct tilejob *j, int pages)
 {
-	printf ("%%%%Pages: %d\n", nrows*ncols);
+	char *want;
+	int n, k;
+
+	if (!(want = pagebits( j, j->opt.pagespec, pages, "poster")))
+		return j->code;
+	for (n = 0, k = 1; k <= pages; k++)
+		n += want[k];
+	if (!(j->pick = malloc( (n ? n : 1) * sizeof( *j->pick))))
+	{	free( want);
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	}
+	for (n = 0, k = 1; k <= pages; k++)
+		if (want[k])
+			j->pick[ n++] = k - 1;
+	j->npick = n;
+	free( want);
+	return TILE_OK;
+}
 
-#ifndef Gv_gs_orientbug
-	printf ("%%%%Orientation: %s\n", rotate?"Landscape":"Portrait");
-#endif
-	printf ("%%%%DocumentMedia: %s %d %d 0 white ()\n",
-		mediaspec, (int)(mediasize[2]), (int)(mediasize[3]));
-	printf ("%%%%BoundingBox: 0 0 %d %d\n", (int)(mediasize[2]), (int)(mediasize[3]));
-	printf ("%%%%EndComments\n\n");
+/* room for the index of -X, if asked for */
+static int indexroom( struct tilejob *j, int files)
+{
+	struct edition *e;
+	int i;
 
-	printf ("%% Print poster %s in %dx%d tiles with %.3g magnification\n",
-		infile, nrows, ncols, scale);
+	if (!j->opt.indexname)
+		return TILE_OK;
+	for (i = 0; i < j->neditions; i++)
+	{	e = j->editions + i;
+		if (!(e->index = calloc( j->npick, sizeof( *e->index))) ||
+		    !(e->files = calloc( files, sizeof( *e->files))))
+			return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	}
+	return TILE_OK;
 }
 
-/*********************************************/
-/* output the poster, create tiles if needed */
-/*********************************************/
-static void printposter()
+/* the index of each edition, or of none */
+static int printindex( struct tilejob *j)
 {
-	int row, col;
+	int i, rc;
 
-	printprolog();
+	for (i = 0; i < j->neditions; i++)
+		if ((rc = indexfile( j, j->editions + i)))
+		{	while (--i >= 0)
+				unlink( j->editions[i].indexname);
+			return rc;
+		}
+	return TILE_OK;
+}
 
-    cover(nrows,ncols);
-	for (row = 1; row <= nrows; row++)
-		for (col = 1; col <= ncols; col++)
-			tile( row, col, nrows, ncols);
-	printf ("%%%%EOF\n");
+/*********************************************/
+/* write the index of -X: where every page   */
+/* is in the output, so it can be taken out  */
+/* without running the job again; the bytes  */
+/* of a file before its prolog offset and    */
+/* from its trailer offset go around it      */
+/*********************************************/
+static int indexfile( struct tilejob *j, struct edition *e)
+{
+	struct pageindex *x;
+	FILE *f;
+	char *name;
+	int part, i, bad;
+
+	if (!(f = fopen( e->indexname, "w")))
+		return fail( j, TILE_EOUTPUT, "Cannot open '%.200s' for writing!",
+			e->indexname);
+	fprintf( f, "%%!TileIndex: %s\n", j->input.name);
+	fprintf( f, "%% file <part> <prolog> <trailer> <size> <name>\n");
+	fprintf( f, "%% page <page> <part> <row> <col> <offset> <length>\n");
+
+	bad = 0;
+	for (part = j->nparts ? 1 : 0; part <= j->nparts && !bad; part++)
+	{	if (!j->outname)
+			name = NULL;
+		else if (!(name = partname( j, e, part)))
+			bad = 1;
+		fprintf( f, "file %d %lu %lu %lu %s\n", part,
+			(unsigned long)e->files[ part].prolog,
+			(unsigned long)e->files[ part].trailer,
+			(unsigned long)e->files[ part].size, name ? name : "-");
+		free( name);
+	}
+	for (i = 0; i < j->npick; i++)
+	{	x = e->index + i;
+		fprintf( f, "page %d %d %d %d %lu %lu\n", x->page, x->part,
+			x->row, x->col, (unsigned long)x->off, (unsigned long)x->len);
+	}
 
-	if (tail_cntl_D)
-	{	printf("%c", 0x4);
+	if (fclose( f) || bad)
+	{	unlink( e->indexname);
+		return bad ? fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator) :
+			fail( j, TILE_EOUTPUT, "%s: failed to write '%.200s'!",
+			j->opt.creator, e->indexname);
 	}
+	if (j->opt.verbose)
+		fprintf( stderr, "Wrote the index to '%s'\n", e->indexname);
+	return TILE_OK;
 }
 
 /*******************************************************/
-/* output PS prolog of the scaling and tiling routines */
+/* PS prolog of the scaling and tiling routines, which */
+/* only depends on the language and a few options      */
 /*******************************************************/
-static void printprolog()
+static void prolog( struct tilejob *j, struct tilelang *lang, struct tilepage *p)
 {
 	char *extraCode, *test1, *test2;
 
-	printf( "%%%%BeginProlog\n");
+	PagePrintf( p, "%%%%BeginProlog\n");
 
-	printf( "/cutmark	%% - cutmark -\n"
+	PagePrintf( p, "/cutmark	%% - cutmark -\n"
 		"{		%% draw cutline\n"
 		"	0.5 setlinewidth 0 setgray\n"
 		"	clipmargin\n"
@@ -725,9 +2723,9 @@ static void printprolog()
 		"	closepath fill\n"
 		"} bind def\n\n");
 
-	if( alignment )
+	if( j->opt.alignment )
 	{
-		printf ("/alignmark\n"
+		PagePrintf( p, "/alignmark\n"
 			"{\n"
 			"    gsave\n"
 			"    0 setgray 1 setlinewidth\n"
@@ -757,7 +2755,7 @@ static void printprolog()
 			"} bind def\n");
 	}
 
-	printf( "%% usage: 	row col tileprolog ps-code tilepilog\n"
+	PagePrintf( p, "%% usage: 	row col tileprolog ps-code tilepilog\n"
 			"%% these procedures output the tile specified by row & col\n"
 			"/tileprolog\n"
 			"{ 	%%def\n"
@@ -784,13 +2782,21 @@ static void printprolog()
 			"	posterxl posteryb translate\n"
 			"	sfactor dup scale\n"
 			"	imagexl neg imageyb neg translate\n"
+			"	%% what the input makes in VM is undone after the page\n"
+			"	/tilesave save def\n"
+			"	/tileops count def\n"
+			"	/tiledicts countdictstack def\n"
 			"	tiledict begin\n"
 			"	0 setgray 0 setlinecap 1 setlinewidth\n"
 		    "	0 setlinejoin 10 setmiterlimit [] 0 setdash newpath\n"
 			"} bind def\n\n");
 
-	printf( "/tileepilog\n"
-			"{	end %% of tiledict\n"
+	PagePrintf( p, "/tileepilog\n"
+			"{	%% rows and cols are above what the input left; an\n"
+			"	%% input that took more than it pushed leaves nothing\n"
+			"	count tileops sub 2 sub dup 0 lt { pop 0 } if { 3 -1 roll pop } repeat\n"
+			"	countdictstack tiledicts sub dup 0 lt { pop 0 } if { end } repeat %% of tiledict\n"
+			"	tilesave restore\n"
 			"	grestore\n"
 			"	%% print the bounding box\n"
 			"	gsave\n"
@@ -812,24 +2818,20 @@ static void printprolog()
 			"	%% print the page label\n"
 			"	0 setgray\n"
 			"	leftmargin clipmargin 3 mul add clipmargin labelsize add neg botmargin add moveto\n" );
-	printf( "	(%s ) show\n", LangPrompt( "Page" ) );
-	printf( "	pagenr strg cvs show\n"
-	        "	(: %s ) show\n", LangPrompt( "row" ) );
-	printf( "	rowcount strg cvs show\n"
-	        "	(, %s ) show\n", LangPrompt( "column" ) );
-	printf( "	colcount strg cvs show\n"
+	PagePrintf( p, "	(%s ) show\n", LangText( lang, LANG_PAGE ) );
+	PagePrintf( p, "	pagenr strg cvs show\n"
+	        "	(: %s ) show\n", LangText( lang, LANG_ROW ) );
+	PagePrintf( p, "	rowcount strg cvs show\n"
+	        "	(, %s ) show\n", LangText( lang, LANG_COLUMN ) );
+	PagePrintf( p, "	colcount strg cvs show\n"
 	        "	pagewidth 69 sub clipmargin labelsize add neg botmargin add moveto\n"
 	        "	(freesewing.org ) show\n" );
-	if( alignment )
+	if( j->opt.alignment )
 	{
-		if( rotate ) {
-			test1 = "	colcount totalcols lt\n";
-			test2 = "	colcount 1 gt\n";
-		} else {
-			test1 = "	colcount 1 gt\n";
-			test2 = "	colcount totalcols lt\n";
-		}
-		printf( "	gsave\n"
+		/* do_turn of the poster, so one prolog serves all */
+		test1 = "	do_turn { colcount totalcols lt } { colcount 1 gt } ifelse\n";
+		test2 = "	do_turn { colcount 1 gt } { colcount totalcols lt } ifelse\n";
+		PagePrintf( p, "	gsave\n"
 				"%s"
 				"	{\n"
 				"		leftmargin botmargin moveto\n"
@@ -854,10 +2856,10 @@ static void printprolog()
 				"	} if\n"
 				"	grestore\n", test1, test2 );
 	}
-	printf( "	showpage\n"
+	PagePrintf( p, "	showpage\n"
           	"} bind def\n\n");
 
-	printf( "%% usage: 	row col coverprolog ps-code coverepilog\n"
+	PagePrintf( p, "%% usage: 	row col coverprolog ps-code coverepilog\n"
 			"%% these procedures output the cover page\n"
 			"/coverprolog\n"
 			"{ %%def\n"
@@ -891,25 +2893,30 @@ static void printprolog()
 			"		0.8 scalecount div dup scale\n"
 			"		imagexl neg posterxl add imageyb neg posteryb add translate\n"
 			"	} ifelse\n"
+			"	/tilesave save def\n"
+			"	/tileops count def\n"
+			"	/tiledicts countdictstack def\n"
 			"	tiledict begin\n"
 			"	0 setgray 0 setlinecap 1 setlinewidth\n"
 			"	0 setlinejoin 10 setmiterlimit [] 0 setdash newpath\n"
 			"} bind def\n\n");
 
-	printf( "/coverepilog\n"
-			"{	end %% of tiledict\n"
+	PagePrintf( p, "/coverepilog\n"
+			"{	count tileops sub dup 0 lt { pop 0 } if { pop } repeat\n"
+			"	countdictstack tiledicts sub dup 0 lt { pop 0 } if { end } repeat %% of tiledict\n"
+			"	tilesave restore\n"
 	        "	grestore\n"
 	        "	%% print the page label\n"
 	        "	0 setgray\n"
 	        "	leftmargin clipmargin 3 mul add clipmargin labelsize add neg botmargin add moveto\n" );
-	printf( "	( %s ) show\n", LangPrompt( "cover page" ));
-	printf(	"	leftmargin clipmargin 3 mul add pageheight 10 add moveto\n"
+	PagePrintf( p, "	( %s ) show\n", LangText( lang, LANG_COVER ));
+	PagePrintf( p, 	"	leftmargin clipmargin 3 mul add pageheight 10 add moveto\n"
           	"	/Helvetica findfont 24 scalefont setfont\n"
 	        "	(FreeSewing) show\n"
 	        "	leftmargin clipmargin 3 mul add pageheight 5 sub moveto\n"
           	"	/Helvetica findfont 11 scalefont setfont\n" );
-	printf( "	(Come for the sewing patterns. Stay for the community.) show\n");
-	printf( "	leftmargin clipmargin 3 mul add pageheight 62 sub moveto\n"
+	PagePrintf( p, "	(Come for the sewing patterns. Stay for the community.) show\n");
+	PagePrintf( p, "	leftmargin clipmargin 3 mul add pageheight 62 sub moveto\n"
           	"	/Helvetica findfont 42 scalefont setfont\n"
 			"	patterntitle show\n"
 			/*"	do_turn { (do_turn True) }{ (do_turn False) } ifelse show\n"*/
@@ -930,7 +2937,7 @@ static void printprolog()
 	        "	showpage\n"
           	"} bind def\n\n");
 
-	printf( "/covergrid\n"
+	PagePrintf( p, "/covergrid\n"
 	        "{	%% print the page label\n"
 			"	/curcol exch def\n"
 		  	"	/currow exch def\n"
@@ -962,10 +2969,10 @@ static void printprolog()
 			"	curcol 1 sub boxwidth mul currow 1 sub boxheight mul moveto\n"
 			"	posterxl neg 20 add posteryb neg 20 add rmoveto\n"
 			"	0.9 setgray 1 setlinewidth\n" );  // Setting for matrix on cover page
-	printf( "	(%s ) show\n", LangPrompt( "row" ) );
-	printf( "	boxrow strg cvs show\n" );
-	printf( "	(, %s ) show\n", LangPrompt( "column" ) );
-	printf( "	boxcol strg cvs show\n"
+	PagePrintf( p, "	(%s ) show\n", LangText( lang, LANG_ROW ) );
+	PagePrintf( p, "	boxrow strg cvs show\n" );
+	PagePrintf( p, "	(, %s ) show\n", LangText( lang, LANG_COLUMN ) );
+	PagePrintf( p, "	boxcol strg cvs show\n"
 	        "	curcol 1 sub boxwidth mul currow 1 sub boxheight mul moveto\n"
 	        "	posterxl neg 150 add posteryb neg 150 add rmoveto\n"
           	"	/Helvetica findfont 300 scalefont setfont\n"
@@ -974,7 +2981,53 @@ static void printprolog()
 	        "	grestore\n"
           	"} bind def\n\n");
 
-	printf( "/logo\n"
+	if (j->opt.skipblank)
+		PagePrintf( p, "/coverskip\n"
+		        "{	%% cross out a tile that is not printed\n"
+				"	/curcol exch def\n"
+				"	/currow exch def\n"
+		        "	gsave\n"
+		        "	0.75 setgray 1 setlinewidth\n"
+				"	do_turn\n"
+				"	{	/boxwidth pageheight def\n"
+				"		/boxheight pagewidth def\n"
+				"	}\n"
+				"	{	/boxwidth pagewidth def\n"
+				"		/boxheight pageheight def\n"
+				"	} ifelse\n"
+				"	curcol 1 sub boxwidth mul currow 1 sub boxheight mul moveto\n"
+				"	posterxl neg posteryb neg rmoveto\n"
+				"	boxwidth boxheight rlineto\n"
+				"	0 boxheight neg rmoveto\n"
+				"	boxwidth neg boxheight rlineto stroke\n"
+		        "	grestore\n"
+		        "} bind def\n\n");
+
+	PagePrintf( p, "%% usage:	rows cols [skipped] covergrids\n"
+	        "/covergrids\n"
+	        "{	%% the grid of the cover page, with the tiles that are\n"
+	        "	%% not printed as bits of a string, row by row\n"
+	        "%s"
+	        "	/gridcols exch def\n"
+	        "	/gridrows exch def\n"
+	        "	0 1 gridrows 1 sub\n"
+	        "	{	/gridrow exch def\n"
+	        "		0 1 gridcols 1 sub\n"
+	        "		{	/gridcol exch def\n"
+	        "			gridrow 1 add gridcol 1 add covergrid\n"
+	        "%s"
+	        "		} for\n"
+	        "	} for\n"
+	        "} bind def\n\n",
+	        j->opt.skipblank ? "	/gridskip exch def\n" : "",
+	        j->opt.skipblank ?
+	        "			/gridbit gridrow gridcols mul gridcol add def\n"
+	        "			gridskip gridbit -3 bitshift get\n"
+	        "			gridbit 7 and 7 sub bitshift 1 and 1 eq\n"
+	        "			{	gridrow 1 add gridcol 1 add coverskip\n"
+	        "			} if\n" : "");
+
+	PagePrintf( p, "/logo\n"
 	        "{	%% print the logo\n"
 			"	/m { moveto } bind def\n"
 			"	/c { curveto } bind def\n"
@@ -1139,19 +3192,98 @@ static void printprolog()
 			"	grestore\n"
 			"} bind def\n\n");
 
-	printf( "%%%%EndProlog\n\n");
-	printf( "%%%%BeginSetup\n");
-	printf( "%% Try to inform the printer about the desired media size:\n"
+	PagePrintf( p, "%%%%EndProlog\n\n");
+}
+
+/*******************************************************/
+/* the prolog of an edition, once for all the files it */
+/* is written to                                       */
+/*******************************************************/
+static void printprolog( struct tilejob *j, struct edition *e)
+{
+	const char *text;
+	size_t len;
+
+	if (j->cache && (text = cachedprolog( j, e->lang, &len)))
+		PagePrintf( &e->prolog, "%.*s", (int)len, text);
+	else
+		prolog( j, e->lang, &e->prolog);
+}
+
+/*******************************************************/
+/* the setup of this poster, once for all the files    */
+/* and editions it is written to                       */
+/*******************************************************/
+static void printsetup( struct tilejob *j, struct tilepage *s)
+{
+	int i;
+
+	PagePrintf( s, "%%%%BeginSetup\n");
+	/* of several posters, on their pages */
+	if (j->nposters == 1)
+		posterdefs( j->posters[0], s);
+	PagePrintf( s, "/strg 10 string def\n"
+	        "/clipmargin 6 def\n"
+	        "/labelsize 9 def\n"
+	        "/tiledict 250 dict def\n"
+	        "tiledict begin\n"
+	        "%% delay users showpage until cropmark is printed.\n"
+	        "/showpage {} def\n"
+			"/setpagedevice { pop } def\n"
+	        "end\n");
+
+	PagePrintf( s, "/Helvetica findfont labelsize scalefont setfont\n");
+
+	PagePrintf( s, "/patterntitle (%s) def\n", j->opt.patterntitle);
+	PagePrintf( s, "/patternurl (%s) def\n", j->opt.patternurl);
+
+	if (j->input.nres)
+	{	/* the prolog of the input, in tiledict like the page */
+		/* bodies it came from; the dicts it leaves open, the */
+		/* body ends them, so every page begins them again */
+		PagePrintf( s, "tiledict begin\n"
+		        "/tilehoist countdictstack def\n");
+		pageinput( j, s, j->input.res, j->input.nres);
+		PagePrintf( s, "\ncountdictstack array dictstack\n"
+		        "tilehoist 1 index length tilehoist sub getinterval\n"
+		        "dup length { end } repeat\n"
+		        "/tileopen exch def\n"
+		        "end\n");
+	}
+
+	if (j->opt.embed)
+	{	for (i = 0; i < j->nposters; i++)
+			embed( j->posters[i], s, j->nposters == 1 ? 0 : i + 1);
+		if (j->opt.form)
+			PagePrintf( s, "/tileinput { tileform execform } bind def\n");
+		else
+			PagePrintf( s, "/tileinput\n"
+			        "{	tiledata 0 setfileposition\n"
+			        "	tiledata 0 () /SubFileDecode filter cvx exec\n"
+			        "} bind def\n");
+	}
+
+	PagePrintf( s, "%%%%EndSetup\n");
+}
+
+/*********************************************/
+/* the media and the placement of a poster:  */
+/* in the document setup, or with several    */
+/* posters in the setup of each page         */
+/*********************************************/
+static void posterdefs( struct tilejob *j, struct tilepage *s)
+{
+	PagePrintf( s, "%% Try to inform the printer about the desired media size:\n"
 	        "/setpagedevice where 	%% level-2 page commands available...\n"
 	        "{	pop		%% ignore where found\n"
 	        "	3 dict dup /PageSize [ %d %d ] put\n"
 	        "	dup /Duplex false put\n%s"
 	        "	setpagedevice\n"
           	"} if\n",
-	       		(int)(mediasize[2]), (int)(mediasize[3]),
-	       		manualfeed?"       dup /ManualFeed true put\n":"");
+	       		(int)(j->mediasize[2]), (int)(j->mediasize[3]),
+	       		j->opt.manualfeed?"       dup /ManualFeed true put\n":"");
 
-	printf( "/sfactor %.10f def\n"
+	PagePrintf( s, "/sfactor %.10f def\n"
 	        "/leftmargin %d def\n"
 	        "/botmargin %d def\n"
 	        "/pagewidth %d def\n"
@@ -1160,122 +3292,353 @@ static void printprolog()
 	        "/imageyb %d def\n"
 	        "/posterxl %d def\n"
 	        "/posteryb %d def\n"
-	        "/do_turn %s def\n"
-	        "/strg 10 string def\n"
-	        "/clipmargin 6 def\n"
-	        "/labelsize 9 def\n"
-	        "/tiledict 250 dict def\n"
-	        "tiledict begin\n"
-	        "%% delay users showpage until cropmark is printed.\n"
-	        "/showpage {} def\n"
-			"/setpagedevice { pop } def\n"
-	        "end\n",
-	        scale, (int)(cutmargin[0]), (int)(cutmargin[1]),
-	        (int)(mediasize[2]-2.0*cutmargin[0]), (int)(mediasize[3]-2.0*cutmargin[1]),
-	        (int)imagebb[0], (int)imagebb[1], (int)posterbb[0], (int)posterbb[1],
-	        rotate?"true":"false");
-
-	printf( "/Helvetica findfont labelsize scalefont setfont\n");
+	        "/do_turn %s def\n",
+	        j->scale, (int)(j->cutmargin[0]), (int)(j->cutmargin[1]),
+	        (int)(j->mediasize[2]-2.0*j->cutmargin[0]), (int)(j->mediasize[3]-2.0*j->cutmargin[1]),
+	        (int)j->imagebb[0], (int)j->imagebb[1], (int)j->posterbb[0], (int)j->posterbb[1],
+	        j->rotate?"true":"false");
+}
 
-	printf( "/patterntitle (%s) def\n", patterntitle);
-	printf( "/patternurl (%s) def\n", patternurl);
+/*********************************************/
+/* the input of a poster kept once in the    */
+/* setup: tiledata, or tiledata1.. for the   */
+/* k-th of several, that its pages take as   */
+/* tiledata                                  */
+/*********************************************/
+static void embed( struct tilejob *j, struct tilepage *s, int k)
+{
+	char n[16];
+	double ext;
 
-	printf( "%%%%EndSetup\n");
+	if (k)
+		sprintf( n, "%d", k);
+	else
+		n[0] = '\0';
+
+	/* keep a single copy of the input in printer VM, */
+	/* the tile and cover pages replay it from there */
+	if (j->opt.compress)
+	{	/* ASCII85 is kept as is, and inflated when read */
+		if (j->opt.compress == 1)
+			PagePrintf( s, "/tiledata%s currentfile /ASCII85Decode filter\n"
+			        "<< /Filter /FlateDecode >> /ReusableStreamDecode filter\n", n);
+		else
+			PagePrintf( s, "/tiledata%s currentfile /FlateDecode filter\n"
+			        "/ReusableStreamDecode filter\n", n);
+		PageDeflate( s, &j->input, j->input.seg, j->input.nseg,
+			j->opt.compress == 2);
+		PagePrintf( s, "\ndef\n");
+	} else
+	{	PagePrintf( s, "/tiledata%s currentfile 0 (%s) /SubFileDecode filter\n"
+		        "/ReusableStreamDecode filter\n", n, EmbedMarker);
+		PageInput( s, j->input.seg, j->input.nseg);
+		PagePrintf( s, "\n%s\n"
+		        "def\n", EmbedMarker);
+	}
+	if (j->opt.form)
+	{	/* as a form, which a distiller makes a single */
+		/* PDF form XObject, drawn by all pages; its BBox */
+		/* is anything any page can show, so it clips nothing */
+		ext = (j->nrows + j->ncols + 1) *
+			(j->mediasize[2] + j->mediasize[3]) / j->scale;
+		PagePrintf( s, "/tileform%s <<\n"
+		        "	/FormType 1\n"
+		        "	/BBox [ %d %d %d %d ]\n"
+		        "	/Matrix matrix\n"
+		        "	/PaintProc\n"
+		        "	{	pop tiledata%s 0 setfileposition\n"
+		        "		tiledata%s 0 () /SubFileDecode filter cvx exec\n"
+		        "	} bind\n"
+		        ">> def\n", n,
+		        (int)floor( j->imagebb[0] - ext), (int)floor( j->imagebb[1] - ext),
+		        (int)ceil( j->imagebb[2] + ext), (int)ceil( j->imagebb[3] + ext), n, n);
+	}
 }
 
 /*****************************/
 /* output one tile at a time */
+/* n counts the printed ones */
 /*****************************/
-static void tile ( int row, int col, int nrows, int ncols)
+static void tile ( void *arg, struct tilepage *p, int n)
 {
-	static int page=2;
-
-	if (verbose) fprintf( stderr, "print page %d\n", page);
-
-	printf ("\n%%%%Page: %d %d\n", page, page);
-	printf ("%d %d tileprolog\n", row, col);
-	printf ("%%%%BeginDocument: %s\n", infile);
-	printfile ();
-	printf ("\n%%%%EndDocument\n");
-	printf ("%d %d tileepilog\n", nrows, ncols);
+	struct tilepart *pt = arg;
+	struct tilejob *j = pt->j;
+	struct tilejob *pj;
+	int i, t, g;
+
+	g = j->pick ? j->pick[ pt->first + n] : pt->first + n;
+	i = pageof (j, g, &t);
+	pj = j->posters[i];
+	p->page = g + 1;
+	p->row = p->col = 0;
+
+	/* numbered through the parts, counted in each */
+	PagePrintf (p, "\n%%%%Page: %d %d\n", p->page, n + 1);
+	if (j->nposters > 1)
+	{	PagePrintf (p, "%%%%BeginPageSetup\n");
+		posterdefs (pj, p);
+		if (j->opt.embed)
+			PagePrintf (p, "/tiledata tiledata%d def\n", i + 1);
+		if (j->opt.form)
+			PagePrintf (p, "/tileform tileform%d def\n", i + 1);
+		PagePrintf (p, "%%%%EndPageSetup\n");
+	}
+	if (t == 0)
+	{	cover (pj, p, pj->nrows, pj->ncols);
+		return;
+	}
 
-	page++;
+	tileof (pj, t - 1, &p->row, &p->col);
+	PagePrintf (p, "%d %d tileprolog\n", p->row, p->col);
+	printbody (pj, p, p->row, p->col);
+	PagePrintf (p, "%d %d tileepilog\n", pj->nrows, pj->ncols);
 }
 
 /*****************************/
 /* cover page                */
 /*****************************/
-static void cover ( int rows, int cols)
+static void cover ( struct tilejob *j, struct tilepage *p, int rows, int cols)
 {
-	static int page=1;
-	int row, col;
+	int row, col, n, bits;
+
+	PagePrintf (p, "%d %d coverprolog\n", rows, cols);
+	printbody (j, p, 0, 0);
+
+	/* the grid is drawn by a loop in the prolog, so the page */
+	/* stays small; with -B it gets the skipped tiles, a bit */
+	/* each, row by row */
+	PagePrintf (p, "%d %d", j->nrows, j->ncols);
+	if (j->opt.skipblank)
+	{	PagePrintf (p, " <");
+		for (n = bits = 0, row = 1; row <= j->nrows; row++)
+		    for (col = 1; col <= j->ncols; col++)
+		    {	bits = bits << 1 | skipped( j, row, col);
+		        if (++n % 8 == 0)
+		        {	PagePrintf (p, "%s%02x", n % 256 ? "" : "\n", bits);
+		            bits = 0;
+		        }
+		    }
+		if (n % 8)
+		    PagePrintf (p, "%02x", bits << (8 - n % 8));
+		PagePrintf (p, ">");
+	}
+	PagePrintf (p, " covergrids\n");
+	PagePrintf (p, "coverepilog\n");
+}
 
-	if (verbose) fprintf( stderr, "print page %d\n", page);
+/*****************************/
+/* write a finished page     */
+/*****************************/
+static int emit ( void *arg, struct tilepage *p, int n)
+{
+	struct tilepart *pt = arg;
+	struct tilejob *j = pt->j;
+	struct pageindex *x;
+	int k;
+
+	if (j->opt.verbose > 1)
+		fprintf( stderr, "print page %d\n", p->page);
+	if (p->failed)
+		return pt->code = TILE_ENOMEM;
+
+	/* the same page in every edition */
+	for (k = 0; k < j->neditions && !pt->code; k++)
+	{	/* in the order of pick, through all parts */
+		x = NULL;
+		if (j->editions[k].index)
+		{	x = j->editions[k].index + pt->first + n;
+			x->page = p->page;
+			x->part = pt->part;
+			x->row = p->row;
+			x->col = p->col;
+			x->off = OutputTell( pt->out + k);
+		}
 
-	printf ("\n%%%%Page: %d %d\n", page, page);
-	printf ("%d %d coverprolog\n", rows, cols);
-	printf ("%%%%BeginDocument: %s\n", infile);
-	printfile ();
-	printf ("\n%%%%EndDocument\n");
-	for (row = 1; row <= nrows; row++)
-	    for (col = 1; col <= ncols; col++)
-	        printf ("%d %d covergrid\n", row, col);
-	printf ("coverepilog\n");
+		if (PageWrite( p, &j->input, pt->out + k))
+			pt->code = TILE_EOUTPUT;
+		if (x)
+			x->len = OutputTell( pt->out + k) - x->off;
+	}
+	return pt->code;
+}
 
-	page++;
+/******************************************/
+/* output the page contents: the input    */
+/* itself, or a call of the embedded copy */
+/* row 0 is the cover page, all of it     */
+/******************************************/
+static void printbody ( struct tilejob *j, struct tilepage *p, int row, int col)
+{
+	if (j->root->input.nres)
+		PagePrintf (p, "tileopen { begin } forall\n");
+	if (j->opt.embed)
+	{	PagePrintf (p, "tileinput\n");
+		return;
+	}
+	PagePrintf (p, "%%%%BeginDocument: %s\n", j->input.name);
+	printfile (j, p, row, col);
+	PagePrintf (p, "\n%%%%EndDocument\n");
 }
 
 /******************************/
 /* copy the PS file to output */
 /******************************/
-static void printfile ()
+static void printfile ( struct tilejob *j, struct tilepage *p, int row, int col)
+{
+	/* the comment lines and a trailing cntl_D have been */
+	/* left out of the segments when the input was read */
+	struct tilesegment *seg = NULL;
+	int nseg, room = 0;
+
+	if (j->opt.cull && j->geom.ok && row)
+	{	if (GeomTile( &j->geom, row, col, &seg, &nseg, &room))
+			p->failed = 1;
+		else
+			pageinput( j, p, seg, nseg);
+		free( seg);
+	} else
+		pageinput( j, p, j->input.seg, j->input.nseg);
+}
+
+/* the input on the page, compressed by the thread building it */
+static void pageinput( struct tilejob *j, struct tilepage *p,
+	struct tilesegment *seg, int nseg)
 {
-	/* use a double line buffer, so that when I print */
-	/* a line, I know whether it is the last or not */
-	/* I surely dont want to print a 'cntl_D' on the last line */
-	/* The double buffer removes the need to scan each line for each page*/
-	/* Furthermore allows cntl_D within binary transmissions */
+	if (!j->opt.compress)
+		PageInput( p, seg, nseg);
+	else if (j->opt.compress == 1)
+	{	/* flushed, so its ~> is read; kept in tiledict, */
+		/* where the dicts the input begins can't hide it */
+		PagePrintf( p, "tiledict /tilesource currentfile /ASCII85Decode filter put\n"
+			"tiledict /tilesource get /FlateDecode filter cvx exec\n"
+			"tiledict /tilesource get flushfile\n");
+		PageDeflate( p, &j->input, seg, nseg, 0);
+	} else
+	{	PagePrintf( p, "currentfile /FlateDecode filter cvx exec\n");
+		PageDeflate( p, &j->input, seg, nseg, 1);
+	}
+}
 
-	char buf[2][BUFSIZE];
-	int bp;
-	char *c;
+/*********************************************/
+/* shrink the input image to what the input  */
+/* draws in it, as far as the geometry pass  */
+/* can tell, before deciding on the poster   */
+/*********************************************/
+static int autocrop( struct tilejob *j)
+{
+	struct tilegeom *g = &j->geom;
+	struct tileplan m;
+	double bb[4], orig[4];
+	int i, sheets, verbose, rc;
+
+	if ((rc = scan( j)))
+		return rc;
+	if (!g->ok || !g->gotbb || g->unlocated)
+	{	if (j->opt.verbose)
+			fprintf( stderr, "Not cropping, since %s\n",
+				!g->ok ? g->why : g->unlocated ?
+				"not all marks could be located" : "nothing is drawn");
+		return postersize( j);
+	}
 
-	if (freopen (infile, "r", stdin) == NULL) {
-		fprintf (stderr, "%s: fail to open file '%s'!\n",
-			myname, infile);
-		printf ("/systemdict /showpage get exec\n");
-		printf ("%%%%EOF\n");
-		exit (1);
+	/* never more than the image was */
+	for (i = 0; i < 4; i++)
+		orig[i] = j->imagebb[i];
+	bb[0] = g->bb[0] > orig[0] ? g->bb[0] : orig[0];
+	bb[1] = g->bb[1] > orig[1] ? g->bb[1] : orig[1];
+	bb[2] = g->bb[2] < orig[2] ? g->bb[2] : orig[2];
+	bb[3] = g->bb[3] < orig[3] ? g->bb[3] : orig[3];
+	if (bb[2] - bb[0] <= 0.0 || bb[3] - bb[1] <= 0.0)
+	{	if (j->opt.verbose)
+			fprintf( stderr, "Not cropping, since nothing is drawn in the image\n");
+		return postersize( j);
 	}
 
-	/* fill first buffer for the first time */
-	if(fgets( buf[bp=0], BUFSIZE, stdin) == NULL) {
-		fprintf (stderr, "%s: failed to read %d bytes from file '%s'!\n",
-			myname, BUFSIZE, infile);
-		printf ("/systemdict /showpage get exec\n");
-		printf ("%%%%EOF\n");
-		exit (1);
+	/* the poster as it would have been, for the record */
+	sheets = 0;
+	if (j->opt.verbose)
+	{	getplan( j, &m);
+		verbose = j->opt.verbose;
+		j->opt.verbose = 0;
+		rc = postersize( j);
+		j->opt.verbose = verbose;
+		sheets = rc ? 0 : j->nrows * j->ncols;
+		j->code = 0;
+		useplan( j, &m);	/* -M picks the media again */
+	}
 
+	for (i = 0; i < 4; i++)
+		j->imagebb[i] = bb[i];
+	if ((rc = postersize( j)))
+		return rc;
+
+	if (j->opt.verbose)
+	{	fprintf( stderr, "Cropped input image [%g,%g,%g,%g] to [%g,%g,%g,%g]\n",
+			orig[0], orig[1], orig[2], orig[3], bb[0], bb[1], bb[2], bb[3]);
+		if (sheets)
+			fprintf( stderr, "Cropping saves %d of %d sheets\n",
+				sheets - j->nrows * j->ncols, sheets);
 	}
+	return TILE_OK;
+}
 
-	/* read subsequent lines by rotating the buffers */
-	while (fgets(buf[1-bp], BUFSIZE, stdin))
-	{	/* print line from the previous fgets */
-		/* do not print postscript comment lines: those (DSC) lines */
-		/* sometimes disturb proper previewing of the result with ghostview */
-		if (buf[bp][0] != '%')
-			fputs( buf[bp], stdout);
-		bp = 1-bp;
+/* the geometry pass, once for all that use it */
+static int scan( struct tilejob *j)
+{
+	if (!j->scanned && GeomScan( &j->geom, &j->input))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+	j->scanned = 1;
+	return TILE_OK;
+}
+
+/*********************************************/
+/* find the paths in the input, and which    */
+/* tiles they show on                        */
+/*********************************************/
+static int geomsetup( struct tilejob *j)
+{
+	double grid[5];
+	int i, n, rc;
+
+	if ((rc = scan( j)))
+		return rc;
+	if (!j->geom.ok)
+	{	if (j->opt.verbose)
+			fprintf( stderr, "Not %s tiles, since %s\n",
+				j->opt.cull ? "culling" : "skipping", j->geom.why);
+		return TILE_OK;
 	}
 
-	/* print buf from last successfull fgets, after removing cntlD */
-	for (c=buf[bp]; *c && *c != '\04'; c++);
-	if (*c == '\04')
-	{	tail_cntl_D = 1;
-		*c = '\0';
+	tilegrid( j, grid);
+	if (GeomIndex( &j->geom, grid[0], grid[1], grid[2], grid[3], grid[4],
+	               j->ncols, j->nrows))
+		return fail( j, TILE_ENOMEM, "%s: out of memory!", j->opt.creator);
+
+	if (j->opt.verbose && j->opt.skipblank)
+	{	for (n = i = 0; i < j->nrows * j->ncols; i++)
+			n += !j->geom.used[i];
+		if (j->geom.unlocated)
+			fprintf( stderr, "Not skipping tiles, since not all marks could be located\n");
+		else
+			fprintf( stderr, "Skipping %d blank tile%s of %d\n",
+				n, (n==1)?"":"s", j->nrows * j->ncols);
 	}
-	if (buf[bp][0] != '%' && strlen( buf[bp]))
-		fputs( buf[bp], stdout);
+	if (j->opt.verbose && j->opt.cull)
+	{	for (n = i = 0; i < j->nrows * j->ncols; i++)
+			n += j->geom.ncell[i];
+		fprintf( stderr, "Culling: %d of %d paths can be left out, "
+			"tiles carry %.1f of those on average\n",
+			j->geom.nitem, j->geom.npath, (double)n / (j->nrows * j->ncols));
+	}
+	return TILE_OK;
+}
+
+/*********************************************/
+/* whether a tile is left out of the output  */
+/*********************************************/
+static int skipped( struct tilejob *j, int row, int col)
+{
+	return j->opt.skipblank && GeomBlank( &j->geom, row, col);
 }
 
 static int mystrncasecmp( const char *s1, const char *s2, int n)
@@ -0,0 +1,100 @@
+/*
+#  tile.h - library interface of the tile.c freesewing program
+#
+#  A job turns one postscript input into one poster, or into a
+#  poster of each page of an input with several. All of its
+#  state lives in its struct tilejob, so a process can run many
+#  jobs, one after the other or at the same time on different
+#  threads. Errors are returned, never a reason to exit.
+#
+#  Typical use:
+#	struct tileoptions opt;
+#	struct tilejob *j;
+#
+#	TileDefaults( &opt);
+#	opt.posterspec = "3x3A4";
+#	j = TileNew( &opt);
+#	if (TileInputFile( j, "pattern.ps") || TileRun( j))
+#		fprintf( stderr, "%s\n", TileError( j));
+#	TileFree( j);
+#
+#  Jobs that share a struct tilecache read each language file,
+#  and format each variant of the prolog, only once.
+*/
+
+#ifndef TILE_H
+#define TILE_H
+
+#include <stddef.h>
+
+/* compile time defaults, media names from the table in tile.c */
+#define DefaultMedia  "A4"
+#define DefaultImage  "A4"
+#define DefaultCutMargin "5%"
+#define DefaultWhiteMargin "0"
+#define DefaultLanguage "en"
+#define DefaultPartName "tile-%p.ps"	/* in a directory of TileOutputFiles() */
+
+/* what TileNew() copies in; NULL specs take the defaults */
+struct tileoptions
+{	int verbose;		/* messages on stderr, > 1 is more */
+	int alignment;		/* add alignment marks */
+	int manualfeed;
+	int embed;		/* the input once, in the document setup */
+	int form;		/* and drawn as a form, implies embed */
+	int compress;		/* the input deflated: 1 in ASCII85, 2 binary */
+	int keepprolog;		/* the input's prolog on every page, not once */
+	int cull;		/* leave out the paths a tile does not show */
+	int skipblank;		/* leave out tiles that show nothing */
+	int autocrop;		/* shrink the image to what is drawn in it */
+	int anymedia;		/* smaller media of the table, for as many sheets */
+	int nthreads;		/* to build the pages on */
+	int splitpages;		/* tiles per file with TileOutputFiles(), 0 all */
+	size_t maxinput;	/* bytes a compressed input may unpack to, 0 any */
+
+	char *imagespec;	/* see tile.1 for these */
+	char *posterspec;
+	char *mediaspec;
+	char *cutmarginspec;
+	char *whitemarginspec;
+	char *scalespec;
+	char *patterntitle;
+	char *patternurl;
+	char *language;
+	char *creator;		/* for %%Creator, and in error messages */
+	char *pagespec;		/* the pages to print, like "1,3-7", NULL all */
+	char *inpagespec;	/* the pages of the input to print, NULL all */
+	char *indexname;	/* file to list the pages of the output in */
+	char *vmspec;		/* printer VM the input may take, like "2m" */
+};
+
+/* error codes */
+#define TILE_OK		0
+#define TILE_ENOMEM	1	/* out of memory */
+#define TILE_EINPUT	2	/* cannot read the input */
+#define TILE_EOUTPUT	3	/* cannot write the output */
+#define TILE_ESPEC	4	/* a box, margin or scale is not understood */
+#define TILE_ESIZE	5	/* the sizes do not make sense */
+#define TILE_EUSAGE	6	/* no input, or called out of order */
+
+struct tilejob;
+struct tilecache;
+
+void TileDefaults( struct tileoptions *opt);
+int TileOption( struct tileoptions *opt, int flag, char *arg);
+struct tilejob *TileNew( struct tileoptions *opt);
+int TileInputFile( struct tilejob *j, char *name);
+int TileInputMemory( struct tilejob *j, char *data, size_t size, char *name);
+void TileOutputFd( struct tilejob *j, int fd);
+void TileOutputCallback( struct tilejob *j,
+	int (*write)( void *arg, const char *buf, size_t len), void *arg);
+void TileOutputFiles( struct tilejob *j, char *name);
+void TileUseCache( struct tilejob *j, struct tilecache *c);
+int TileRun( struct tilejob *j);
+const char *TileError( struct tilejob *j);
+void TileFree( struct tilejob *j);
+
+struct tilecache *TileCacheNew( void);
+void TileCacheFree( struct tilecache *c);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+#  tilebatch - many jobs of the tile.c freesewing program at once
+#
+#  Reads a manifest with one job per line:
+#	<infile> <outfile> [options]
+#  with the options as on the command line, like
+#	pattern.ps poster.ps -p3x3A4 -C -t "My pattern"
+#  Empty lines and lines starting with '#' are skipped.
+#  A fixed number of threads takes the jobs from the list, each
+#  thread the next one not yet taken, so a thread that finishes a
+#  job early does not wait for the others. All jobs share one
+#  struct tilecache, for the language files and prologs.
+#  Every job reports its status and time on standard output.
+#
+# --------------------------------------------------------------
+#  Tile is a fork of 'poster' by Jos T.J. van Eijndhoven
+#  <J.T.J.v.Eijndhoven@ele.tue.nl>
+#
+#  Forked by Joost De Cock for freesewing.org
+#
+#  Copyright (C) 1999 Jos T.J. van Eijndhoven
+#  Copyright (C) 2021 Joost De Cock
+# --------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "tile.h"
+#include "tilebatch.h"
+
+/* words on a manifest line */
+#define MAXWORDS 64
+
+/* the options with an argument, as for getopt() */
+#define ARGFLAGS "jnPIXVilcwmpstu"
+
+struct batchjob
+{	int lineno;
+	char *line;		/* the words point into it */
+	char *word[ MAXWORDS];
+	int nword;
+};
+
+struct batch
+{	pthread_mutex_t lock;	/* for next, failed and the report */
+	struct batchjob *job;
+	int njobs;
+	int next;		/* next job to take */
+	int failed;
+	struct tileoptions *opt;
+	struct tilecache *cache;
+	char *manifest;
+};
+
+static int readmanifest( struct batch *b);
+static int split( struct batchjob *bj);
+static void *worker( void *arg);
+static void run( struct batch *b, struct batchjob *bj);
+static double now( void);
+
+/*********************************************/
+/* run the jobs of the manifest, "-" for     */
+/* standard input; returns non-zero when     */
+/* any job failed                            */
+/*********************************************/
+int BatchRun( char *manifest, struct tileoptions *opt)
+{
+	struct batch b;
+	pthread_t *threads;
+	double start;
+	int nthreads, i;
+
+	start = now();
+	memset( &b, 0, sizeof( b));
+	pthread_mutex_init( &b.lock, NULL);
+	b.opt = opt;
+	b.manifest = manifest;
+	if (readmanifest( &b))
+		return 1;
+
+	nthreads = opt->nthreads < 1 ? 1 : opt->nthreads;
+	if (nthreads > b.njobs)
+		nthreads = b.njobs ? b.njobs : 1;
+	if (!(threads = malloc( nthreads * sizeof( *threads))) ||
+	    !(b.cache = TileCacheNew()))
+	{	fprintf( stderr, "%s: out of memory!\n", opt->creator);
+		return 1;
+	}
+
+	/* this thread is one of the workers */
+	for (i = 1; i < nthreads; i++)
+		if (pthread_create( threads + i, NULL, worker, &b))
+			break;
+	worker( &b);
+	while (--i > 0)
+		pthread_join( threads[i], NULL);
+
+	printf( "%d jobs, %d failed, %.3fs\n", b.njobs, b.failed, now() - start);
+	fflush( stdout);
+
+	for (i = 0; i < b.njobs; i++)
+		free( b.job[i].line);
+	free( b.job);
+	free( threads);
+	TileCacheFree( b.cache);
+	return b.failed != 0;
+}
+
+/* read all jobs of the manifest */
+static int readmanifest( struct batch *b)
+{
+	struct batchjob *bj;
+	FILE *f;
+	char *line;
+	size_t size;
+	int room, lineno;
+
+	if (!strcmp( b->manifest, "-"))
+		f = stdin;
+	else if (!(f = fopen( b->manifest, "r")))
+	{	fprintf( stderr, "%s: fail to open file '%s'!\n",
+			b->opt->creator, b->manifest);
+		return 1;
+	}
+
+	room = 0;
+	for (lineno = 1; ; lineno++)
+	{	line = NULL;
+		size = 0;
+		if (getline( &line, &size, f) < 0)
+		{	free( line);
+			break;
+		}
+		if (b->njobs == room)
+		{	room = room ? 2 * room : 64;
+			if (!(bj = realloc( b->job, room * sizeof( *bj))))
+			{	fprintf( stderr, "%s: out of memory!\n", b->opt->creator);
+				return 1;
+			}
+			b->job = bj;
+		}
+		bj = b->job + b->njobs;
+		memset( bj, 0, sizeof( *bj));
+		bj->lineno = lineno;
+		bj->line = line;
+		if (split( bj))
+		{	fprintf( stderr, "%s: line %d: too many words!\n",
+				b->manifest, lineno);
+			return 1;
+		}
+		if (bj->nword == 0 || bj->word[0][0] == '#')
+		{	free( line);
+			continue;
+		}
+		if (bj->nword < 2)
+		{	fprintf( stderr, "%s: line %d: no output file!\n",
+				b->manifest, lineno);
+			return 1;
+		}
+		b->njobs++;
+	}
+	if (f != stdin)
+		fclose( f);
+	return 0;
+}
+
+/* cut the line into words, "" quotes a word with spaces */
+static int split( struct batchjob *bj)
+{
+	char *c, *w;
+
+	for (c = bj->line; ; )
+	{	while (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r')
+			c++;
+		if (!*c)
+			return 0;
+		if (bj->nword == MAXWORDS)
+			return 1;
+		bj->word[ bj->nword++] = w = c;
+		while (*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
+		{	if (*c == '"')
+			{	for (c++; *c && *c != '"'; )
+					*w++ = *c++;
+				if (*c)
+					c++;
+			} else
+				*w++ = *c++;
+		}
+		if (*c)
+			c++;
+		*w = '\0';
+	}
+}
+
+static void *worker( void *arg)
+{
+	struct batch *b = arg;
+	int n;
+
+	for (;;)
+	{	pthread_mutex_lock( &b->lock);
+		n = b->next < b->njobs ? b->next++ : -1;
+		pthread_mutex_unlock( &b->lock);
+		if (n < 0)
+			break;
+		run( b, b->job + n);
+	}
+	return NULL;
+}
+
+/*********************************************/
+/* one job of the manifest                   */
+/*********************************************/
+static void run( struct batch *b, struct batchjob *bj)
+{
+	struct tileoptions opt;
+	struct tilejob *j;
+	char *input, *output, *w, *arg;
+	char error[ 256];
+	const char *why;
+	double start;
+	int i, rc;
+
+	start = now();
+	input = bj->word[0];
+	output = bj->word[1];
+	opt = *b->opt;
+	opt.nthreads = 1;	/* the threads go to the jobs */
+	j = NULL;
+	why = error;
+	rc = TILE_OK;
+
+	for (i = 2; i < bj->nword && !rc; i++)
+	{	w = bj->word[i];
+		arg = w + 2;
+		if (w[0] == '-' && w[1] && !w[2] && strchr( ARGFLAGS, w[1]) &&
+		    i + 1 < bj->nword)
+			arg = bj->word[ ++i];
+		if (w[0] != '-' || !w[1] || TileOption( &opt, w[1], arg))
+		{	snprintf( error, sizeof( error), "Unknown option '%.64s'!", w);
+			rc = TILE_EUSAGE;
+		}
+	}
+
+	if (rc)
+		;
+	else if (!(j = TileNew( &opt)))
+	{	snprintf( error, sizeof( error), "%s: out of memory!", opt.creator);
+		rc = TILE_ENOMEM;
+	} else
+	{	/* the job opens the output, and removes it on failure */
+		TileUseCache( j, b->cache);
+		TileOutputFiles( j, output);
+		if (!(rc = TileInputFile( j, input)))
+			rc = TileRun( j);
+		why = TileError( j);
+	}
+
+	pthread_mutex_lock( &b->lock);
+	if (rc)
+	{	b->failed++;
+		printf( "%s:%d: %s -> %s: failed, %.3fs\n%s\n", b->manifest,
+			bj->lineno, input, output, now() - start, why);
+	} else
+		printf( "%s:%d: %s -> %s: done, %.3fs\n", b->manifest,
+			bj->lineno, input, output, now() - start);
+	fflush( stdout);
+	pthread_mutex_unlock( &b->lock);
+
+	TileFree( j);
+}
+
+/* seconds, for the report */
+static double now( void)
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,8 @@
+/*
+#  tilebatch - many jobs of the tile.c freesewing program at once
+#
+#  Runs the jobs listed in a manifest file, with opt as the
+#  defaults of every job, and opt->nthreads jobs at the same time.
+*/
+
+int BatchRun( char *manifest, struct tileoptions *opt);
@@ -0,0 +1,104 @@
+/*
+#  tilebench - the input scan of the tile.c freesewing program
+#
+#  Times InputOpen(), which maps an input and finds its comment
+#  lines, on each file given, and prints the speed of the best of
+#  five runs. With -s it prints the segments of each file instead,
+#  one "offset length" line each and a last "^D" line if the input
+#  ended with one, to compare the builds of tileinput.c:
+#	tilebench -s pattern.ps
+#  The Makefile builds this program with each path of the comment
+#  line search: the memchr() loop, 16 and 32 bytes at a time.
+#
+# --------------------------------------------------------------
+#  Tile is a fork of 'poster' by Jos T.J. van Eijndhoven
+#  <J.T.J.v.Eijndhoven@ele.tue.nl>
+#
+#  Forked by Joost De Cock for freesewing.org
+#
+#  Copyright (C) 1999 Jos T.J. van Eijndhoven
+#  Copyright (C) 2021 Joost De Cock
+# --------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "tileinput.h"
+
+#define RUNS 5
+
+/* seconds, for the timing */
+static double now( void)
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int segments( char *name)
+{
+	struct tileinput in;
+	int i;
+
+	if (InputOpen( &in, name, 0))
+	{	perror( name);
+		return 1;
+	}
+	for (i = 0; i < in.nseg; i++)
+		printf( "%lu %lu\n", (unsigned long)in.seg[i].off,
+			(unsigned long)in.seg[i].len);
+	if (in.tail_cntl_D)
+		printf( "^D\n");
+	InputClose( &in);
+	return 0;
+}
+
+static int bench( char *name)
+{
+	struct tileinput in;
+	double t, best = 0;
+	size_t size = 0;
+	int run, nseg = 0;
+
+	for (run = 0; run < RUNS; run++)
+	{	t = now();
+		if (InputOpen( &in, name, 0))
+		{	perror( name);
+			return 1;
+		}
+		t = now() - t;
+		if (run == 0 || t < best)
+			best = t;
+		size = in.size;
+		nseg = in.nseg;
+		InputClose( &in);
+	}
+	printf( "%s: %lu bytes, %d segments, %.4f s, %.2f GB/s\n",
+		name, (unsigned long)size, nseg, best,
+		best > 0 ? size / best / 1e9 : 0.0);
+	return 0;
+}
+
+int main( int argc, char *argv[])
+{
+	int c, list = 0, rc = 0;
+
+	while ((c = getopt( argc, argv, "s")) != EOF)
+	{	switch( c)
+		{	case 's':	list = 1; break;
+			default:	fprintf( stderr, "Usage: %s [-s] <file>...\n", argv[0]);
+					exit( 1);
+		}
+	}
+	if (optind == argc)
+	{	fprintf( stderr, "Usage: %s [-s] <file>...\n", argv[0]);
+		exit( 1);
+	}
+	for (; optind < argc; optind++)
+		rc |= list ? segments( argv[optind]) : bench( argv[optind]);
+	return rc;
+}
@@ -0,0 +1,1726 @@
+/*
+#  tilegeom - geometry pass for the tile.c freesewing program
+#
+#  A light-weight scan over the PostScript input that does not
+#  interpret it, but follows just enough of it (the current
+#  transformation, the current point, the line width and the
+#  gsave nesting) to find the extent of each painted path.
+#  A path statement, from its first moveto upto the stroke or fill
+#  that ends it, that leaves no state behind can be left out of
+#  every tile it does not show on.
+#  Next to the usual operators, the `m l c h re S f ...' shorthands
+#  of freesewing and cairo output are taken for what they stand for.
+#
+#  Whenever the input does something this scan cannot follow
+#  (such as reading inline data with currentfile), it gives up
+#  and every tile gets the complete input as before.
+#
+# --------------------------------------------------------------
+#  Tile is a fork of 'poster' by Jos T.J. van Eijndhoven
+#  <J.T.J.v.Eijndhoven@ele.tue.nl>
+#
+#  Forked by Joost De Cock for freesewing.org
+#
+#  Copyright (C) 1999 Jos T.J. van Eijndhoven
+#  Copyright (C) 2021 Joost De Cock
+# --------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "tileinput.h"
+#include "tilegeom.h"
+
+#define MAXSTACK 64
+#define MAXGS 32
+#define MAXPROC 32
+#define DefaultFontSize 12.0
+
+/* what an operator does, as far as the scan is concerned */
+enum
+{	OP_NONE, OP_MOVETO, OP_RMOVETO, OP_LINETO, OP_RLINETO, OP_CURVETO,
+	OP_RCURVETO, OP_V, OP_Y, OP_CLOSEPATH, OP_ARC, OP_ARCT, OP_RE,
+	OP_CHARPATH, OP_STROKE, OP_FILL, OP_FILLSTROKE, OP_RECTFILL,
+	OP_RECTSTROKE, OP_SHOW, OP_IMAGE, OP_SHFILL, OP_NEWPATH, OP_CLIP,
+	OP_GSAVE, OP_SAVE, OP_GRESTORE, OP_RESTORE,
+	OP_TRANSLATE, OP_SCALE, OP_ROTATE, OP_CONCAT, OP_CM, OP_SETMATRIX,
+	OP_STYLE, OP_LINEWIDTH, OP_MITER, OP_FONTSIZE,
+	OP_DEF, OP_BIND, OP_LOAD, OP_POP, OP_EXCH, OP_DUP,
+	OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG, OP_CURRENTFILE, OP_RUN
+};
+
+/* what a procedure does */
+#define F_PATH		1
+#define F_PAINT		2
+#define F_CTM		4
+#define F_CURFILE	8
+
+static struct builtin
+{	char *name;
+	int op;
+	int arity;	/* operands of OP_STYLE, OP_SHOW and OP_FONTSIZE */
+} builtins[] =
+{	/* sorted for bsearch() */
+	{ "B",		OP_FILLSTROKE,	0},
+	{ "B*",		OP_FILLSTROKE,	0},
+	{ "F",		OP_FILL,	0},
+	{ "G",		OP_STYLE,	1},
+	{ "J",		OP_STYLE,	1},
+	{ "K",		OP_STYLE,	4},
+	{ "M",		OP_MITER,	1},
+	{ "Q",		OP_GRESTORE,	0},
+	{ "RG",		OP_STYLE,	3},
+	{ "S",		OP_STROKE,	0},
+	{ "TJ",		OP_SHOW,	1},
+	{ "Tf",		OP_FONTSIZE,	2},
+	{ "Tj",		OP_SHOW,	1},
+	{ "W",		OP_CLIP,	0},
+	{ "W*",		OP_CLIP,	0},
+	{ "add",	OP_ADD,		0},
+	{ "arc",	OP_ARC,		0},
+	{ "arcn",	OP_ARC,		0},
+	{ "arct",	OP_ARCT,	0},
+	{ "ashow",	OP_SHOW,	3},
+	{ "awidthshow",	OP_SHOW,	6},
+	{ "b",		OP_FILLSTROKE,	0},
+	{ "b*",		OP_FILLSTROKE,	0},
+	{ "bind",	OP_BIND,	0},
+	{ "c",		OP_CURVETO,	0},
+	{ "charpath",	OP_CHARPATH,	2},
+	{ "clip",	OP_CLIP,	0},
+	{ "closepath",	OP_CLOSEPATH,	0},
+	{ "cm",		OP_CM,		0},
+	{ "colorimage",	OP_IMAGE,	0},
+	{ "concat",	OP_CONCAT,	0},
+	{ "currentfile",OP_CURRENTFILE,	0},
+	{ "curveto",	OP_CURVETO,	0},
+	{ "d",		OP_STYLE,	2},
+	{ "def",	OP_DEF,		0},
+	{ "div",	OP_DIV,		0},
+	{ "dup",	OP_DUP,		0},
+	{ "eoclip",	OP_CLIP,	0},
+	{ "eofill",	OP_FILL,	0},
+	{ "exch",	OP_EXCH,	0},
+	{ "exec",	OP_RUN,		0},
+	{ "f",		OP_FILL,	0},
+	{ "f*",		OP_FILL,	0},
+	{ "fill",	OP_FILL,	0},
+	{ "for",	OP_RUN,		0},
+	{ "forall",	OP_RUN,		0},
+	{ "g",		OP_STYLE,	1},
+	{ "glyphshow",	OP_SHOW,	1},
+	{ "grestore",	OP_GRESTORE,	0},
+	{ "gsave",	OP_GSAVE,	0},
+	{ "h",		OP_CLOSEPATH,	0},
+	{ "i",		OP_STYLE,	1},
+	{ "if",		OP_RUN,		0},
+	{ "ifelse",	OP_RUN,		0},
+	{ "image",	OP_IMAGE,	0},
+	{ "imagemask",	OP_IMAGE,	0},
+	{ "initgraphics",OP_SETMATRIX,	0},
+	{ "initmatrix",	OP_SETMATRIX,	0},
+	{ "j",		OP_STYLE,	1},
+	{ "k",		OP_STYLE,	4},
+	{ "kshow",	OP_SHOW,	2},
+	{ "l",		OP_LINETO,	0},
+	{ "lineto",	OP_LINETO,	0},
+	{ "load",	OP_LOAD,	0},
+	{ "loop",	OP_RUN,		0},
+	{ "m",		OP_MOVETO,	0},
+	{ "moveto",	OP_MOVETO,	0},
+	{ "mul",	OP_MUL,		0},
+	{ "n",		OP_NEWPATH,	0},
+	{ "neg",	OP_NEG,		0},
+	{ "newpath",	OP_NEWPATH,	0},
+	{ "pop",	OP_POP,		0},
+	{ "q",		OP_GSAVE,	0},
+	{ "rcurveto",	OP_RCURVETO,	0},
+	{ "re",		OP_RE,		0},
+	{ "rectfill",	OP_RECTFILL,	0},
+	{ "rectstroke",	OP_RECTSTROKE,	0},
+	{ "repeat",	OP_RUN,		0},
+	{ "restore",	OP_RESTORE,	0},
+	{ "rg",		OP_STYLE,	3},
+	{ "rlineto",	OP_RLINETO,	0},
+	{ "rmoveto",	OP_RMOVETO,	0},
+	{ "rotate",	OP_ROTATE,	0},
+	{ "s",		OP_STROKE,	0},
+	{ "save",	OP_SAVE,	0},
+	{ "scale",	OP_SCALE,	0},
+	{ "scalefont",	OP_FONTSIZE,	2},
+	{ "selectfont",	OP_FONTSIZE,	2},
+	{ "setcmykcolor",OP_STYLE,	4},
+	{ "setdash",	OP_STYLE,	2},
+	{ "setflat",	OP_STYLE,	1},
+	{ "setgray",	OP_STYLE,	1},
+	{ "sethsbcolor",OP_STYLE,	3},
+	{ "setlinecap",	OP_STYLE,	1},
+	{ "setlinejoin",OP_STYLE,	1},
+	{ "setlinewidth",OP_LINEWIDTH,	1},
+	{ "setmatrix",	OP_SETMATRIX,	0},
+	{ "setmiterlimit",OP_MITER,	1},
+	{ "setrgbcolor",OP_STYLE,	3},
+	{ "shfill",	OP_SHFILL,	0},
+	{ "show",	OP_SHOW,	1},
+	{ "stopped",	OP_RUN,		0},
+	{ "stroke",	OP_STROKE,	0},
+	{ "sub",	OP_SUB,		0},
+	{ "translate",	OP_TRANSLATE,	0},
+	{ "ueofill",	OP_SHFILL,	0},
+	{ "ufill",	OP_SHFILL,	0},
+	{ "ustroke",	OP_SHFILL,	0},
+	{ "v",		OP_V,		0},
+	{ "w",		OP_LINEWIDTH,	1},
+	{ "widthshow",	OP_SHOW,	4},
+	{ "xshow",	OP_SHOW,	2},
+	{ "xyshow",	OP_SHOW,	2},
+	{ "y",		OP_Y,		0},
+	{ "yshow",	OP_SHOW,	2},
+};
+#define NBUILTIN (sizeof( builtins) / sizeof( builtins[0]))
+
+/* operators that leave the matrix, the path and the page alone; */
+/* any other name the scan does not know may change or draw them */
+static char *quiet[] =
+{	/* sorted for the search in isquiet() */
+	"=", "==", "abs", "aload", "and", "array", "astore", "atan", "begin",
+	"ceiling", "clear", "cleartomark", "copy", "cos", "count",
+	"countdictstack", "counttomark", "currentdict", "currentfont",
+	"currentgray", "currentlinewidth", "currentmatrix", "currentpoint",
+	"currentrgbcolor", "cvi", "cvlit", "cvn", "cvr", "cvs", "cvx",
+	"definefont", "dict", "dictstack", "dtransform", "end", "eq", "exit",
+	"exp", "false", "findfont", "floor", "flush", "ge", "get",
+	"getinterval", "globaldict", "gt", "idiv", "idtransform", "index",
+	"itransform", "known", "le", "length", "ln", "log", "lt", "makefont",
+	"mark", "matrix", "mod", "ne", "not", "null", "or", "pathbbox",
+	"print", "pstack", "put", "putinterval", "readonly", "rectclip",
+	"roll", "round", "setcolor", "setcolorspace", "setfont",
+	"setoverprint", "setpattern", "setstrokeadjust", "showpage", "sin",
+	"sqrt", "stack", "stop", "string", "stringwidth", "systemdict",
+	"transform", "true", "truncate", "type", "undef", "userdict",
+	"where", "xcheck", "xor"
+};
+#define NQUIET (sizeof( quiet) / sizeof( quiet[0]))
+
+/* operand kinds */
+enum { K_UNKNOWN, K_NUMBER, K_ARRAY, K_PROC, K_NAME, K_STRING, K_MARK, K_LOADED };
+
+struct operand
+{	int kind;
+	size_t off;		/* where its token(s) start */
+	double v[6];		/* number, or numeric array of upto 6 */
+	int n;
+	int flags;		/* of a procedure */
+	struct builtin *op;	/* procedure or loaded name standing for one operator */
+	char *name;		/* literal name, or string */
+	int len;
+};
+
+/* names defined by the input itself */
+struct definition
+{	char *name;
+	int len;
+	int kind;		/* K_NUMBER, K_PROC or K_UNKNOWN */
+	double v;
+	int flags;
+	struct builtin *op;
+};
+
+struct gstate
+{	double m[6];		/* from user space to input space */
+	int mknown;
+	double cx, cy;		/* current point, in input space */
+	int cpknown;
+	double sx, sy;		/* start of the current subpath */
+	double lw, miter, fontsize;
+	int lwknown;
+};
+
+struct scan
+{	struct tilegeom *g;
+	struct tileinput *in;
+	char *d;
+
+	struct operand st[MAXSTACK];
+	int sp;
+	struct gstate gs[MAXGS];
+	int gsp;
+
+	/* procedure being collected */
+	int procdepth;
+	int pflags[MAXPROC];
+	int ptokens;
+	struct builtin *pop;
+	size_t pstart;
+
+	/* the path statement being followed */
+	int inpath;		/* a path is being built */
+	int segments;		/* it draws more than just movetos */
+	size_t istart;
+	int idepth;		/* operand stack depth when it started */
+	int igs;		/* gsave nesting within it */
+	int itaint;		/* it changes state, keep it on all tiles */
+	int iloc;		/* all of its points are known */
+	int ipaint;
+	double ibb[4];
+	int ibbset;
+	double iexp;		/* stroke extent around the path */
+
+	struct definition *def;
+	int ndef, defroom;
+
+	int markroom;
+	struct tilesegment *range;	/* of each item */
+	int itemroom;
+	size_t lastend;
+};
+
+static void token( struct scan *s, size_t off, size_t end);
+static void execute( struct scan *s, struct builtin *b, size_t off, size_t end);
+static void runflags( struct scan *s, int flags);
+static struct operand *push( struct scan *s, int kind, size_t off);
+static int numbers( struct scan *s, int n, double *v);
+static void startpath( struct scan *s, int arity, size_t off);
+static void addpoint( struct scan *s, double x, double y);
+static void adduser( struct scan *s, double x, double y);
+static void addmark( struct scan *s, double bb[4]);
+static void endpath( struct scan *s, size_t end, int cullable);
+static void taint( struct scan *s);
+static void fail( struct scan *s, char *why);
+static void concat( struct gstate *gs, double m[6]);
+static struct builtin *findbuiltin( char *name, int len);
+static int isquiet( char *name, int len);
+static struct definition *finddef( struct scan *s, char *name, int len, int add);
+static int flagsof( struct scan *s, char *name, int len);
+static int opflags( struct builtin *b);
+static int makepieces( struct tilegeom *g, struct tileinput *in,
+	struct tilesegment *range);
+static int addrange( struct tilesegment **seg, int *n, int *room, size_t off, size_t end,
+	int merge);
+static void cellrange( double bb[4], double ox, double oy, double cw, double ch,
+	double margin, int ncols, int nrows, int *c0, int *c1, int *r0, int *r1);
+static void markcells( struct tilegeom *g, double ox, double oy, double cw, double ch,
+	double margin, int ncols, int nrows, char *used);
+static size_t skipdata( struct scan *s, size_t p);
+
+#define isspc(c)	((c)==' ' || (c)=='\t' || (c)=='\n' || (c)=='\r' || \
+			 (c)=='\f' || (c)=='\0' || (c)=='\04')
+#define isdelim(c)	((c)=='(' || (c)==')' || (c)=='<' || (c)=='>' || (c)=='[' || \
+			 (c)==']' || (c)=='{' || (c)=='}' || (c)=='/' || (c)=='%')
+
+/*********************************************/
+/* scan the input, collecting its paths;    */
+/* only the ranges of the view of an input   */
+/* of InputView()                            */
+/* returns 0, or -1 when out of memory       */
+/* g->ok tells whether the result is usable  */
+/*********************************************/
+int GeomScan( struct tilegeom *g, struct tileinput *in)
+{
+	struct scan *s;
+	size_t p, start, size, vend;
+	char *d;
+	int depth, rc, v;
+
+	memset( g, 0, sizeof( *g));
+	if (!(s = calloc( 1, sizeof( *s))))
+		return -1;
+	s->g = g;
+	s->in = in;
+	s->d = d = in->data;
+	size = in->size;
+	g->ok = 1;
+	v = 0;
+	p = 0;
+	vend = size;
+	if (in->nview)
+	{	p = in->view[0].off;
+		vend = p + in->view[0].len;
+		size = in->view[ in->nview - 1].off + in->view[ in->nview - 1].len;
+	}
+
+	s->gs[0].m[0] = s->gs[0].m[3] = 1.0;
+	s->gs[0].mknown = 1;
+	s->gs[0].lw = 1.0;
+	s->gs[0].lwknown = 1;
+	s->gs[0].miter = 10.0;
+	s->gs[0].fontsize = DefaultFontSize;
+
+	while (p < size && g->ok)
+	{	if (p >= vend)
+		{	/* on to the next range of the view */
+			if (++v >= in->nview)
+				break;
+			p = in->view[v].off;
+			vend = p + in->view[v].len;
+			continue;
+		}
+		if (isspc( d[p]))
+		{	p++;
+			continue;
+		}
+		start = p;
+		switch (d[p])
+		{ case '%':
+			if (p == 0 || d[p-1] == '\n' || d[p-1] == '\r')
+				p = skipdata( s, p);
+			else
+				p = InputLineEnd( in, p);
+			continue;
+
+		  case '(':
+			for (depth = 0, p++; p < size; p++)
+			{	if (d[p] == '\\') p++;
+				else if (d[p] == '(') depth++;
+				else if (d[p] == ')' && depth-- == 0) break;
+			}
+			p++;
+			break;
+
+		  case '<':
+			if (p+1 < size && d[p+1] == '<')
+				p += 2;
+			else if (p+1 < size && d[p+1] == '~')
+			{	for (p += 2; p+1 < size && !(d[p] == '~' && d[p+1] == '>'); p++)
+					;
+				p += 2;
+			} else
+			{	for (p++; p < size && d[p] != '>'; p++)
+					;
+				p++;
+			}
+			break;
+
+		  case '>':
+			p += (p+1 < size && d[p+1] == '>') ? 2 : 1;
+			break;
+
+		  case '[': case ']': case '{': case '}': case ')':
+			p++;
+			break;
+
+		  case '/':
+			/* literal (or immediately evaluated) name */
+			p++;
+			if (p < size && d[p] == '/') p++;
+			while (p < size && !isspc( d[p]) && !isdelim( d[p])) p++;
+			break;
+
+		  default:
+			/* executable names and numbers */
+			for (p++; p < size && !isspc( d[p]) && !isdelim( d[p]); p++);
+			break;
+		}
+		if (p > size) p = size;
+		token( s, start, p);
+	}
+
+	if (s->inpath)
+		endpath( s, size, 0);
+
+	rc = 0;
+	if (g->ok)
+		rc = makepieces( g, in, s->range);
+	free( s->range);
+	free( s->def);
+	free( s);
+	return rc;
+}
+
+/*********************************************/
+/* the %%BeginData: and %%BeginBinary:       */
+/* sections are skipped, other comments are  */
+/* just comments                             */
+/*********************************************/
+static size_t skipdata( struct scan *s, size_t p)
+{
+	char buf[128], type[32], unit[32];
+	size_t end, len;
+	long n;
+	int lines;
+
+	end = InputLineEnd( s->in, p);
+	len = end - p;
+	if (len >= sizeof( buf)) len = sizeof( buf) - 1;
+	memcpy( buf, s->d + p, len);
+	buf[len] = '\0';
+
+	lines = 0;
+	if (!strncmp( buf, "%%BeginData:", 12))
+	{	unit[0] = '\0';
+		if (sscanf( buf+12, "%ld %31s %31s", &n, type, unit) < 1)
+			return end;
+		lines = !strncmp( unit, "Lines", 5);
+	} else if (!strncmp( buf, "%%BeginBinary:", 14))
+	{	if (sscanf( buf+14, "%ld", &n) != 1)
+			return end;
+	} else
+		return end;
+
+	/* marks in here cannot be located */
+	s->g->unlocated = 1;
+	if (s->inpath) taint( s);
+
+	for (p = end; n > 0 && p < s->in->size; n--)
+		p = lines ? InputLineEnd( s->in, p) : p + 1;
+	return p;
+}
+
+/*********************************************/
+/* handle one token, from off upto end       */
+/*********************************************/
+static void token( struct scan *s, size_t off, size_t end)
+{
+	char *t = s->d + off, *e, nbuf[64];
+	int len = end - off, i, n, flags;
+	struct operand *o, *mark;
+	struct builtin *b;
+	struct definition *df;
+	double v;
+
+	/* inside a procedure body: only note what it does */
+	if (s->procdepth)
+	{	if (t[0] == '{')
+		{	if (s->procdepth == MAXPROC)
+			{	fail( s, "procedures nested too deep");
+				return;
+			}
+			s->pflags[s->procdepth++] = 0;
+			s->ptokens++;
+			return;
+		}
+		if (t[0] == '}')
+		{	flags = s->pflags[--s->procdepth];
+			if (s->procdepth)
+			{	s->pflags[s->procdepth-1] |= flags;
+				return;
+			}
+			o = push( s, K_PROC, s->pstart);
+			o->flags = flags;
+			o->op = (s->ptokens == 1) ? s->pop : NULL;
+			return;
+		}
+		s->ptokens++;
+		s->pop = NULL;
+		if (t[0] != '/' && !isdelim( t[0]) && !isdigit( (unsigned char)t[0]) &&
+		    t[0] != '-' && t[0] != '.')
+		{	s->pflags[s->procdepth-1] |= flagsof( s, t, len);
+			s->pop = (df = finddef( s, t, len, 0)) != NULL ? df->op :
+				findbuiltin( t, len);
+		}
+		return;
+	}
+
+	switch (t[0])
+	{ case '{':
+		s->procdepth = 1;
+		s->pflags[0] = 0;
+		s->ptokens = 0;
+		s->pop = NULL;
+		s->pstart = off;
+		return;
+
+	  case '}':
+		fail( s, "unbalanced procedure braces");
+		return;
+
+	  case '(':
+		o = push( s, K_STRING, off);
+		o->name = t + 1;
+		o->len = len - 2;
+		return;
+
+	  case '<':
+		if (len == 2 && t[1] == '<')
+			push( s, K_MARK, off);
+		else
+		{	/* hex or ascii85 strings, length is a guess */
+			o = push( s, K_STRING, off);
+			o->len = len / 2;
+		}
+		return;
+
+	  case '[':
+		push( s, K_MARK, off);
+		return;
+
+	  case '>':
+	  case ']':
+		/* build the array (or dict), keep it if it is a matrix */
+		for (i = s->sp - 1; i >= 0 && s->st[i].kind != K_MARK; i--);
+		if (i < 0)
+		{	s->sp = 0;
+			push( s, K_UNKNOWN, off);
+			return;
+		}
+		mark = &s->st[i];
+		n = s->sp - i - 1;
+		if (t[0] == ']' && n <= 6 && numbers( s, n, mark->v) == n)
+		{	mark->kind = K_ARRAY;
+			mark->n = n;
+		} else
+			mark->kind = K_UNKNOWN;
+		s->sp = i + 1;
+		return;
+
+	  case ')':
+		return;
+
+	  case '/':
+		o = push( s, K_NAME, off);
+		o->name = t + 1;
+		o->len = len - 1;
+		if (o->len && o->name[0] == '/')
+		{	o->name++;
+			o->len--;
+		}
+		return;
+	}
+
+	/* a number? */
+	if (isdigit( (unsigned char)t[0]) || t[0] == '-' || t[0] == '+' || t[0] == '.')
+	{	if (len < (int)sizeof( nbuf))
+		{	memcpy( nbuf, t, len);
+			nbuf[len] = '\0';
+			v = strtod( nbuf, &e);
+			if (*e == '#')
+				v = strtol( e + 1, &e, (int)v);
+			if (*e == '\0' && e != nbuf)
+			{	o = push( s, K_NUMBER, off);
+				o->v[0] = v;
+				return;
+			}
+		}
+	}
+
+	/* executable name: what the input defined first, as */
+	/* that shadows the shorthands and operators of that name */
+	if ((df = finddef( s, t, len, 0)) != NULL)
+	{	if (df->kind == K_NUMBER)
+		{	o = push( s, K_NUMBER, off);
+			o->v[0] = df->v;
+		} else if (df->kind == K_PROC && df->op)
+			execute( s, df->op, off, end);
+		else if (df->kind == K_PROC)
+		{	runflags( s, df->flags);
+			s->sp = 0;
+		} else
+			push( s, K_UNKNOWN, off);
+		return;
+	}
+
+	if ((b = findbuiltin( t, len)) != NULL)
+	{	execute( s, b, off, end);
+		return;
+	}
+
+	/* some operator that does not matter here, */
+	/* its operands are unknown, so drop them all; */
+	/* in a path it may be a procedure that draws */
+	if (s->inpath && !s->igs)
+	{	taint( s);
+		s->iloc = 0;
+	} else if (!isquiet( t, len))
+		/* or one that moves what follows, or draws */
+		runflags( s, F_CTM | F_PATH);
+	s->sp = 0;
+}
+
+/*********************************************/
+/* the effect of running code with flags     */
+/*********************************************/
+static void runflags( struct scan *s, int flags)
+{
+	struct gstate *gs = &s->gs[s->gsp];
+
+	if (flags & F_CURFILE)
+	{	fail( s, "it reads inline data");
+		return;
+	}
+	if (flags & F_CTM)
+		gs->mknown = 0;
+	if (flags & (F_PATH | F_PAINT))
+	{	if (!s->inpath && (flags & F_PATH))
+		{	startpath( s, 0, 0);
+			s->iloc = 0;
+		}
+		s->g->unlocated = 1;
+		gs->cpknown = 0;
+	}
+	if (s->inpath)
+		taint( s);
+}
+
+static void execute( struct scan *s, struct builtin *b, size_t off, size_t end)
+{
+	struct gstate *gs = &s->gs[s->gsp];
+	struct operand *o;
+	struct definition *df;
+	double v[6], m[6], bb[4], x, y, r, a, w;
+	int i, n, flags, inside;
+
+	/* operators that change state in the middle of a path */
+	/* statement (not within a gsave of it) make it stay */
+	inside = s->inpath && !s->igs;
+
+	switch (b->op)
+	{ case OP_MOVETO:
+	  case OP_LINETO:
+		startpath( s, 2, off);
+		if (numbers( s, 2, v) == 2 && gs->mknown)
+		{	adduser( s, v[0], v[1]);
+			gs->cpknown = 1;
+		} else
+			s->iloc = gs->cpknown = 0;
+		if (b->op == OP_MOVETO)
+		{	gs->sx = gs->cx;
+			gs->sy = gs->cy;
+		} else
+			s->segments = 1;
+		break;
+
+	  case OP_RMOVETO:
+	  case OP_RLINETO:
+		startpath( s, 2, off);
+		if (numbers( s, 2, v) == 2 && gs->mknown && gs->cpknown)
+			addpoint( s, gs->cx + gs->m[0]*v[0] + gs->m[2]*v[1],
+			             gs->cy + gs->m[1]*v[0] + gs->m[3]*v[1]);
+		else
+			s->iloc = gs->cpknown = 0;
+		if (b->op == OP_RMOVETO)
+		{	gs->sx = gs->cx;
+			gs->sy = gs->cy;
+		} else
+			s->segments = 1;
+		break;
+
+	  case OP_CURVETO:
+	  case OP_RCURVETO:
+	  case OP_V:
+	  case OP_Y:
+		n = (b->op == OP_V || b->op == OP_Y) ? 4 : 6;
+		startpath( s, n, off);
+		s->segments = 1;
+		if (numbers( s, n, v) != n || !gs->mknown ||
+		    (b->op == OP_RCURVETO && !gs->cpknown))
+		{	s->iloc = gs->cpknown = 0;
+			break;
+		}
+		if (b->op == OP_RCURVETO)
+		{	x = gs->cx;
+			y = gs->cy;
+			for (i = 0; i < 6; i += 2)
+				addpoint( s, x + gs->m[0]*v[i] + gs->m[2]*v[i+1],
+				             y + gs->m[1]*v[i] + gs->m[3]*v[i+1]);
+		} else
+			/* control points bound the curve */
+			for (i = 0; i < n; i += 2)
+				adduser( s, v[i], v[i+1]);
+		gs->cpknown = 1;
+		break;
+
+	  case OP_CLOSEPATH:
+		if (s->inpath)
+		{	gs->cx = gs->sx;
+			gs->cy = gs->sy;
+		}
+		break;
+
+	  case OP_ARC:
+		startpath( s, 5, off);
+		s->segments = 1;
+		if (numbers( s, 5, v) != 5 || !gs->mknown)
+		{	s->iloc = gs->cpknown = 0;
+			break;
+		}
+		r = fabs( v[2]);
+		adduser( s, v[0] - r, v[1] - r);
+		adduser( s, v[0] + r, v[1] - r);
+		adduser( s, v[0] + r, v[1] + r);
+		adduser( s, v[0] - r, v[1] + r);
+		a = v[4] * M_PI / 180.0;
+		x = v[0] + r * cos( a);
+		y = v[1] + r * sin( a);
+		gs->cx = gs->m[0]*x + gs->m[2]*y + gs->m[4];
+		gs->cy = gs->m[1]*x + gs->m[3]*y + gs->m[5];
+		gs->cpknown = 1;
+		break;
+
+	  case OP_ARCT:
+		startpath( s, 5, off);
+		s->segments = 1;
+		if (numbers( s, 5, v) != 5 || !gs->mknown)
+			s->iloc = 0;
+		else
+		{	/* the arc stays within the corner's triangle */
+			adduser( s, v[0], v[1]);
+			adduser( s, v[2], v[3]);
+		}
+		gs->cpknown = 0;
+		break;
+
+	  case OP_RE:
+		startpath( s, 4, off);
+		s->segments = 1;
+		if (numbers( s, 4, v) != 4 || !gs->mknown)
+		{	s->iloc = gs->cpknown = 0;
+			break;
+		}
+		adduser( s, v[0] + v[2], v[1]);
+		adduser( s, v[0] + v[2], v[1] + v[3]);
+		adduser( s, v[0], v[1] + v[3]);
+		adduser( s, v[0], v[1]);
+		gs->sx = gs->cx;
+		gs->sy = gs->cy;
+		break;
+
+	  case OP_CHARPATH:
+	  case OP_SHOW:
+		/* a rough text box at the current point */
+		n = b->arity;
+		w = 20.0;
+		for (i = 1; i <= n && i <= s->sp; i++)
+			if (s->st[s->sp - i].kind == K_STRING)
+				w = s->st[s->sp - i].len;
+		if (b->op == OP_CHARPATH)
+		{	startpath( s, n, off);
+			s->segments = 1;
+		}
+		numbers( s, n, v);
+		if (!gs->mknown || !gs->cpknown)
+		{	if (s->inpath) s->iloc = 0;
+			s->g->unlocated = 1;
+			if (inside) taint( s);
+			break;
+		}
+		x = w * gs->fontsize;
+		y = gs->fontsize;
+		bb[0] = bb[2] = gs->cx;
+		bb[1] = bb[3] = gs->cy;
+		for (i = 0; i < 4; i++)
+		{	double ux = (i & 1) ? x : 0.0, uy = (i & 2) ? y : -0.25*y;
+			double px = gs->cx + gs->m[0]*ux + gs->m[2]*uy;
+			double py = gs->cy + gs->m[1]*ux + gs->m[3]*uy;
+			if (px < bb[0]) bb[0] = px;
+			if (py < bb[1]) bb[1] = py;
+			if (px > bb[2]) bb[2] = px;
+			if (py > bb[3]) bb[3] = py;
+		}
+		if (b->op == OP_CHARPATH)
+		{	addpoint( s, bb[0], bb[1]);
+			addpoint( s, bb[2], bb[3]);
+		} else
+		{	addmark( s, bb);
+			/* later text depends on where this one ended */
+			gs->cpknown = 0;
+			if (inside)
+			{	if (s->segments)
+					taint( s);
+				else
+					/* just a moveto for this text */
+					endpath( s, end, 0);
+			}
+		}
+		break;
+
+	  case OP_STROKE:
+	  case OP_FILLSTROKE:
+		if (gs->lwknown && gs->mknown)
+		{	w = gs->lw * sqrt( fabs( gs->m[0]*gs->m[3] - gs->m[1]*gs->m[2]));
+			w *= (gs->miter > 2.0) ? gs->miter / 2.0 : 1.0;
+			if (w > s->iexp) s->iexp = w;
+		} else
+			s->iloc = 0;
+		/* fall through */
+	  case OP_FILL:
+		if (!s->inpath)
+			break;
+		s->ipaint = 1;
+		gs->cpknown = 0;
+		if (!s->igs)
+			endpath( s, end, 1);
+		break;
+
+	  case OP_RECTFILL:
+	  case OP_RECTSTROKE:
+		if (numbers( s, 4, v) != 4 || !gs->mknown)
+		{	s->g->unlocated = 1;
+			if (inside) taint( s);
+			s->sp = 0;
+			break;
+		}
+		/* a statement of its own, unless part of a path statement */
+		o = &s->st[s->sp];
+		if (!s->inpath)
+		{	startpath( s, 0, o->off);
+			s->idepth = s->sp;
+			adduser( s, v[0], v[1]);
+			adduser( s, v[0] + v[2], v[1] + v[3]);
+			adduser( s, v[0] + v[2], v[1]);
+			adduser( s, v[0], v[1] + v[3]);
+			s->ipaint = 1;
+			if (b->op == OP_RECTSTROKE && gs->lwknown)
+				s->iexp = gs->lw;
+			else if (b->op == OP_RECTSTROKE)
+				s->iloc = 0;
+			endpath( s, end, 1);
+			gs->cpknown = 0;
+		} else
+		{	adduser( s, v[0], v[1]);
+			adduser( s, v[0] + v[2], v[1] + v[3]);
+			adduser( s, v[0] + v[2], v[1]);
+			adduser( s, v[0], v[1] + v[3]);
+		}
+		break;
+
+	  case OP_IMAGE:
+		s->sp = 0;
+		if (inside) taint( s);
+		if (!gs->mknown)
+		{	s->g->unlocated = 1;
+			break;
+		}
+		/* the unit square of user space */
+		bb[0] = bb[2] = gs->m[4];
+		bb[1] = bb[3] = gs->m[5];
+		for (i = 1; i < 4; i++)
+		{	x = gs->m[4] + ((i & 1) ? gs->m[0] : 0) + ((i & 2) ? gs->m[2] : 0);
+			y = gs->m[5] + ((i & 1) ? gs->m[1] : 0) + ((i & 2) ? gs->m[3] : 0);
+			if (x < bb[0]) bb[0] = x;
+			if (y < bb[1]) bb[1] = y;
+			if (x > bb[2]) bb[2] = x;
+			if (y > bb[3]) bb[3] = y;
+		}
+		addmark( s, bb);
+		break;
+
+	  case OP_SHFILL:
+		s->sp = 0;
+		s->g->unlocated = 1;
+		if (inside) taint( s);
+		break;
+
+	  case OP_NEWPATH:
+		if (s->inpath && !s->igs)
+			endpath( s, end, 1);
+		gs->cpknown = 0;
+		break;
+
+	  case OP_CLIP:
+		if (s->inpath)
+			taint( s);
+		break;
+
+	  case OP_SAVE:
+		push( s, K_UNKNOWN, off);
+		/* fall through */
+	  case OP_GSAVE:
+		if (s->gsp == MAXGS-1)
+		{	fail( s, "gsave nested too deep");
+			break;
+		}
+		s->gs[s->gsp+1] = *gs;
+		s->gsp++;
+		if (s->inpath)
+			s->igs++;
+		break;
+
+	  case OP_RESTORE:
+		numbers( s, 1, v);
+		/* fall through */
+	  case OP_GRESTORE:
+		if (s->gsp > 0)
+			s->gsp--;
+		if (s->inpath)
+		{	if (s->igs)
+				s->igs--;
+			else
+			{	/* the path of before its gsave comes back */
+				taint( s);
+				endpath( s, end, 0);
+			}
+		}
+		break;
+
+	  case OP_TRANSLATE:
+		if (inside) taint( s);
+		if (s->sp && s->st[s->sp-1].kind != K_NUMBER)
+		{	s->sp = 0;	/* the matrix variant */
+			break;
+		}
+		if (numbers( s, 2, v) != 2)
+		{	gs->mknown = 0;
+			break;
+		}
+		m[0] = m[3] = 1.0;
+		m[1] = m[2] = 0.0;
+		m[4] = v[0];
+		m[5] = v[1];
+		concat( gs, m);
+		break;
+
+	  case OP_SCALE:
+		if (inside) taint( s);
+		if (s->sp && s->st[s->sp-1].kind != K_NUMBER)
+		{	s->sp = 0;
+			break;
+		}
+		if (numbers( s, 2, v) != 2)
+		{	gs->mknown = 0;
+			break;
+		}
+		m[0] = v[0];
+		m[3] = v[1];
+		m[1] = m[2] = m[4] = m[5] = 0.0;
+		concat( gs, m);
+		break;
+
+	  case OP_ROTATE:
+		if (inside) taint( s);
+		if (s->sp && s->st[s->sp-1].kind != K_NUMBER)
+		{	s->sp = 0;
+			break;
+		}
+		if (numbers( s, 1, v) != 1)
+		{	gs->mknown = 0;
+			break;
+		}
+		a = v[0] * M_PI / 180.0;
+		m[0] = m[3] = cos( a);
+		m[1] = sin( a);
+		m[2] = -m[1];
+		m[4] = m[5] = 0.0;
+		concat( gs, m);
+		break;
+
+	  case OP_CONCAT:
+		if (inside) taint( s);
+		if (s->sp && s->st[s->sp-1].kind == K_ARRAY && s->st[s->sp-1].n == 6)
+		{	concat( gs, s->st[s->sp-1].v);
+			s->sp--;
+		} else
+		{	gs->mknown = 0;
+			s->sp = 0;
+		}
+		break;
+
+	  case OP_CM:
+		if (inside) taint( s);
+		if (numbers( s, 6, v) == 6)
+			concat( gs, v);
+		else
+			gs->mknown = 0;
+		break;
+
+	  case OP_SETMATRIX:
+		if (inside) taint( s);
+		gs->mknown = 0;
+		s->sp = 0;
+		break;
+
+	  case OP_LINEWIDTH:
+		if (inside) taint( s);
+		if ((gs->lwknown = (numbers( s, 1, v) == 1)))
+			gs->lw = fabs( v[0]);
+		break;
+
+	  case OP_MITER:
+		if (inside) taint( s);
+		gs->miter = (numbers( s, 1, v) == 1) ? v[0] : 10.0;
+		break;
+
+	  case OP_FONTSIZE:
+		if (inside) taint( s);
+		gs->fontsize = (numbers( s, 2, v) >= 1) ? fabs( v[1]) : DefaultFontSize;
+		if (b->name[0] != 'T')	/* scalefont leaves the font */
+			push( s, K_UNKNOWN, off);
+		break;
+
+	  case OP_STYLE:
+		if (inside) taint( s);
+		numbers( s, b->arity, v);
+		break;
+
+	  case OP_DEF:
+		if (s->inpath) taint( s);
+		if (s->sp < 2 || s->st[s->sp-2].kind != K_NAME)
+		{	s->sp = 0;
+			break;
+		}
+		o = &s->st[s->sp-1];
+		df = finddef( s, s->st[s->sp-2].name, s->st[s->sp-2].len, 1);
+		if (!df)
+			break;
+		df->kind = K_UNKNOWN;
+		df->flags = 0;
+		df->op = NULL;
+		if (o->kind == K_NUMBER)
+		{	df->kind = K_NUMBER;
+			df->v = o->v[0];
+		} else if (o->kind == K_PROC || o->kind == K_LOADED)
+		{	df->kind = K_PROC;
+			df->flags = o->flags;
+			df->op = o->op;
+		}
+		s->sp -= 2;
+		break;
+
+	  case OP_BIND:
+		break;
+
+	  case OP_LOAD:
+		if (!s->sp || s->st[s->sp-1].kind != K_NAME)
+		{	s->sp = 0;
+			push( s, K_UNKNOWN, off);
+			break;
+		}
+		o = &s->st[s->sp-1];
+		if ((df = finddef( s, o->name, o->len, 0)) != NULL)
+		{	o->kind = df->kind == K_PROC ? K_LOADED : K_UNKNOWN;
+			o->flags = df->flags;
+			o->op = df->op;
+		} else if ((o->op = findbuiltin( o->name, o->len)) != NULL)
+		{	o->kind = K_LOADED;
+			o->flags = opflags( o->op);
+		} else
+			o->kind = K_UNKNOWN;
+		break;
+
+	  case OP_POP:
+		if (s->sp) s->sp--;
+		break;
+
+	  case OP_EXCH:
+		if (s->sp >= 2)
+		{	struct operand h = s->st[s->sp-1];
+			size_t hoff = s->st[s->sp-2].off;
+			s->st[s->sp-1] = s->st[s->sp-2];
+			s->st[s->sp-2] = h;
+			s->st[s->sp-2].off = hoff;
+		} else
+			s->sp = 0;
+		break;
+
+	  case OP_DUP:
+		if (s->sp)
+		{	o = push( s, K_UNKNOWN, off);
+			*o = s->st[s->sp-2];
+			o->off = off;
+		}
+		break;
+
+	  case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+		if (s->sp < 2)
+		{	s->sp = 0;
+			push( s, K_UNKNOWN, off);
+			break;
+		}
+		o = &s->st[s->sp-2];
+		if (o->kind == K_NUMBER && s->st[s->sp-1].kind == K_NUMBER)
+		{	x = s->st[s->sp-1].v[0];
+			switch (b->op)
+			{ case OP_ADD: o->v[0] += x; break;
+			  case OP_SUB: o->v[0] -= x; break;
+			  case OP_MUL: o->v[0] *= x; break;
+			  default: if (x == 0.0) o->kind = K_UNKNOWN; else o->v[0] /= x; break;
+			}
+		} else
+			o->kind = K_UNKNOWN;
+		s->sp--;
+		break;
+
+	  case OP_NEG:
+		if (s->sp && s->st[s->sp-1].kind == K_NUMBER)
+			s->st[s->sp-1].v[0] = -s->st[s->sp-1].v[0];
+		else if (s->sp)
+			s->st[s->sp-1].kind = K_UNKNOWN;
+		break;
+
+	  case OP_CURRENTFILE:
+		fail( s, "it reads inline data");
+		break;
+
+	  case OP_RUN:
+		for (flags = 0, i = 1; i <= 3 && i <= s->sp; i++)
+			if (s->st[s->sp-i].kind == K_PROC)
+				flags |= s->st[s->sp-i].flags;
+		runflags( s, flags);
+		s->sp = 0;
+		break;
+	}
+}
+
+/*********************************************/
+/* operand stack                             */
+/*********************************************/
+static struct operand *push( struct scan *s, int kind, size_t off)
+{
+	struct operand *o;
+
+	if (s->sp == MAXSTACK)
+	{	/* too much to follow, start over */
+		if (s->inpath) taint( s);
+		s->sp = 0;
+	}
+	o = &s->st[s->sp++];
+	o->kind = kind;
+	o->off = off;
+	o->n = 0;
+	o->flags = 0;
+	o->op = NULL;
+	o->len = 0;
+	return o;
+}
+
+/* pop n operands into v, returns how many were numbers */
+static int numbers( struct scan *s, int n, double *v)
+{
+	int i, got;
+
+	if (s->sp < n)
+	{	s->sp = 0;
+		if (s->inpath && !s->igs) taint( s);
+		return 0;
+	}
+	for (got = i = 0; i < n; i++)
+	{	v[i] = s->st[s->sp - n + i].v[0];
+		if (s->st[s->sp - n + i].kind == K_NUMBER)
+			got++;
+	}
+	s->sp -= n;
+	return got;
+}
+
+/*********************************************/
+/* path statements                           */
+/*********************************************/
+static void startpath( struct scan *s, int arity, size_t off)
+{
+	if (s->inpath)
+		return;
+	s->inpath = 1;
+	s->segments = 0;
+	s->igs = 0;
+	s->itaint = 0;
+	s->iloc = 1;
+	s->ipaint = 0;
+	s->ibbset = 0;
+	s->iexp = 0.0;
+	if (s->sp >= arity)
+	{	s->istart = arity ? s->st[s->sp - arity].off : off;
+		s->idepth = s->sp - arity;
+	} else
+	{	s->istart = off;
+		s->idepth = 0;
+		s->itaint = 1;
+	}
+}
+
+/* a point in input space */
+static void addpoint( struct scan *s, double x, double y)
+{
+	struct gstate *gs = &s->gs[s->gsp];
+
+	gs->cx = x;
+	gs->cy = y;
+	gs->cpknown = 1;
+	if (!s->ibbset)
+	{	s->ibb[0] = s->ibb[2] = x;
+		s->ibb[1] = s->ibb[3] = y;
+		s->ibbset = 1;
+		return;
+	}
+	if (x < s->ibb[0]) s->ibb[0] = x;
+	if (y < s->ibb[1]) s->ibb[1] = y;
+	if (x > s->ibb[2]) s->ibb[2] = x;
+	if (y > s->ibb[3]) s->ibb[3] = y;
+}
+
+/* a point in user space */
+static void adduser( struct scan *s, double x, double y)
+{
+	struct gstate *gs = &s->gs[s->gsp];
+
+	addpoint( s, gs->m[0]*x + gs->m[2]*y + gs->m[4],
+	             gs->m[1]*x + gs->m[3]*y + gs->m[5]);
+}
+
+/* something painted, at a known place */
+static void addmark( struct scan *s, double bb[4])
+{
+	struct tilegeom *g = s->g;
+	double (*mark)[4];
+	int i, room;
+
+	if (g->nmark == s->markroom)
+	{	room = s->markroom ? 2 * s->markroom : 256;
+		if (!(mark = realloc( g->mark, room * sizeof( *mark))))
+		{	fail( s, "out of memory");
+			return;
+		}
+		g->mark = mark;
+		s->markroom = room;
+	}
+	memcpy( g->mark[g->nmark++], bb, sizeof( g->mark[0]));
+
+	if (!g->gotbb)
+	{	for (i = 0; i < 4; i++) g->bb[i] = bb[i];
+		g->gotbb = 1;
+		return;
+	}
+	if (bb[0] < g->bb[0]) g->bb[0] = bb[0];
+	if (bb[1] < g->bb[1]) g->bb[1] = bb[1];
+	if (bb[2] > g->bb[2]) g->bb[2] = bb[2];
+	if (bb[3] > g->bb[3]) g->bb[3] = bb[3];
+}
+
+static void taint( struct scan *s)
+{
+	s->itaint = 1;
+}
+
+static void endpath( struct scan *s, size_t end, int cullable)
+{
+	struct tilegeom *g = s->g;
+	struct geomitem *it;
+	struct tilesegment *r = NULL;
+	double bb[4];
+	int room;
+
+	s->inpath = 0;
+	g->npath++;
+
+	if (s->ibbset)
+	{	bb[0] = s->ibb[0] - s->iexp;
+		bb[1] = s->ibb[1] - s->iexp;
+		bb[2] = s->ibb[2] + s->iexp;
+		bb[3] = s->ibb[3] + s->iexp;
+	}
+	if (s->ipaint || s->itaint)
+	{	if (s->iloc && s->ibbset)
+			addmark( s, bb);
+		else if (!s->iloc)
+			g->unlocated = 1;
+	}
+
+	if (!cullable || s->itaint || !s->iloc || s->sp != s->idepth)
+		return;
+
+	/* it may not use operands from before an earlier statement */
+	if (s->istart < s->lastend)
+		return;
+
+	if (g->nitem == s->itemroom)
+	{	room = s->itemroom ? 2 * s->itemroom : 256;
+		if (!(it = realloc( g->item, room * sizeof( *it))) ||
+		    !(r = realloc( s->range, room * sizeof( *r))))
+		{	if (it) g->item = it;
+			fail( s, "out of memory");
+			return;
+		}
+		g->item = it;
+		s->range = r;
+		s->itemroom = room;
+	}
+	it = &g->item[g->nitem];
+	if (s->ibbset)
+		memcpy( it->bb, bb, sizeof( bb));
+	else
+	{	/* nothing drawn: not needed on any tile */
+		it->bb[0] = it->bb[1] = 1.0;
+		it->bb[2] = it->bb[3] = -1.0;
+	}
+	it->piece = -1;
+	it->npiece = 0;
+
+	/* take the white space behind it along */
+	while (end < s->in->size && isspc( s->d[end]))
+		end++;
+	s->range[g->nitem].off = s->istart;
+	s->range[g->nitem].len = end - s->istart;
+	s->lastend = end;
+	g->nitem++;
+}
+
+static void fail( struct scan *s, char *why)
+{
+	s->g->ok = 0;
+	s->g->why = why;
+}
+
+/* CTM = m x CTM */
+static void concat( struct gstate *gs, double m[6])
+{
+	double *c = gs->m, r[6];
+
+	r[0] = m[0]*c[0] + m[1]*c[2];
+	r[1] = m[0]*c[1] + m[1]*c[3];
+	r[2] = m[2]*c[0] + m[3]*c[2];
+	r[3] = m[2]*c[1] + m[3]*c[3];
+	r[4] = m[4]*c[0] + m[5]*c[2] + c[4];
+	r[5] = m[4]*c[1] + m[5]*c[3] + c[5];
+	memcpy( c, r, sizeof( r));
+}
+
+/*********************************************/
+/* name lookup                               */
+/*********************************************/
+static struct builtin *findbuiltin( char *name, int len)
+{
+	int lo, hi, mid, c;
+
+	for (lo = 0, hi = NBUILTIN - 1; lo <= hi; )
+	{	mid = (lo + hi) / 2;
+		c = strncmp( builtins[mid].name, name, len);
+		if (c == 0 && builtins[mid].name[len] != '\0')
+			c = 1;
+		if (c == 0)
+			return &builtins[mid];
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return NULL;
+}
+
+static unsigned hashname( char *name, int len)
+{
+	unsigned h = 5381;
+
+	while (len--)
+		h = h * 33 + (unsigned char)*name++;
+	return h;
+}
+
+/* open addressing over s->def, which is kept at most half full */
+static struct definition *finddef( struct scan *s, char *name, int len, int add)
+{
+	struct definition *df, *old;
+	unsigned h;
+	int i, oldroom;
+
+	if (add && 2 * (s->ndef + 1) > s->defroom)
+	{	old = s->def;
+		oldroom = s->defroom;
+		s->defroom = oldroom ? 2 * oldroom : 256;
+		if (!(s->def = calloc( s->defroom, sizeof( *df))))
+		{	s->def = old;
+			s->defroom = oldroom;
+			fail( s, "out of memory");
+			return NULL;
+		}
+		for (i = 0; i < oldroom; i++)
+			if (old[i].name)
+			{	h = hashname( old[i].name, old[i].len) & (s->defroom - 1);
+				while (s->def[h].name)
+					h = (h + 1) & (s->defroom - 1);
+				s->def[h] = old[i];
+			}
+		free( old);
+	}
+	if (!s->defroom)
+		return NULL;
+
+	h = hashname( name, len) & (s->defroom - 1);
+	for (;;)
+	{	df = &s->def[h];
+		if (!df->name)
+			break;
+		if (df->len == len && !memcmp( df->name, name, len))
+			return df;
+		h = (h + 1) & (s->defroom - 1);
+	}
+	if (!add)
+		return NULL;
+	df->name = name;
+	df->len = len;
+	s->ndef++;
+	return df;
+}
+
+/* whether a name is one of the quiet operators */
+static int isquiet( char *name, int len)
+{
+	int lo, hi, mid, c;
+
+	for (lo = 0, hi = NQUIET - 1; lo <= hi; )
+	{	mid = (lo + hi) / 2;
+		c = strncmp( quiet[mid], name, len);
+		if (c == 0 && quiet[mid][len] != '\0')
+			c = 1;
+		if (c == 0)
+			return 1;
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return 0;
+}
+
+/* what running a name does; the input's own */
+/* definitions shadow the builtins */
+static int flagsof( struct scan *s, char *name, int len)
+{
+	struct builtin *b;
+	struct definition *df;
+
+	if ((df = finddef( s, name, len, 0)) != NULL)
+		return df->op ? opflags( df->op) : df->flags;
+	if ((b = findbuiltin( name, len)) != NULL)
+		return opflags( b);
+	return 0;
+}
+
+/* what running a builtin does */
+static int opflags( struct builtin *b)
+{
+	switch (b->op)
+	{ case OP_MOVETO: case OP_RMOVETO: case OP_LINETO: case OP_RLINETO:
+	  case OP_CURVETO: case OP_RCURVETO: case OP_V: case OP_Y:
+	  case OP_CLOSEPATH: case OP_ARC: case OP_ARCT: case OP_RE:
+	  case OP_CHARPATH:
+		return F_PATH;
+	  case OP_STROKE: case OP_FILL: case OP_FILLSTROKE: case OP_RECTFILL:
+	  case OP_RECTSTROKE: case OP_SHOW: case OP_IMAGE: case OP_SHFILL:
+		return F_PAINT;
+	  case OP_TRANSLATE: case OP_SCALE: case OP_ROTATE: case OP_CONCAT:
+	  case OP_CM: case OP_SETMATRIX:
+		return F_CTM;
+	  case OP_CURRENTFILE:
+		return F_CURFILE;
+	}
+	return 0;
+}
+
+/*********************************************/
+/* split the body segments into the ranges   */
+/* of each item, and what is left: the parts */
+/* that go on every tile                     */
+/*********************************************/
+static int makepieces( struct tilegeom *g, struct tileinput *in,
+	struct tilesegment *range)
+{
+	struct geomitem *it;
+	size_t a, b, pos, is, ie, rend;
+	int k, j, proom, oroom;
+
+	proom = oroom = 0;
+	for (j = k = 0; k < in->nseg; k++)
+	{	a = in->seg[k].off;
+		b = a + in->seg[k].len;
+		for (pos = a; pos < b; )
+		{	while (j < g->nitem && range[j].off + range[j].len <= pos)
+				j++;
+			if (j == g->nitem || range[j].off >= b)
+			{	if (addrange( &g->other, &g->nother, &oroom, pos, b, 1))
+					return -1;
+				break;
+			}
+			rend = range[j].off + range[j].len;
+			is = (range[j].off > pos) ? range[j].off : pos;
+			ie = (rend < b) ? rend : b;
+			if (is > pos &&
+			    addrange( &g->other, &g->nother, &oroom, pos, is, 1))
+				return -1;
+			it = &g->item[j];
+			if (it->piece < 0)
+				it->piece = g->npiece;
+			if (addrange( &g->piece, &g->npiece, &proom, is, ie, 0))
+				return -1;
+			it->npiece++;
+			pos = ie;
+		}
+	}
+	return 0;
+}
+
+/* merge: extend the last range when this one follows on it */
+static int addrange( struct tilesegment **seg, int *n, int *room, size_t off, size_t end,
+	int merge)
+{
+	struct tilesegment *s;
+
+	if (end <= off)
+		return 0;
+	if (merge && *n && (*seg)[*n-1].off + (*seg)[*n-1].len == off)
+	{	(*seg)[*n-1].len += end - off;
+		return 0;
+	}
+	if (*n == *room)
+	{	*room = *room ? 2 * *room : 64;
+		if (!(s = realloc( *seg, *room * sizeof( *s))))
+			return -1;
+		*seg = s;
+	}
+	(*seg)[*n].off = off;
+	(*seg)[*n].len = end - off;
+	(*n)++;
+	return 0;
+}
+
+/* the grid cells within margin of bb, maybe none */
+static void cellrange( double bb[4], double ox, double oy, double cw, double ch,
+	double margin, int ncols, int nrows, int *c0, int *c1, int *r0, int *r1)
+{
+	*c0 = ceil( (bb[0] - margin - ox) / cw - 1.0);
+	*c1 = floor( (bb[2] + margin - ox) / cw);
+	*r0 = ceil( (bb[1] - margin - oy) / ch - 1.0);
+	*r1 = floor( (bb[3] + margin - oy) / ch);
+	if (*c0 < 0) *c0 = 0;
+	if (*r0 < 0) *r0 = 0;
+	if (*c1 >= ncols) *c1 = ncols - 1;
+	if (*r1 >= nrows) *r1 = nrows - 1;
+}
+
+/*********************************************/
+/* spatial index: a grid of ncols by nrows   */
+/* cells of cw by ch, starting at ox,oy, all */
+/* in input coordinates. Each cell lists the */
+/* items within margin of it.                */
+/*********************************************/
+int GeomIndex( struct tilegeom *g, double ox, double oy, double cw, double ch,
+	double margin, int ncols, int nrows)
+{
+	struct geomitem *it;
+	int *room, *l, i, n, r, c, r0, r1, c0, c1, cell;
+
+	for (i = 0; g->cell && i < g->ncols * g->nrows; i++)
+		free( g->cell[i]);
+	free( g->cell);
+	free( g->ncell);
+	free( g->used);
+
+	n = ncols * nrows;
+	g->ncols = ncols;
+	g->nrows = nrows;
+	g->cell = calloc( n, sizeof( *g->cell));
+	g->ncell = calloc( n, sizeof( *g->ncell));
+	g->used = calloc( n, sizeof( *g->used));
+	room = calloc( n, sizeof( *room));
+	if (!g->cell || !g->ncell || !g->used || !room)
+	{	free( room);
+		return -1;
+	}
+
+	/* the tiles that show anything */
+	markcells( g, ox, oy, cw, ch, margin, ncols, nrows, g->used);
+
+	for (i = 0; i < g->nitem; i++)
+	{	it = &g->item[i];
+		if (it->bb[2] < it->bb[0] || !it->npiece)
+			continue;
+		cellrange( it->bb, ox, oy, cw, ch, margin, ncols, nrows, &c0, &c1, &r0, &r1);
+		for (r = r0; r <= r1; r++)
+			for (c = c0; c <= c1; c++)
+			{	cell = r * ncols + c;
+				if (g->ncell[cell] == room[cell])
+				{	room[cell] = room[cell] ? 2 * room[cell] : 16;
+					if (!(l = realloc( g->cell[cell], room[cell] * sizeof( *l))))
+					{	free( room);
+						return -1;
+					}
+					g->cell[cell] = l;
+				}
+				g->cell[cell][g->ncell[cell]++] = i;
+			}
+	}
+	free( room);
+	return 0;
+}
+
+/*********************************************/
+/* the number of cells of a grid as for      */
+/* GeomIndex() that show any mark, without   */
+/* indexing the items; used is scratch room  */
+/* for ncols*nrows flags                     */
+/*********************************************/
+int GeomCount( struct tilegeom *g, double ox, double oy, double cw, double ch,
+	double margin, int ncols, int nrows, char *used)
+{
+	int i, n;
+
+	memset( used, 0, ncols * nrows);
+	markcells( g, ox, oy, cw, ch, margin, ncols, nrows, used);
+	for (n = i = 0; i < ncols * nrows; i++)
+		n += used[i];
+	return n;
+}
+
+/* flag the cells that show any mark */
+static void markcells( struct tilegeom *g, double ox, double oy, double cw, double ch,
+	double margin, int ncols, int nrows, char *used)
+{
+	int i, r, c, r0, r1, c0, c1;
+
+	for (i = 0; i < g->nmark; i++)
+	{	cellrange( g->mark[i], ox, oy, cw, ch, margin, ncols, nrows, &c0, &c1, &r0, &r1);
+		for (r = r0; r <= r1; r++)
+			for (c = c0; c <= c1; c++)
+				used[r * ncols + c] = 1;
+	}
+}
+
+/*********************************************/
+/* whether a tile shows nothing at all       */
+/*********************************************/
+int GeomBlank( struct tilegeom *g, int row, int col)
+{
+	if (!g->ok || g->unlocated || !g->used)
+		return 0;
+	return !g->used[(row-1) * g->ncols + col-1];
+}
+
+/*********************************************/
+/* the body ranges for one tile: everything  */
+/* but the items it does not show            */
+/*********************************************/
+int GeomTile( struct tilegeom *g, int row, int col,
+	struct tilesegment **seg, int *nseg, int *room)
+{
+	struct geomitem *it;
+	int i, k, p, n, *l;
+
+	*nseg = 0;
+	l = g->cell[(row-1) * g->ncols + col-1];
+	n = g->ncell[(row-1) * g->ncols + col-1];
+
+	for (i = k = 0; i < g->nother || k < n; )
+	{	it = (k < n) ? &g->item[l[k]] : NULL;
+		if (it && (i == g->nother ||
+		           g->piece[it->piece].off < g->other[i].off))
+		{	for (p = it->piece; p < it->piece + it->npiece; p++)
+				if (addrange( seg, nseg, room, g->piece[p].off,
+				              g->piece[p].off + g->piece[p].len, 1))
+					return -1;
+			k++;
+		} else
+		{	if (addrange( seg, nseg, room, g->other[i].off,
+			              g->other[i].off + g->other[i].len, 1))
+				return -1;
+			i++;
+		}
+	}
+	return 0;
+}
+
+void GeomFree( struct tilegeom *g)
+{
+	int i;
+
+	for (i = 0; g->cell && i < g->ncols * g->nrows; i++)
+		free( g->cell[i]);
+	free( g->cell);
+	free( g->ncell);
+	free( g->used);
+	free( g->mark);
+	free( g->item);
+	free( g->piece);
+	free( g->other);
+	memset( g, 0, sizeof( *g));
+}
@@ -0,0 +1,48 @@
+/*
+#  tilegeom - geometry pass for the tile.c freesewing program
+#
+#  Finds the paths in the input, with their extent, so tiles
+#  can leave out the paths they do not show.
+*/
+
+/* a path that can be left out of a page as a whole */
+struct geomitem
+{	double bb[4];		/* extent, in input coordinates */
+	int piece;		/* its byte ranges: geom.piece[piece..] */
+	int npiece;
+};
+
+struct tilegeom
+{	int ok;			/* the input could be analysed */
+	char *why;		/* and if not, why not */
+	int npath;		/* paths seen, cullable or not */
+
+	struct geomitem *item;	/* cullable paths, in input order */
+	int nitem;
+	struct tilesegment *piece;	/* byte ranges of the items */
+	int npiece;
+	struct tilesegment *other;	/* body ranges outside the items */
+	int nother;
+
+	double bb[4];		/* extent of all marks that could be located */
+	int gotbb;
+	int unlocated;		/* some marks could not be located */
+	double (*mark)[4];	/* extent of each mark that could */
+	int nmark;
+
+	/* spatial index: the items to keep, per tile */
+	int ncols, nrows;
+	int **cell;
+	int *ncell;
+	char *used;		/* the tile shows any mark */
+};
+
+int GeomScan( struct tilegeom *g, struct tileinput *in);
+int GeomIndex( struct tilegeom *g, double ox, double oy, double cw, double ch,
+	double margin, int ncols, int nrows);
+int GeomCount( struct tilegeom *g, double ox, double oy, double cw, double ch,
+	double margin, int ncols, int nrows, char *used);
+int GeomTile( struct tilegeom *g, int row, int col,
+	struct tilesegment **seg, int *nseg, int *room);
+int GeomBlank( struct tilegeom *g, int row, int col);
+void GeomFree( struct tilegeom *g);
@@ -0,0 +1,1429 @@
+/*
+#  tileinput - input handling for the tile.c freesewing program
+#
+#  The input is taken in once: regular files are memory mapped,
+#  anything else (standard input, pipes) is spooled: into memory
+#  upto SPOOLMAX bytes, beyond that into an unlinked temporary file
+#  which is then mapped as well. The byte ranges that make up
+#  the page body (all but the comment lines and a trailing ^D) are
+#  located once as well, so every page just replays that list.
+#  Where the system allows, those ranges go from the input file to
+#  the output without passing through user space.
+#  Input compressed with gzip (or zstd, when built with HAVE_ZSTD)
+#  is recognised by its first bytes, and decompressed as it is read,
+#  so it is decompressed once; the result is kept like the spool,
+#  in memory upto SPOOLMAX bytes and in a temporary file beyond.
+#
+# --------------------------------------------------------------
+#  Tile is a fork of 'poster' by Jos T.J. van Eijndhoven
+#  <J.T.J.v.Eijndhoven@ele.tue.nl>
+#
+#  Forked by Joost De Cock for freesewing.org
+#
+#  Copyright (C) 1999 Jos T.J. van Eijndhoven
+#  Copyright (C) 2021 Joost De Cock
+# --------------------------------------------------------------
+*/
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+#if defined(__SSE2__) && !defined(NOSIMD)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__) && !defined(NOSIMD)
+#include <immintrin.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "tileinput.h"
+
+#define READCHUNK 65536
+#ifndef SPOOLMAX
+#define SPOOLMAX (64*1024*1024)
+#endif
+
+/* ways to move input ranges to the output fd, best first */
+#define COPY_ASK	0	/* not known yet, fstat() the output */
+#define COPY_WRITE	1	/* plain write() from the input buffer */
+#define COPY_RANGE	2	/* copy_file_range(), file to file */
+#define COPY_SPLICE	3	/* splice(), file to pipe */
+#define COPY_SENDFILE	4	/* sendfile(), file to socket or other */
+
+/* printer VM in bytes, as InputVM() counts it */
+#define VM_OBJECT	8	/* an element of an array or procedure */
+#define VM_ENTRY	20	/* an entry of a dict */
+#define VM_NEST		32	/* { [ << levels it keeps apart */
+
+/* the operand stack, as InputBalanced() follows it */
+#define ST_MAX		64	/* operands it keeps apart */
+#define ST_DEFS		256	/* names the code defines */
+#define ST_UNKNOWN	(-100000)	/* an effect it cannot tell */
+
+#define OPD_OTHER	0
+#define OPD_PROC	1	/* a procedure, effect is what running it does */
+#define OPD_MARK	2	/* of mark, [ and << */
+#define OPD_NAME	3	/* a literal name */
+#define OPD_WHERE	4	/* what where leaves */
+
+struct operand
+{	int kind, effect;
+	const char *name;
+	size_t len;
+};
+
+struct opstack
+{	struct operand st[ ST_MAX];
+	int n;			/* below 0 in a procedure that pops what it found */
+	int inproc;
+	int lost;		/* it can no longer tell */
+};
+
+/* a name the code defines, and then runs */
+struct stackdef
+{	char name[32];
+	int kind, effect;
+};
+
+struct stackscan
+{	const char *d;
+	size_t pos, end;
+	struct stackdef def[ ST_DEFS];
+	int ndef;
+};
+
+/* operators that take and leave a fixed number of operands */
+static struct
+{	char *name;
+	int pops, pushes;
+} stackops[] =
+{	{ "pop", 1, 0 },	{ "begin", 1, 0 },	{ "end", 0, 0 },
+	{ "load", 1, 1 },	{ "dict", 1, 1 },	{ "currentdict", 0, 1 },
+	{ "userdict", 0, 1 },	{ "globaldict", 0, 1 },	{ "systemdict", 0, 1 },
+	{ "statusdict", 0, 1 },	{ "errordict", 0, 1 },	{ "known", 2, 1 },
+	{ "get", 2, 1 },	{ "put", 3, 0 },	{ "undef", 2, 0 },
+	{ "findfont", 1, 1 },	{ "scalefont", 2, 1 },	{ "makefont", 2, 1 },
+	{ "definefont", 2, 1 },	{ "undefinefont", 1, 0 },	{ "setfont", 1, 0 },
+	{ "findresource", 2, 1 },	{ "defineresource", 3, 1 },
+	{ "undefineresource", 2, 0 },	{ "cvn", 1, 1 },	{ "cvs", 2, 1 },
+	{ "cvi", 1, 1 },	{ "cvr", 1, 1 },	{ "cvlit", 1, 1 },
+	{ "array", 1, 1 },	{ "string", 1, 1 },	{ "length", 1, 1 },
+	{ "matrix", 0, 1 },	{ "setpacking", 1, 0 },	{ "currentpacking", 0, 1 },
+	{ "setglobal", 1, 0 },	{ "currentglobal", 0, 1 },	{ "true", 0, 1 },
+	{ "false", 0, 1 },	{ "null", 0, 1 },	{ "counttomark", 0, 1 },
+	{ "not", 1, 1 },	{ "and", 2, 1 },	{ "or", 2, 1 },
+	{ "xor", 2, 1 },	{ "eq", 2, 1 },		{ "ne", 2, 1 },
+	{ "lt", 2, 1 },		{ "gt", 2, 1 },		{ "le", 2, 1 },
+	{ "ge", 2, 1 },		{ "add", 2, 1 },	{ "sub", 2, 1 },
+	{ "mul", 2, 1 },	{ "div", 2, 1 },	{ "idiv", 2, 1 },
+	{ "mod", 2, 1 },	{ "neg", 1, 1 },	{ "abs", 1, 1 },
+	{ "type", 1, 1 },	{ "xcheck", 1, 1 },	{ "rcheck", 1, 1 },
+	{ "wcheck", 1, 1 },	{ "languagelevel", 0, 1 },	{ "product", 0, 1 },
+	{ "version", 0, 1 },	{ "currentfile", 0, 1 },	{ "readstring", 2, 2 },
+	{ "readhexstring", 2, 2 },	{ "readline", 2, 2 },
+	{ NULL, 0, 0 }
+};
+
+/* compressed input formats */
+#define PACK_NONE	0
+#define PACK_GZIP	1
+#define PACK_ZSTD	2
+
+static int readall( struct tileinput *in, int fd);
+static int packed( char *data, size_t size);
+static int unpack( struct tileinput *in, int how, char *src, size_t nsrc, int fd);
+static int grow( struct tileinput *in, size_t *room);
+static int spill( struct tileinput *in, int fd);
+static int spoolfile( void);
+static int mapspool( struct tileinput *in, int sfd);
+static int writeall( int fd, char *buf, size_t n);
+static int findsegments( struct tileinput *in);
+static size_t nextcomment( const char *d, size_t pos, size_t size);
+static int addsegment( struct tileinput *in, size_t off, size_t len, int *room);
+static int copyrange( struct tileinput *in, size_t off, size_t len, int fd, int *how);
+static size_t vmrange( const char *d, size_t pos, size_t end);
+static int stackrun( struct stackscan *s, int inproc);
+static void stackop( struct stackscan *s, struct opstack *os,
+	const char *name, size_t len);
+static void stackapply( struct opstack *os, int effect);
+static void stackpush( struct opstack *os, int kind, int effect,
+	const char *name, size_t len);
+static struct operand stackpop( struct opstack *os);
+static void stacktomark( struct opstack *os);
+
+/*********************************************/
+/* take in the complete input file,          */
+/* a name of "-" stands for standard input;  */
+/* compressed input is refused with EFBIG    */
+/* past limit bytes, unless limit is 0       */
+/* returns 0 on success, -1 with errno set   */
+/*********************************************/
+int InputOpen( struct tileinput *in, char *name, size_t limit)
+{
+	struct stat st;
+	char *src;
+	size_t nsrc;
+	int fd, how, rc;
+
+	memset( in, 0, sizeof( *in));
+	in->name = name;
+	in->fd = -1;
+	in->limit = limit;
+
+	if (!strcmp( name, "-"))
+		fd = dup( 0);
+	else
+		fd = open( name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat( fd, &st) == 0 && S_ISREG( st.st_mode) && st.st_size > 0)
+	{	in->data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (in->data != MAP_FAILED)
+		{	in->size = st.st_size;
+			in->mapped = 1;
+			madvise( in->data, in->size, MADV_SEQUENTIAL);
+		} else
+			in->data = NULL;
+	}
+
+	/* compressed: decompress it from the mapping */
+	if (in->mapped && (how = packed( in->data, in->size)))
+	{	src = in->data;
+		nsrc = in->size;
+		in->data = NULL;
+		in->size = 0;
+		in->mapped = 0;
+		rc = unpack( in, how, src, nsrc, -1);
+		munmap( src, nsrc);
+		if (rc)
+		{	close( fd);
+			InputClose( in);
+			return -1;
+		}
+	}
+
+	/* not mappable: read it into memory */
+	if (!in->mapped && !in->data && readall( in, fd))
+	{	close( fd);
+		InputClose( in);
+		return -1;
+	}
+	/* keep a mapped file open for InputWrite() */
+	if (in->mapped && in->fd < 0)
+		in->fd = fd;
+	else
+		close( fd);
+
+	if (findsegments( in))
+	{	InputClose( in);
+		return -1;
+	}
+	return 0;
+}
+
+/*********************************************/
+/* use input the caller has in memory, which */
+/* must stay there until InputClose(); limit */
+/* is that of InputOpen()                    */
+/* returns 0 on success, -1 with errno set   */
+/*********************************************/
+int InputMemory( struct tileinput *in, char *data, size_t size, char *name,
+	size_t limit)
+{
+	int how;
+
+	memset( in, 0, sizeof( *in));
+	in->name = name;
+	in->fd = -1;
+	in->limit = limit;
+	in->data = data;
+	in->size = size;
+	in->borrowed = 1;
+
+	/* compressed: decompress it into memory of our own */
+	if ((how = packed( data, size)))
+	{	in->data = NULL;
+		in->size = 0;
+		in->borrowed = 0;
+		if (unpack( in, how, data, size, -1))
+		{	InputClose( in);
+			return -1;
+		}
+	}
+
+	if (findsegments( in))
+	{	InputClose( in);
+		return -1;
+	}
+	return 0;
+}
+
+static int readall( struct tileinput *in, int fd)
+{
+	size_t room = 0, nsrc;
+	ssize_t n;
+	char *p, *src;
+	int checked = 0, how, rc;
+
+	for (;;)
+	{	if (in->size == room)
+		{	if (room >= SPOOLMAX)
+				return spill( in, fd);
+			room = room ? 2*room : READCHUNK;
+			if (!(p = realloc( in->data, room)))
+				return -1;
+			in->data = p;
+		}
+		n = read( fd, in->data + in->size, room - in->size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		in->size += n;
+
+		/* compressed: decompress the rest as it comes in */
+		if (!checked && (in->size >= 4 || n == 0))
+		{	checked = 1;
+			if ((how = packed( in->data, in->size)))
+			{	src = in->data;
+				nsrc = in->size;
+				in->data = NULL;
+				in->size = 0;
+				rc = unpack( in, how, src, nsrc, fd);
+				free( src);
+				return rc;
+			}
+		}
+		if (n == 0)
+			return 0;
+	}
+}
+
+/* the compression of data, by its first bytes */
+static int packed( char *data, size_t size)
+{
+	unsigned char *d = (unsigned char *)data;
+
+	if (size >= 2 && d[0] == 0x1f && d[1] == 0x8b)
+		return PACK_GZIP;
+#ifdef HAVE_ZSTD
+	if (size >= 4 && d[0] == 0x28 && d[1] == 0xb5 && d[2] == 0x2f && d[3] == 0xfd)
+		return PACK_ZSTD;
+#endif
+	return PACK_NONE;
+}
+
+/*********************************************/
+/* decompress src[0..nsrc], and what follows */
+/* it on fd unless that is -1, into in->data */
+/* or past SPOOLMAX into a temporary file    */
+/* returns 0 on success, -1 with errno set   */
+/*********************************************/
+static int unpack( struct tileinput *in, int how, char *src, size_t nsrc, int fd)
+{
+	char *buf = NULL;
+	size_t room = 0, spilled = 0;
+	ssize_t n;
+	int done = 0, end = 0, rc = 0, sfd = -1;
+	z_stream z;
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *zs = NULL;
+	ZSTD_inBuffer zin;
+	ZSTD_outBuffer zout;
+	size_t zr = 1;
+#endif
+
+	memset( &z, 0, sizeof( z));
+	if (how == PACK_GZIP)
+	{	if (inflateInit2( &z, 15 + 16) != Z_OK)
+			return -1;
+		z.next_in = (unsigned char *)src;
+		z.avail_in = nsrc;
+	}
+#ifdef HAVE_ZSTD
+	if (how == PACK_ZSTD)
+	{	if (!(zs = ZSTD_createDStream()))
+			return -1;
+		ZSTD_initDStream( zs);
+		zin.src = src;
+		zin.size = nsrc;
+		zin.pos = 0;
+	}
+#endif
+
+	while (!done && !rc)
+	{	if (in->limit && spilled + in->size > in->limit)
+		{	errno = EFBIG;
+			rc = -1;
+			break;
+		}
+		/* the memory is full: write it out, and use it again */
+		if (in->size == room && room >= SPOOLMAX)
+		{	if ((sfd < 0 && (sfd = spoolfile()) < 0) ||
+			    writeall( sfd, in->data, in->size))
+			{	rc = -1;
+				break;
+			}
+			spilled += in->size;
+			in->size = 0;
+		}
+		if (grow( in, &room))
+		{	rc = -1;
+			break;
+		}
+
+		if (how == PACK_GZIP)
+		{	z.next_out = (unsigned char *)in->data + in->size;
+			z.avail_out = room - in->size;
+			switch (inflate( &z, Z_NO_FLUSH))
+			{ case Z_STREAM_END:
+				/* a next member may follow */
+				if (z.avail_in)
+					inflateReset( &z);
+				else
+					end = 1;
+				break;
+			  case Z_OK:
+			  case Z_BUF_ERROR:
+				break;
+			  default:
+				errno = EINVAL;
+				rc = -1;
+			}
+			in->size = room - z.avail_out;
+			if (rc || z.avail_in || (z.avail_out == 0 && !end))
+				continue;
+		}
+#ifdef HAVE_ZSTD
+		if (how == PACK_ZSTD)
+		{	zout.dst = in->data;
+			zout.size = room;
+			zout.pos = in->size;
+			zr = ZSTD_decompressStream( zs, &zout, &zin);
+			in->size = zout.pos;
+			if (ZSTD_isError( zr))
+			{	errno = EINVAL;
+				rc = -1;
+			}
+			if (rc || zin.pos < zin.size || zout.pos == zout.size)
+				continue;
+		}
+#endif
+
+		/* all input used: get more, if there is any */
+		n = 0;
+		if (fd >= 0)
+		{	if (!buf && !(buf = malloc( READCHUNK)))
+			{	rc = -1;
+				break;
+			}
+			while ((n = read( fd, buf, READCHUNK)) < 0 && errno == EINTR);
+			if (n < 0)
+			{	rc = -1;
+				break;
+			}
+		}
+		if (n == 0)
+		{	/* a stream cut short is an error */
+			if (how == PACK_GZIP && !end)
+			{	errno = EINVAL;
+				rc = -1;
+			}
+#ifdef HAVE_ZSTD
+			if (how == PACK_ZSTD && zr != 0)
+			{	errno = EINVAL;
+				rc = -1;
+			}
+#endif
+			done = 1;
+		} else if (how == PACK_GZIP)
+		{	if (end)	/* a next member */
+			{	inflateReset( &z);
+				end = 0;
+			}
+			z.next_in = (unsigned char *)buf;
+			z.avail_in = n;
+		}
+#ifdef HAVE_ZSTD
+		else if (how == PACK_ZSTD)
+		{	zin.src = buf;
+			zin.size = n;
+			zin.pos = 0;
+		}
+#endif
+	}
+
+	if (!rc && in->limit && spilled + in->size > in->limit)
+	{	errno = EFBIG;
+		rc = -1;
+	}
+	if (sfd >= 0)
+	{	if (rc || writeall( sfd, in->data, in->size))
+		{	close( sfd);
+			rc = -1;
+		} else
+			rc = mapspool( in, sfd);
+	}
+
+	if (how == PACK_GZIP)
+		inflateEnd( &z);
+#ifdef HAVE_ZSTD
+	if (how == PACK_ZSTD)
+		ZSTD_freeDStream( zs);
+#endif
+	free( buf);
+	return rc;
+}
+
+/* room for more decompressed data */
+static int grow( struct tileinput *in, size_t *room)
+{
+	char *p;
+	size_t r;
+
+	if (in->size < *room)
+		return 0;
+	r = *room ? 2 * *room : 4 * READCHUNK;
+	if (!(p = realloc( in->data, r)))
+		return -1;
+	in->data = p;
+	*room = r;
+	return 0;
+}
+
+/*********************************************/
+/* too big to keep in memory: move what was  */
+/* read so far into a temporary file, append */
+/* the rest of the input and map that file   */
+/*********************************************/
+static int spill( struct tileinput *in, int fd)
+{
+	char *buf;
+	ssize_t n;
+	int sfd;
+
+	if ((sfd = spoolfile()) < 0)
+		return -1;
+
+	buf = in->data;
+	if (writeall( sfd, buf, in->size))
+		goto fail;
+
+	/* reuse the first chunk of the memory spool as copy buffer */
+	for (;;)
+	{	n = read( fd, buf, READCHUNK);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		if (writeall( sfd, buf, n))
+			goto fail;
+	}
+	if (n < 0)
+		goto fail;
+	return mapspool( in, sfd);
+
+fail:
+	close( sfd);
+	return -1;
+}
+
+/* an unlinked temporary file in TMPDIR, or -1 */
+static int spoolfile( void)
+{
+	char path[1024], *dir;
+	int sfd;
+
+	if (!(dir = getenv( "TMPDIR")) || !*dir)
+		dir = "/tmp";
+	snprintf( path, sizeof( path), "%s/tileXXXXXX", dir);
+	if ((sfd = mkstemp( path)) < 0)
+		return -1;
+	unlink( path);
+	return sfd;
+}
+
+/* the input is all in the file sfd: map it, */
+/* in place of what is in memory             */
+static int mapspool( struct tileinput *in, int sfd)
+{
+	struct stat st;
+
+	if (fstat( sfd, &st))
+	{	close( sfd);
+		return -1;
+	}
+	free( in->data);
+	in->data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, sfd, 0);
+	if (in->data == MAP_FAILED)
+	{	close( sfd);
+		in->data = NULL;
+		in->size = 0;
+		return -1;
+	}
+	in->size = st.st_size;
+	in->mapped = 1;
+	in->fd = sfd;
+	return 0;
+}
+
+static int writeall( int fd, char *buf, size_t n)
+{
+	ssize_t w;
+
+	while (n > 0)
+	{	if ((w = write( fd, buf, n)) < 0)
+		{	if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += w;
+		n -= w;
+	}
+	return 0;
+}
+
+/*********************************************/
+/* offset just past the line starting at pos */
+/*********************************************/
+size_t InputLineEnd( struct tileinput *in, size_t pos)
+{
+	char *nl;
+
+	nl = memchr( in->data + pos, '\n', in->size - pos);
+	return nl ? (size_t)(nl - in->data) + 1 : in->size;
+}
+
+/*********************************************/
+/* offset of the start of the line that pos  */
+/* is in, or that ends just before pos       */
+/*********************************************/
+size_t InputLineStart( struct tileinput *in, size_t pos)
+{
+#ifdef __linux__
+	char *nl;
+
+	if (pos < 2)
+		return 0;
+	nl = memrchr( in->data, '\n', pos - 1);
+	return nl ? (nl - in->data) + 1 : 0;
+#else
+	if (pos > 0)
+		pos--;
+	while (pos > 0 && in->data[pos-1] != '\n')
+		pos--;
+	return pos;
+#endif
+}
+
+/*********************************************/
+/* locate the lines to copy on every page:   */
+/* all but comment lines, and the last line  */
+/* only upto a ^D                            */
+/* Comment lines are few, so this looks for  */
+/* them, and takes everything in between as  */
+/* one range, without going line by line     */
+/*********************************************/
+static int findsegments( struct tileinput *in)
+{
+	size_t pos, end, last;
+	char *c;
+	int room = 0;
+
+	/* do not print postscript comment lines: those (DSC) lines */
+	/* sometimes disturb proper previewing of the result with ghostview */
+	for (pos = 0; pos < in->size; pos = end)
+	{	end = nextcomment( in->data, pos, in->size);
+		if (end > pos && addsegment( in, pos, end - pos, &room))
+			return -1;
+		if (end < in->size)
+			end = InputLineEnd( in, end);
+	}
+
+	/* the last line, only upto a ^D */
+	last = InputLineStart( in, in->size);
+	if (last < in->size &&
+	    (c = memchr( in->data + last, '\04', in->size - last)) != NULL)
+	{	in->tail_cntl_D = 1;
+		if (in->data[last] != '%')
+		{	/* in the last range, which runs to the end */
+			in->seg[in->nseg-1].len -= in->size - (c - in->data);
+			if (in->seg[in->nseg-1].len == 0)
+				in->nseg--;
+		}
+	}
+	return 0;
+}
+
+/*********************************************/
+/* the start of the first comment line at or */
+/* after pos, a line start; size if none     */
+/* 16 or 32 bytes at a time, where the CPU   */
+/* has the instructions for that             */
+/*********************************************/
+static size_t nextcomment( const char *d, size_t pos, size_t size)
+{
+	const char *nl;
+	size_t i;
+
+	if (pos < size && d[pos] == '%')
+		return pos;
+
+	/* a % after a newline */
+	i = pos;
+#if defined(__AVX2__) && !defined(NOSIMD)
+	{	__m256i n = _mm256_set1_epi8( '\n'), p = _mm256_set1_epi8( '%');
+		unsigned m;
+
+		for (; i + 33 <= size; i += 32)
+		{	m = _mm256_movemask_epi8( _mm256_and_si256(
+				_mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)(d + i)), n),
+				_mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)(d + i + 1)), p)));
+			if (m)
+				return i + __builtin_ctz( m) + 1;
+		}
+	}
+#endif
+#if defined(__SSE2__) && !defined(NOSIMD)
+	{	__m128i n = _mm_set1_epi8( '\n'), p = _mm_set1_epi8( '%');
+		unsigned m;
+
+		for (; i + 17 <= size; i += 16)
+		{	m = _mm_movemask_epi8( _mm_and_si128(
+				_mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)(d + i)), n),
+				_mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)(d + i + 1)), p)));
+			if (m)
+				return i + __builtin_ctz( m) + 1;
+		}
+	}
+#endif
+	/* the rest, or all without those */
+	while (i + 1 < size && (nl = memchr( d + i, '\n', size - i - 1)) != NULL)
+	{	i = nl - d + 1;
+		if (d[i] == '%')
+			return i;
+	}
+	return size;
+}
+
+static int addsegment( struct tileinput *in, size_t off, size_t len, int *room)
+{
+	struct tilesegment *s;
+
+	if (in->nseg == *room)
+	{	*room = *room ? 2 * *room : 64;
+		if (!(s = realloc( in->seg, *room * sizeof( *s))))
+			return -1;
+		in->seg = s;
+	}
+	in->seg[in->nseg].off = off;
+	in->seg[in->nseg].len = len;
+	in->nseg++;
+	return 0;
+}
+
+/*********************************************/
+/* all of another input, as it is now: its   */
+/* body and what InputHoist() took out of    */
+/* it; the data stays with from, until       */
+/* InputClose() of that one                  */
+/* returns 0 on success, -1 with errno set   */
+/*********************************************/
+int InputShare( struct tileinput *in, struct tileinput *from)
+{
+	memset( in, 0, sizeof( *in));
+	in->name = from->name;
+	/* its own fd, for InputWrite() without a copy; the */
+	/* ranges go by their offset, so one file position is fine */
+	in->fd = from->fd >= 0 ? dup( from->fd) : -1;
+	in->data = from->data;
+	in->size = from->size;
+	in->borrowed = 1;
+	in->tail_cntl_D = from->tail_cntl_D;
+
+	in->seg = malloc( (from->nseg + 1) * sizeof( *in->seg));
+	in->res = malloc( (from->nres + 1) * sizeof( *in->res));
+	if (!in->seg || !in->res)
+	{	free( in->seg);
+		free( in->res);
+		in->seg = in->res = NULL;
+		if (in->fd >= 0)
+			close( in->fd);
+		in->fd = -1;
+		return -1;
+	}
+	memcpy( in->seg, from->seg, from->nseg * sizeof( *in->seg));
+	memcpy( in->res, from->res, from->nres * sizeof( *in->res));
+	in->nseg = from->nseg;
+	in->nres = from->nres;
+	return 0;
+}
+
+/*********************************************/
+/* a part of another input: the ranges of    */
+/* view, in order and apart, and of the page */
+/* body of from what is inside them; the     */
+/* data stays with from, until InputClose()  */
+/* of that one                               */
+/* returns 0 on success, -1 with errno set   */
+/*********************************************/
+int InputView( struct tileinput *in, struct tileinput *from,
+	struct tilesegment *view, int nview)
+{
+	struct tilesegment *seg, *v;
+	size_t a, b, vend;
+	int i, k;
+
+	memset( in, 0, sizeof( *in));
+	in->name = from->name;
+	in->fd = -1;
+	in->data = from->data;
+	in->size = from->size;
+	in->borrowed = 1;
+	in->tail_cntl_D = from->tail_cntl_D;
+
+	seg = malloc( (from->nseg + nview + 1) * sizeof( *seg));
+	v = malloc( (nview + 1) * sizeof( *v));
+	if (!seg || !v)
+	{	free( seg);
+		free( v);
+		return -1;
+	}
+	memcpy( v, view, nview * sizeof( *v));
+	in->view = v;
+	in->nview = nview;
+	in->seg = seg;
+
+	/* the body segments cut to the view */
+	for (i = k = 0; i < from->nseg && k < nview; )
+	{	a = from->seg[i].off;
+		b = a + from->seg[i].len;
+		vend = view[k].off + view[k].len;
+		if (b <= view[k].off)
+			i++;
+		else if (vend <= a)
+			k++;
+		else
+		{	seg[ in->nseg].off = a > view[k].off ? a : view[k].off;
+			seg[ in->nseg].len = (b < vend ? b : vend) - seg[ in->nseg].off;
+			in->nseg++;
+			if (b <= vend)
+				i++;
+			else
+				k++;
+		}
+	}
+	return 0;
+}
+
+/*********************************************/
+/* move what is inside the ranges, in order  */
+/* and apart, from the page body to in->res, */
+/* for what is printed once instead of on    */
+/* every page                                */
+/* returns 0 on success, -1 with errno set   */
+/*********************************************/
+int InputHoist( struct tileinput *in, struct tilesegment *range, int nrange)
+{
+	struct tilesegment *seg, *res, *r;
+	size_t a, b, pos, is, ie;
+	int i, k, nseg, nres;
+
+	/* every range splits one body segment at most */
+	seg = malloc( (in->nseg + nrange + 1) * sizeof( *seg));
+	res = malloc( (in->nseg + nrange + 1) * sizeof( *res));
+	if (!seg || !res)
+	{	free( seg);
+		free( res);
+		return -1;
+	}
+
+	nseg = nres = 0;
+	for (i = k = 0; i < in->nseg; i++)
+	{	a = in->seg[i].off;
+		b = a + in->seg[i].len;
+		for (pos = a; pos < b; pos = ie)
+		{	while (k < nrange && range[k].off + range[k].len <= pos)
+				k++;
+			r = k < nrange ? range + k : NULL;
+			if (!r || r->off >= b)
+			{	seg[ nseg].off = pos;
+				seg[ nseg++].len = b - pos;
+				break;
+			}
+			is = r->off > pos ? r->off : pos;
+			ie = r->off + r->len < b ? r->off + r->len : b;
+			if (is > pos)
+			{	seg[ nseg].off = pos;
+				seg[ nseg++].len = is - pos;
+			}
+			res[ nres].off = is;
+			res[ nres++].len = ie - is;
+		}
+	}
+
+	free( in->seg);
+	free( in->res);
+	in->seg = seg;
+	in->nseg = nseg;
+	in->res = res;
+	in->nres = nres;
+	return 0;
+}
+
+/*********************************************/
+/* a guess of the printer VM that running    */
+/* the ranges takes: the procedures, arrays, */
+/* dicts and strings they make, and the      */
+/* names they def; a guess, as it only reads */
+/* the code and does not run it              */
+/*********************************************/
+size_t InputVM( struct tileinput *in, struct tilesegment *seg, int nseg)
+{
+	size_t vm;
+	int i;
+
+	/* a token does not run from one range into the next, */
+	/* there is a comment line in between */
+	for (vm = 0, i = 0; i < nseg; i++)
+		vm += vmrange( in->data, seg[i].off, seg[i].off + seg[i].len);
+	return vm;
+}
+
+static size_t vmrange( const char *d, size_t pos, size_t end)
+{
+	char kind[ VM_NEST];	/* what each level is: { [ or < */
+	char buf[32];
+	size_t vm, open, start, n;
+	double num;
+	int depth, depth0, isnum;
+
+	vm = open = 0;
+	depth = 0;
+	num = 0;
+	while (pos < end)
+	{	if (d[pos] == ' ' || d[pos] == '\t' || d[pos] == '\r' ||
+		    d[pos] == '\n' || d[pos] == '\f' || d[pos] == '\0')
+		{	pos++;
+			continue;
+		}
+		start = pos;
+		depth0 = depth;
+		isnum = 0;
+		n = 0;
+		switch (d[pos])
+		{ case '%':
+			while (pos < end && d[pos] != '\n' && d[pos] != '\r')
+				pos++;
+			continue;
+
+		  case '(':
+			for (depth0 = 0, pos++; pos < end; pos++)
+			{	if (d[pos] == '\\') pos++;
+				else if (d[pos] == '(') depth0++;
+				else if (d[pos] == ')' && depth0-- == 0) break;
+			}
+			if (pos++ >= end)
+				return vm;	/* not closed: not a string */
+			n = pos - start - 2;
+			depth0 = depth;
+			break;
+
+		  case '<':
+			if (pos+1 < end && d[pos+1] == '<')
+			{	pos += 2;
+				if (depth < VM_NEST)
+					kind[ depth] = '<';
+				depth++;
+				break;
+			}
+			if (pos+1 < end && d[pos+1] == '~')
+			{	for (pos += 2; pos+1 < end && !(d[pos] == '~' && d[pos+1] == '>'); pos++)
+					;
+				n = (pos - start - 2) * 4 / 5;
+				pos += 2;
+			} else
+			{	for (pos++; pos < end && d[pos] != '>'; pos++)
+					;
+				n = (pos - start - 1) / 2;
+				pos++;
+			}
+			if (pos > end)
+				return vm;
+			break;
+
+		  case '{':
+		  case '[':
+			if (depth < VM_NEST)
+				kind[ depth] = d[pos];
+			depth++;
+			pos++;
+			break;
+
+		  case '}':
+		  case ']':
+		  case '>':
+			pos += d[pos] == '>' ? 2 : 1;
+			if (depth > 0)
+				depth--;
+			break;
+
+		  default:
+			/* a name or number, upto a delimiter */
+			for (pos++; pos < end && !strchr( " \t\r\n\f()<>[]{}/%", d[pos]); pos++)
+				;
+			if (d[start] == '/')
+				break;
+			isnum = (d[start] >= '0' && d[start] <= '9') || d[start] == '.' ||
+				((d[start] == '-' || d[start] == '+') && pos - start > 1);
+			num = 0;
+			if (isnum && !depth && pos - start < sizeof( buf))
+			{	memcpy( buf, d + start, pos - start);
+				buf[ pos - start] = '\0';
+				num = strtod( buf, NULL);
+			}
+			if (isnum || depth)
+				break;
+			/* what the operators make, at the top level */
+			if (pos - start == 6 && !strncmp( d + start, "string", 6))
+				n = num;
+			else if (pos - start == 5 && !strncmp( d + start, "array", 5))
+				n = num * VM_OBJECT;
+			else if (pos - start == 4 && !strncmp( d + start, "dict", 4))
+				n = num * VM_ENTRY;
+			else if (pos - start == 3 && !strncmp( d + start, "def", 3))
+				n = VM_ENTRY;
+			vm += n;
+			num = 0;
+			continue;
+		}
+
+		/* in a procedure, array or dict, everything is an element of it */
+		if (depth0 > 0)
+			open += n + (depth0 <= VM_NEST && kind[ depth0-1] == '<' ?
+				VM_ENTRY / 2 : VM_OBJECT);
+		else
+			vm += n;
+		/* a procedure is made when it is read, the others when run */
+		if (depth == 0 && depth0 > 0)
+		{	vm += open;
+			open = 0;
+		}
+		if (!isnum)
+			num = 0;
+	}
+	return vm;
+}
+
+/*********************************************/
+/* whether running the range, as far as can  */
+/* be told from reading it, does no save or  */
+/* restore and leaves the operand stack as   */
+/* it found it: only then can it run once    */
+/* in the setup instead of on every page;    */
+/* 0 for anything it cannot follow           */
+/*********************************************/
+int InputBalanced( struct tileinput *in, size_t off, size_t len)
+{
+	struct stackscan s;
+
+	memset( &s, 0, sizeof( s));
+	s.d = in->data;
+	s.pos = off;
+	s.end = off + len;
+	return stackrun( &s, 0) == 0;
+}
+
+/* the effect on the stack of the code from s->pos: up to the */
+/* end, or in a procedure up to its '}' and past it */
+static int stackrun( struct stackscan *s, int inproc)
+{
+	struct opstack os;
+	const char *d = s->d;
+	size_t start;
+	int depth;
+
+	memset( &os, 0, sizeof( os));
+	os.inproc = inproc;
+	while (s->pos < s->end)
+	{	if (strchr( " \t\r\n\f", d[ s->pos]) || d[ s->pos] == '\0')
+		{	s->pos++;
+			continue;
+		}
+		start = s->pos;
+		switch (d[ s->pos])
+		{ case '%':
+			while (s->pos < s->end && d[ s->pos] != '\n' && d[ s->pos] != '\r')
+				s->pos++;
+			break;
+
+		  case '(':
+			for (depth = 0, s->pos++; s->pos < s->end; s->pos++)
+			{	if (d[ s->pos] == '\\') s->pos++;
+				else if (d[ s->pos] == '(') depth++;
+				else if (d[ s->pos] == ')' && depth-- == 0) break;
+			}
+			if (s->pos++ >= s->end)
+				return ST_UNKNOWN;
+			stackpush( &os, OPD_OTHER, 0, NULL, 0);
+			break;
+
+		  case '<':
+			if (s->pos+1 < s->end && d[ s->pos+1] == '<')
+			{	s->pos += 2;
+				stackpush( &os, OPD_MARK, 0, NULL, 0);
+				break;
+			}
+			if (s->pos+1 < s->end && d[ s->pos+1] == '~')
+				for (s->pos += 2; s->pos+1 < s->end &&
+				     !(d[ s->pos] == '~' && d[ s->pos+1] == '>'); s->pos++)
+					;
+			else
+				for (s->pos++; s->pos < s->end && d[ s->pos] != '>'; s->pos++)
+					;
+			if (++s->pos > s->end)
+				return ST_UNKNOWN;
+			stackpush( &os, OPD_OTHER, 0, NULL, 0);
+			break;
+
+		  case '[':
+			s->pos++;
+			stackpush( &os, OPD_MARK, 0, NULL, 0);
+			break;
+
+		  case ']':
+		  case '>':
+			s->pos += d[ s->pos] == '>' ? 2 : 1;
+			stacktomark( &os);
+			stackpush( &os, OPD_OTHER, 0, NULL, 0);
+			break;
+
+		  case '{':
+			s->pos++;
+			stackpush( &os, OPD_PROC, stackrun( s, 1), NULL, 0);
+			break;
+
+		  case '}':
+			s->pos++;
+			if (inproc)
+				return os.lost ? ST_UNKNOWN : os.n;
+			os.lost = 1;
+			break;
+
+		  default:
+			/* a name or number, upto a delimiter */
+			for (s->pos++; s->pos < s->end &&
+			     !strchr( " \t\r\n\f()<>[]{}/%", d[ s->pos]); s->pos++)
+				;
+			if (d[ start] == '/' && start+1 < s->end && d[ start+1] == '/')
+			{	/* //name, its value now */
+				for (s->pos = start + 2; s->pos < s->end &&
+				     !strchr( " \t\r\n\f()<>[]{}/%", d[ s->pos]); s->pos++)
+					;
+				stackpush( &os, OPD_OTHER, 0, NULL, 0);
+			} else if (d[ start] == '/')
+				stackpush( &os, OPD_NAME, 0, d + start + 1, s->pos - start - 1);
+			else if ((d[ start] >= '0' && d[ start] <= '9') || d[ start] == '.' ||
+			         d[ start] == '-' || d[ start] == '+')
+				stackpush( &os, OPD_OTHER, 0, NULL, 0);
+			else
+				stackop( s, &os, d + start, s->pos - start);
+			break;
+		}
+	}
+	/* a procedure that is not closed */
+	if (inproc || os.lost)
+		return ST_UNKNOWN;
+	return os.n;
+}
+
+/* run the executable name of len bytes */
+static void stackop( struct stackscan *s, struct opstack *os,
+	const char *name, size_t len)
+{
+	struct operand a, b, c;
+	struct stackdef *df;
+	int i;
+
+	if (os->lost)
+		return;
+	/* what the code defined itself goes first */
+	for (i = s->ndef; i-- > 0; )
+		if (strlen( s->def[i].name) == len && !memcmp( s->def[i].name, name, len))
+		{	if (s->def[i].kind == OPD_PROC)
+				stackapply( os, s->def[i].effect);
+			else
+				stackpush( os, OPD_OTHER, 0, NULL, 0);
+			return;
+		}
+
+#define IS( op)	(len == sizeof( op) - 1 && !memcmp( name, op, len))
+	if (IS( "def"))
+	{	a = stackpop( os);
+		b = stackpop( os);
+		/* a procedure the code runs later by its name */
+		if (!os->inproc && b.kind == OPD_NAME && b.len < sizeof( df->name) &&
+		    s->ndef < ST_DEFS)
+		{	df = s->def + s->ndef++;
+			memcpy( df->name, b.name, b.len);
+			df->name[ b.len] = '\0';
+			df->kind = a.kind == OPD_PROC ? OPD_PROC : OPD_OTHER;
+			df->effect = a.effect;
+		}
+	} else if (IS( "bind") || IS( "readonly") || IS( "executeonly") ||
+	           IS( "noaccess") || IS( "cvx"))
+		;	/* the same operand */
+	else if (IS( "exch"))
+	{	a = stackpop( os);
+		b = stackpop( os);
+		stackpush( os, a.kind, a.effect, a.name, a.len);
+		stackpush( os, b.kind, b.effect, b.name, b.len);
+	} else if (IS( "dup"))
+	{	a = stackpop( os);
+		stackpush( os, a.kind, a.effect, a.name, a.len);
+		stackpush( os, a.kind, a.effect, a.name, a.len);
+	} else if (IS( "where"))
+	{	/* a dict and true, or false: as one operand, for if */
+		stackpop( os);
+		stackpush( os, OPD_WHERE, 0, NULL, 0);
+	} else if (IS( "if"))
+	{	a = stackpop( os);
+		b = stackpop( os);
+		/* as much on the stack, whether it runs or not */
+		if (a.kind != OPD_PROC || a.effect != (b.kind == OPD_WHERE ? -1 : 0))
+			os->lost = 1;
+	} else if (IS( "ifelse"))
+	{	a = stackpop( os);
+		b = stackpop( os);
+		c = stackpop( os);
+		if (a.kind != OPD_PROC || b.kind != OPD_PROC || a.effect == ST_UNKNOWN ||
+		    b.effect == ST_UNKNOWN ||
+		    a.effect != b.effect + (c.kind == OPD_WHERE ? 1 : 0))
+			os->lost = 1;
+		else
+			stackapply( os, a.effect);
+	} else if (IS( "exec"))
+	{	a = stackpop( os);
+		stackapply( os, a.kind == OPD_PROC ? a.effect : ST_UNKNOWN);
+	} else if (IS( "repeat"))
+	{	a = stackpop( os);
+		stackpop( os);
+		if (a.kind != OPD_PROC || a.effect != 0)
+			os->lost = 1;
+	} else if (IS( "mark"))
+		stackpush( os, OPD_MARK, 0, NULL, 0);
+	else if (IS( "cleartomark"))
+		stacktomark( os);
+	else if (IS( "eexec") && !os->inproc)
+	{	/* the rest is a Type 1 font program, which leaves */
+		/* the stack as its clear text part found it */
+		s->pos = s->end;
+		os->n = 0;
+	} else
+	{	for (i = 0; stackops[i].name; i++)
+			if (strlen( stackops[i].name) == len &&
+			    !memcmp( stackops[i].name, name, len))
+				break;
+		if (!stackops[i].name)
+		{	/* save, restore, and what it does not know */
+			os->lost = 1;
+			return;
+		}
+		stackapply( os, -stackops[i].pops);
+		stackapply( os, stackops[i].pushes);
+	}
+#undef IS
+}
+
+/* operands of an effect: pushed, or popped when negative */
+static void stackapply( struct opstack *os, int effect)
+{
+	if (effect == ST_UNKNOWN)
+		os->lost = 1;
+	for (; effect < 0 && !os->lost; effect++)
+		stackpop( os);
+	for (; effect > 0 && !os->lost; effect--)
+		stackpush( os, OPD_OTHER, 0, NULL, 0);
+}
+
+static void stackpush( struct opstack *os, int kind, int effect,
+	const char *name, size_t len)
+{
+	struct operand *o;
+
+	if (os->lost)
+		return;
+	if (os->n >= ST_MAX)
+	{	os->lost = 1;
+		return;
+	}
+	/* below what a procedure found, nothing is kept */
+	if (os->n >= 0)
+	{	o = os->st + os->n;
+		o->kind = kind;
+		o->effect = effect;
+		o->name = name;
+		o->len = len;
+	}
+	os->n++;
+}
+
+static struct operand stackpop( struct opstack *os)
+{
+	struct operand o;
+
+	memset( &o, 0, sizeof( o));
+	o.kind = OPD_OTHER;
+	if (os->lost)
+		return o;
+	/* what the code did not push itself */
+	if (os->n <= 0 && !os->inproc)
+	{	os->lost = 1;
+		return o;
+	}
+	if (--os->n >= 0)
+		o = os->st[ os->n];
+	return o;
+}
+
+/* pop upto and with the mark of [ << or mark */
+static void stacktomark( struct opstack *os)
+{
+	while (!os->lost)
+	{	if (os->n <= 0)
+		{	os->lost = 1;	/* before what it can see */
+			break;
+		}
+		if (stackpop( os).kind == OPD_MARK)
+			break;
+	}
+}
+
+/*********************************************/
+/* write the page body segments to fd        */
+/* returns 0 on success, -1 with errno set   */
+/*********************************************/
+int InputWrite( struct tileinput *in, int fd)
+{
+	int how = COPY_ASK;
+
+	return InputWriteSegments( in, in->seg, in->nseg, fd, &how);
+}
+
+/* the same, for any list of input ranges; *how is the way */
+/* to copy to fd, found on the first call when 0, and kept */
+/* by the caller for the next calls to the same fd         */
+int InputWriteSegments( struct tileinput *in, struct tilesegment *seg, int nseg,
+	int fd, int *how)
+{
+	struct stat st;
+	int i, plain = COPY_WRITE;
+
+	if (*how == COPY_ASK)
+	{	*how = COPY_WRITE;
+#ifdef __linux__
+		if (fstat( fd, &st) == 0)
+		{	if (S_ISREG( st.st_mode)) *how = COPY_RANGE;
+			else if (S_ISFIFO( st.st_mode)) *how = COPY_SPLICE;
+			else *how = COPY_SENDFILE;
+		}
+#endif
+	}
+	/* an input in memory only is written */
+	if (in->fd < 0)
+		how = &plain;
+
+	for (i = 0; i < nseg; i++)
+		if (copyrange( in, seg[i].off, seg[i].len, fd, how))
+			return -1;
+	return 0;
+}
+
+static int copyrange( struct tileinput *in, size_t off, size_t len, int fd, int *how)
+{
+	ssize_t n;
+#ifdef __linux__
+	loff_t o;
+	off_t so;
+#endif
+
+	while (len > 0)
+	{	switch (*how)
+		{
+#ifdef __linux__
+		  case COPY_RANGE:
+			o = off;
+			n = copy_file_range( in->fd, &o, fd, NULL, len, 0);
+			break;
+		  case COPY_SPLICE:
+			o = off;
+			n = splice( in->fd, &o, fd, NULL, len, SPLICE_F_MORE);
+			break;
+		  case COPY_SENDFILE:
+			so = off;
+			n = sendfile( fd, in->fd, &so, len);
+			break;
+#endif
+		  default:
+			n = write( fd, in->data + off, len);
+			break;
+		}
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && *how != COPY_WRITE && (errno == EINVAL ||
+		    errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP))
+		{	/* not supported for this pair of files, */
+			/* do the rest the old fashioned way */
+			*how = COPY_WRITE;
+			continue;
+		}
+		if (n == 0)
+		{	/* the input ends before the range does */
+			errno = EIO;
+			return -1;
+		}
+		if (n < 0)
+			return -1;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+void InputClose( struct tileinput *in)
+{
+	if (in->mapped)
+		munmap( in->data, in->size);
+	else if (!in->borrowed)
+		free( in->data);
+	if (in->fd >= 0)
+		close( in->fd);
+	in->fd = -1;
+	free( in->seg);
+	free( in->res);
+	free( in->view);
+	in->data = NULL;
+	in->seg = NULL;
+	in->res = NULL;
+	in->view = NULL;
+	in->size = 0;
+	in->nseg = in->nres = in->nview = 0;
+}
@@ -0,0 +1,47 @@
+/*
+#  tileinput - input handling for the tile.c freesewing program
+#
+#  The input file is read (or memory mapped) only once,
+#  and the parts of it that go on every page are located once.
+*/
+
+#include <stddef.h>
+
+/* a byte range of the input that is copied to the output as is */
+struct tilesegment
+{	size_t off;
+	size_t len;
+};
+
+struct tileinput
+{	char *name;		/* as given on the command line */
+	char *data;		/* complete input file contents */
+	size_t size;
+	int mapped;		/* data is mmap()ed, rather than malloc()ed */
+	int borrowed;		/* data belongs to the caller */
+	int fd;			/* the mapped file, or -1 */
+	struct tilesegment *seg;	/* the page body, without comments */
+	int nseg;
+	struct tilesegment *res;	/* taken out of it by InputHoist() */
+	int nres;
+	struct tilesegment *view;	/* of InputView(): the ranges of data */
+	int nview;		/* that are this input, 0 all */
+	int tail_cntl_D;	/* input ended with a ^D */
+	size_t limit;		/* bytes it may decompress to, 0 any */
+};
+
+int InputOpen( struct tileinput *in, char *name, size_t limit);
+int InputMemory( struct tileinput *in, char *data, size_t size, char *name,
+	size_t limit);
+size_t InputLineEnd( struct tileinput *in, size_t pos);
+size_t InputLineStart( struct tileinput *in, size_t pos);
+int InputShare( struct tileinput *in, struct tileinput *from);
+int InputView( struct tileinput *in, struct tileinput *from,
+	struct tilesegment *view, int nview);
+int InputHoist( struct tileinput *in, struct tilesegment *range, int nrange);
+size_t InputVM( struct tileinput *in, struct tilesegment *seg, int nseg);
+int InputBalanced( struct tileinput *in, size_t off, size_t len);
+int InputWrite( struct tileinput *in, int fd);
+int InputWriteSegments( struct tileinput *in, struct tilesegment *seg, int nseg,
+	int fd, int *how);
+void InputClose( struct tileinput *in);
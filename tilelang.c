@@ -19,20 +19,32 @@
 
 #include "tilelang.h"
 
-char *langPrompts[ LANG_PROMPTS_MAX ] ;
-char *langTranslates[ LANG_PROMPTS_MAX ] ;
-char *langBuffer = NULL;
-char *langEmpty = "";
-char fileName[15];
-char *cPointer;
-
-void ResetLangPrompts( void )
+static char *langEmpty = "";
+
+// The prompts of LANG_COVER and on, in English
+static char *langKeys[ LANG_TEXTS ] =
+  { "cover page", "Page", "row", "column" };
+
+// The languages built into tile, for when there is no file
+#define LANG_BUILTINS 2
+
+static struct
+{
+  char *code;
+  char *text[ LANG_TEXTS ];
+} langBuiltin[ LANG_BUILTINS ] =
+{
+  { "en", { "cover page", "Page", "row", "column" } },
+  { "nl", { "voorpagina", "Pagina", "rij", "kolom" } },
+};
+
+static void ResetLangPrompts( struct tilelang *lang )
 {
   for( int i = 0 ; i < LANG_PROMPTS_MAX ; i ++ )
-    langPrompts[i] = langEmpty;
+    lang->prompts[i] = langEmpty;
 }
 
-int SkipTo( char **cPointer, char c )
+static int SkipTo( struct tilelang *lang, char **cPointer, char c )
 {
   while( *cPointer[0] && *cPointer[0] != c )
     *cPointer[0] ++;
@@ -40,19 +52,31 @@ int SkipTo( char **cPointer, char c )
   if( ! *cPointer[0] )
   {
     //Error in language file
-    fprintf( stderr, "Error in language file %s\n", fileName );
-    ResetLangPrompts();
+    ResetLangPrompts( lang );
     return( 0 );
   }
   return( 1 );
 }
 
-int LangRead( char *language )
+static int BadFile( struct tilelang *lang, char *fileName, char *error, size_t room )
+{
+  snprintf( error, room, "Error in language file %s!", fileName );
+  LangClose( lang );
+  return( LANG_BADFILE );
+}
+
+// Returns LANG_OK, LANG_NOFILE when the prompts stay English, or
+// LANG_BADFILE or LANG_NOMEM with the reason in error
+int LangRead( struct tilelang *lang, char *language, char *error, size_t room )
 {
   int fileSize, readSize;
+  char fileName[15];
+  char *cPointer;
+
+  memset( lang, 0, sizeof( *lang ) );
 
   if( strlen( language ) != 2 )
-    return(1);
+    return( LANG_NOFILE );
 
   sprintf( fileName, "tile.%s.yml", language );
 
@@ -68,72 +92,96 @@ int LangRead( char *language )
     rewind( fileHandler );
 
     // Allocate a string that can hold it all
-    langBuffer = (char*) malloc( sizeof(char) * (fileSize + 1) );
+    lang->buffer = (char*) malloc( sizeof(char) * (fileSize + 1) );
 
-    if( ! langBuffer )
+    if( ! lang->buffer )
     {
-       // No memory, set the buffer to NULL
-       fprintf( stderr, "Error allocating memory\n" );
-       langBuffer = NULL;
+       // No memory
+       snprintf( error, room, "Out of memory for language file %s!", fileName );
+       fclose( fileHandler );
+       return( LANG_NOMEM );
     }
 
     // Read it all in one operation
-    readSize = fread( langBuffer, sizeof(char), fileSize, fileHandler);
+    readSize = fread( lang->buffer, sizeof(char), fileSize, fileHandler);
+
+    // Always remember to close the file.
+    fclose( fileHandler );
 
     if( fileSize != readSize)
     {
        // Something went wrong, throw away the memory and set
        // the buffer to NULL
-       fprintf( stderr, "Error reading language file %s\n", fileName );
-       free( langBuffer );
-       langBuffer = NULL;
+       snprintf( error, room, "Error reading language file %s!", fileName );
+       LangClose( lang );
+       return( LANG_BADFILE );
     }
+    lang->buffer[ fileSize ] = '\0';
 
-    // Always remember to close the file.
-    fclose( fileHandler );
-
-    cPointer = langBuffer;
+    cPointer = lang->buffer;
 
     for( int i = 0 ; i < LANG_PROMPTS_MAX ; i ++ )
     {
-      if( ! SkipTo( &cPointer, '"') ) return(1);
-      langPrompts[i] = ++ cPointer;
+      if( ! SkipTo( lang, &cPointer, '"' ) ) return( BadFile( lang, fileName, error, room ) );
+      lang->prompts[i] = ++ cPointer;
 
-      if( ! SkipTo( &cPointer, '"') ) return(1);
+      if( ! SkipTo( lang, &cPointer, '"' ) ) return( BadFile( lang, fileName, error, room ) );
       *cPointer ++ = '\0';
 
-      if( ! SkipTo( &cPointer, ':') ) return(1);
+      if( ! SkipTo( lang, &cPointer, ':' ) ) return( BadFile( lang, fileName, error, room ) );
 
-      if( ! SkipTo( &cPointer, '"') ) return(1);
-      langTranslates[i] = ++ cPointer;
+      if( ! SkipTo( lang, &cPointer, '"' ) ) return( BadFile( lang, fileName, error, room ) );
+      lang->translates[i] = ++ cPointer;
 
-      if( ! SkipTo( &cPointer, '"') ) return(1);
+      if( ! SkipTo( lang, &cPointer, '"' ) ) return( BadFile( lang, fileName, error, room ) );
       *cPointer ++ = '\0';
     }
+
+    // Look the prompts of tile up once, not on every use
+    for( int t = 0 ; t < LANG_TEXTS ; t ++ )
+      lang->text[t] = LangPrompt( lang, langKeys[t] );
   }
   else
   {
-    return( 1 );
+    // Without a file in the current directory, a built in language
+    for( int i = 0 ; i < LANG_BUILTINS ; i ++ )
+    {
+      if( strcmp( langBuiltin[i].code, language ) == 0 )
+      {
+        memcpy( lang->text, langBuiltin[i].text, sizeof( lang->text ) );
+        return( LANG_OK );
+      }
+    }
+    return( LANG_NOFILE );
   }
-  return( 0 ) ;
+  return( LANG_OK ) ;
 }
 
-void LangClose( void )
+void LangClose( struct tilelang *lang )
 {
-  if( langBuffer )
-    free( langBuffer );
-  langBuffer = NULL;
+  if( lang->buffer )
+    free( lang->buffer );
+  lang->buffer = NULL;
+  memset( lang->text, 0, sizeof( lang->text ) );
 }
 
-char *LangPrompt( char *defPrompt )
+char *LangPrompt( struct tilelang *lang, char *defPrompt )
 {
-  if( langBuffer )
+  if( lang->buffer )
   {
-    for( int i; i < LANG_PROMPTS_MAX ; i ++ )
+    for( int i = 0; i < LANG_PROMPTS_MAX ; i ++ )
     {
-      if( strcmp( langPrompts[ i ], defPrompt ) == 0 )
-        return( langTranslates[ i ] );
+      if( strcmp( lang->prompts[ i ], defPrompt ) == 0 )
+        return( lang->translates[ i ] );
     }
   }
   return( defPrompt );
 }
+
+// A prompt of tile, LANG_COVER and on; a NULL lang has the English ones
+char *LangText( struct tilelang *lang, int prompt )
+{
+  if( lang && lang->text[ prompt ] )
+    return( lang->text[ prompt ] );
+  return( langKeys[ prompt ] );
+}
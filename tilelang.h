@@ -1,6 +1,30 @@
 
+
+
 #define LANG_PROMPTS_MAX 5
 
-char *LangPrompt( char *defPrompt );
-int LangRead( char *language );
-void LangClose( void );
+/* the prompts that tile prints, for LangText() */
+#define LANG_COVER	0	/* "cover page" */
+#define LANG_PAGE	1	/* "Page" */
+#define LANG_ROW	2	/* "row" */
+#define LANG_COLUMN	3	/* "column" */
+#define LANG_TEXTS	4
+
+/* the translations of one language: built in, or read from tile.<lang>.yml */
+struct tilelang
+{	char *buffer;
+	char *prompts[ LANG_PROMPTS_MAX ];
+	char *translates[ LANG_PROMPTS_MAX ];
+	char *text[ LANG_TEXTS ];	/* of the prompts of tile, NULL untranslated */
+};
+
+/* what LangRead() returns */
+#define LANG_OK		0	/* read, or built in */
+#define LANG_NOFILE	1	/* no file for the language, the prompts stay English */
+#define LANG_BADFILE	2	/* the file cannot be used, the reason is in error */
+#define LANG_NOMEM	3	/* out of memory, the reason is in error */
+
+char *LangPrompt( struct tilelang *lang, char *defPrompt );
+char *LangText( struct tilelang *lang, int prompt );
+int LangRead( struct tilelang *lang, char *language, char *error, size_t room );
+void LangClose( struct tilelang *lang );
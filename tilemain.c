@@ -0,0 +1,149 @@
+/*
+#  tile - resize a postscript image to print on larger media and/or multiple sheets
+#
+#  The command line front end of tile: it turns the options into
+#  a struct tileoptions, and runs a single job from the tile library
+#  on the input file, writing to standard output.
+#
+# --------------------------------------------------------------
+#  Tile is a fork of 'poster' by Jos T.J. van Eijndhoven
+#  <J.T.J.v.Eijndhoven@ele.tue.nl>
+#
+#  Forked by Joost De Cock for freesewing.org
+#
+#  Copyright (C) 1999 Jos T.J. van Eijndhoven
+#  Copyright (C) 2021 Joost De Cock
+# --------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tile.h"
+#include "tileserve.h"
+#include "tilebatch.h"
+
+extern char *optarg;        /* silently set by getopt() */
+extern int optind, opterr;  /* silently set by getopt() */
+
+static void usage();
+
+char *myname;
+
+int main( int argc, char *argv[])
+{
+	struct tileoptions opt;
+	struct tilejob *j;
+	char *infile;
+	char *filespec = NULL;
+	char *socketspec = NULL;
+	char *batchspec = NULL;
+	int c, rc;
+
+	myname = argv[0];
+	TileDefaults( &opt);
+	opt.creator = myname;
+
+	while ((c = getopt( argc, argv, "vafeFzZKCBAMj:n:S:b:P:I:X:V:i:c:l:w:m:p:s:o:t:h:u:")) != EOF)
+	{	switch( c)
+		{ case 'o': filespec = optarg; break;
+		  case 'S': socketspec = optarg; break;
+		  case 'b': batchspec = optarg; break;
+		  default:	if (TileOption( &opt, c, optarg))
+				usage();
+			break;
+		}
+	}
+
+	/* the options are the defaults of the requests or jobs */
+	if (socketspec)
+		exit (ServeRun( socketspec, &opt) ? 1 : 0);
+	if (batchspec)
+		exit (BatchRun( batchspec, &opt) ? 1 : 0);
+
+	if (optind < argc)
+		infile = argv[ optind];
+	else
+	{	fprintf( stderr, "Filename argument missing!\n");
+		usage();
+	}
+
+	if (opt.splitpages > 0 && !filespec)
+	{	fprintf( stderr, "Please give -o with -n, for the names of the files!\n");
+		usage();
+	}
+	if (opt.mediaspec && strchr( opt.mediaspec, ',') && !filespec)
+	{	fprintf( stderr, "Please give -o with several media, for the names of the files!\n");
+		usage();
+	}
+	if (opt.language && strchr( opt.language, ',') && !filespec)
+	{	fprintf( stderr, "Please give -o with several languages, for the names of the files!\n");
+		usage();
+	}
+
+	if (!(j = TileNew( &opt)))
+	{	fprintf( stderr, "%s: out of memory!\n", myname);
+		exit(1);
+	}
+	/* the job opens the output file, or the files of the parts */
+	if (filespec)
+		TileOutputFiles( j, filespec);
+	else
+		TileOutputFd( j, fileno( stdout));
+	rc = TileInputFile( j, infile);
+	if (!rc)
+		rc = TileRun( j);
+	if (rc)
+		fprintf( stderr, "%s\n", TileError( j));
+	TileFree( j);
+
+	exit (rc ? 1 : 0);
+}
+
+static void usage()
+{
+	fprintf( stderr, "Usage: %s <options> infile\n\n", myname);
+	fprintf( stderr, "options are:\n");
+	fprintf( stderr, "   -v:         be verbose\n");
+	fprintf( stderr, "   -a:         add alignment marks\n");
+	fprintf( stderr, "   -f:         ask manual feed on plotting/printing device\n");
+	fprintf( stderr, "   -e:         embed the input once, instead of copying it on every page\n");
+	fprintf( stderr, "   -F:         embed the input once as a form, for PDF conversion\n");
+	fprintf( stderr, "   -z:         compress the input in the output, in ASCII85\n");
+	fprintf( stderr, "   -Z:         compress the input in the output, in binary\n");
+	fprintf( stderr, "   -K:         keep the prolog of the input on every page\n");
+	fprintf( stderr, "   -C:         leave the paths a tile does not show out of that tile\n");
+	fprintf( stderr, "   -B:         leave out tiles that show nothing\n");
+	fprintf( stderr, "   -A:         crop the input image to what is drawn in it\n");
+	fprintf( stderr, "   -M:         print on smaller media than -m when that takes no more sheets\n");
+	fprintf( stderr, "   -j<number>: build the pages on this many threads\n");
+	fprintf( stderr, "   -n<number>: with -o, write at most this many tiles per file\n");
+	fprintf( stderr, "   -P<pages>:  print only these pages, like '1,3-7,12'\n");
+	fprintf( stderr, "   -I<pages>:  of an input with several pages, make posters of these\n");
+	fprintf( stderr, "   -X<file>:   list where each page is in the output in this file\n");
+	fprintf( stderr, "   -V<bytes>:  fail when the input takes more printer VM, like '2m'\n");
+	fprintf( stderr, "   -S<socket>: serve requests on this socket, -j of them at once\n");
+	fprintf( stderr, "   -b<file>:   run the jobs listed in this file, -j of them at once\n");
+	fprintf( stderr, "   -l<lang>:   specify language code (en, nl, fr), or several like 'en,nl'\n");
+	fprintf( stderr, "   -i<box>:    specify input image size\n");
+	fprintf( stderr, "   -c<margin>: horizontal and vertical cutmargin\n");
+	fprintf( stderr, "   -w<margin>: horizontal and vertical additional white margin\n");
+	fprintf( stderr, "   -m<box>:    media paper size, or several like 'A4,Letter'\n");
+	fprintf( stderr, "   -p<box>:    output poster size\n");
+	fprintf( stderr, "   -s<number>: linear scale factor for poster\n");
+	fprintf( stderr, "   -o<file>:   output redirection to named file, or directory/\n");
+	fprintf( stderr, "   -t<title>:  title for the cover page\n");
+	fprintf( stderr, "   -u<title>:  url/link for the cover page\n\n");
+	fprintf( stderr, "   At least one of -s -p -m is mandatory, and don't give both -s and -p\n");
+	fprintf( stderr, "   An infile of '-' reads the input from standard input\n");
+	fprintf( stderr, "   <box> is like 'A4', '3x3letter', '10x25cm', '200x200+10,10p'\n");
+	fprintf( stderr, "   <margin> is either a simple <box> or <number>%%\n\n");
+
+	fprintf( stderr, "   Defaults are: '-m%s', '-c%s', '-i<box>' read from input file.\n",
+		DefaultMedia, DefaultCutMargin);
+	fprintf( stderr, "                 and output written to stdout.\n");
+
+	exit(1);
+}
@@ -0,0 +1,566 @@
+/*
+#  tilepage - output pages for the tile.c freesewing program
+#
+#  Every page is built in memory before it is written: the text
+#  tile.c prints for it, and the list of input ranges it copies.
+#  The input ranges stay references until the page is written,
+#  so they can still go to the output without passing through
+#  user space. PageRun() builds the pages on a pool of threads,
+#  while the calling thread writes them out in page order.
+#  Output text is collected in a buffer, and goes to a file
+#  descriptor or to the caller's write callback in large chunks.
+#
+# --------------------------------------------------------------
+#  Tile is a fork of 'poster' by Jos T.J. van Eijndhoven
+#  <J.T.J.v.Eijndhoven@ele.tue.nl>
+#
+#  Forked by Joost De Cock for freesewing.org
+#
+#  Copyright (C) 1999 Jos T.J. van Eijndhoven
+#  Copyright (C) 2021 Joost De Cock
+# --------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "tileinput.h"
+#include "tilepage.h"
+
+/* the pages being built or waiting to be written, per thread */
+#define SLOTS_PER_THREAD 2
+
+/* output text collected before it is written */
+#define OUTBUF 65536
+
+struct pool
+{	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct tilepage *slot;
+	int *job;		/* page number in each slot, or -1 */
+	int *done;		/* the page in the slot is built */
+	int nslot;
+	int next;		/* next page to build */
+	int written;		/* pages written so far */
+	int npages;
+	int stop;		/* emit() failed, build no more */
+	void (*make)( void *arg, struct tilepage *p, int n);
+	void *arg;
+};
+
+static struct pagepart *addpart( struct tilepage *p, int input);
+static char *textroom( struct tilepage *p, size_t n);
+static void addtext( struct tilepage *p, size_t n);
+static size_t ascii85( unsigned char *in, size_t n, char *out);
+static void *worker( void *arg);
+static void rawwrite( struct tileoutput *o, const char *buf, size_t len);
+
+/*********************************************/
+/* add text to the page                      */
+/*********************************************/
+void PagePrintf( struct tilepage *p, const char *fmt, ...)
+{
+	va_list ap;
+	size_t room;
+	int n;
+
+	if (p->failed)
+		return;
+	for (;;)
+	{	room = p->textroom - p->ntext;
+		va_start( ap, fmt);
+		n = vsnprintf( p->text + p->ntext, room, fmt, ap);
+		va_end( ap);
+		if (n < 0)
+		{	p->failed = 1;
+			return;
+		}
+		if ((size_t)n < room)
+			break;
+		if (!textroom( p, n + 1))
+			return;
+	}
+	addtext( p, n);
+}
+
+/* make room for n more bytes of text */
+static char *textroom( struct tilepage *p, size_t n)
+{
+	size_t room;
+	char *t;
+
+	if (p->failed)
+		return NULL;
+	if (p->ntext + n > p->textroom)
+	{	room = p->textroom ? 2 * p->textroom : 4096;
+		while (room < p->ntext + n)
+			room *= 2;
+		if (!(t = realloc( p->text, room)))
+		{	p->failed = 1;
+			return NULL;
+		}
+		p->text = t;
+		p->textroom = room;
+	}
+	return p->text + p->ntext;
+}
+
+/* the n bytes put at the end of the text are part of the page */
+static void addtext( struct tilepage *p, size_t n)
+{
+	struct pagepart *pp;
+
+	/* extend the current text part, if it is the last one */
+	if (p->npart && !p->part[p->npart-1].input)
+		p->part[p->npart-1].len += n;
+	else if ((pp = addpart( p, 0)))
+	{	pp->off = p->ntext;
+		pp->len = n;
+	}
+	p->ntext += n;
+}
+
+/*********************************************/
+/* add ranges of the input to the page       */
+/*********************************************/
+void PageInput( struct tilepage *p, struct tilesegment *seg, int nseg)
+{
+	struct tilesegment *s;
+	struct pagepart *pp;
+	int room;
+
+	if (p->failed || !nseg)
+		return;
+	if (p->nseg + nseg > p->segroom)
+	{	room = p->segroom ? 2 * p->segroom : 64;
+		while (room < p->nseg + nseg)
+			room *= 2;
+		if (!(s = realloc( p->seg, room * sizeof( *s))))
+		{	p->failed = 1;
+			return;
+		}
+		p->seg = s;
+		p->segroom = room;
+	}
+	if (!(pp = addpart( p, 1)))
+		return;
+	memcpy( p->seg + p->nseg, seg, nseg * sizeof( *seg));
+	pp->off = p->nseg;
+	pp->len = nseg;
+	p->nseg += nseg;
+}
+
+/*********************************************/
+/* add ranges of the input to the page as    */
+/* text: deflated, and unless binary, in     */
+/* ASCII85 ending in ~>                      */
+/*********************************************/
+void PageDeflate( struct tilepage *p, struct tileinput *in,
+	struct tilesegment *seg, int nseg, int binary)
+{
+	z_stream z;
+	unsigned char *buf;
+	size_t total, room, n;
+	char *t;
+	int i, rc;
+
+	if (p->failed)
+		return;
+	for (total = 0, i = 0; i < nseg; i++)
+		total += seg[i].len;
+
+	memset( &z, 0, sizeof( z));
+	if (deflateInit( &z, Z_DEFAULT_COMPRESSION) != Z_OK)
+	{	p->failed = 1;
+		return;
+	}
+	room = deflateBound( &z, total);
+	if (!(buf = malloc( room)))
+	{	deflateEnd( &z);
+		p->failed = 1;
+		return;
+	}
+	z.next_out = buf;
+	z.avail_out = room;
+	for (i = 0; i < nseg; i++)
+	{	z.next_in = (unsigned char *)in->data + seg[i].off;
+		z.avail_in = seg[i].len;
+		deflate( &z, Z_NO_FLUSH);
+	}
+	rc = deflate( &z, Z_FINISH);
+	n = z.total_out;
+	deflateEnd( &z);
+	if (rc != Z_STREAM_END)
+		p->failed = 1;
+	else if (binary)
+	{	if ((t = textroom( p, n)))
+		{	memcpy( t, buf, n);
+			addtext( p, n);
+		}
+	} else if ((t = textroom( p, n / 4 * 5 + n / 32 + 16)))
+		addtext( p, ascii85( buf, n, t));
+	free( buf);
+}
+
+/* the ASCII85 encoding of in[0..n] in out, returns its length */
+/* no line starts with a %, which DSC readers could take for a comment */
+static size_t ascii85( unsigned char *in, size_t n, char *out)
+{
+	unsigned long v;
+	size_t i, k, m, col;
+	char c[5], *o;
+	int d;
+
+	o = out;
+	col = 0;
+	for (i = 0; i < n; i += 4)
+	{	m = n - i < 4 ? n - i : 4;
+		for (v = 0, k = 0; k < 4; k++)
+			v = v << 8 | (k < m ? in[i+k] : 0);
+		if (v == 0 && m == 4)
+		{	c[0] = 'z';
+			d = 1;
+		} else
+		{	for (k = 5; k-- > 0; v /= 85)
+				c[k] = '!' + v % 85;
+			d = m + 1;
+		}
+		for (k = 0; k < (size_t)d; k++)
+		{	if (col >= 64 && c[k] != '%')
+			{	*o++ = '\n';
+				col = 0;
+			}
+			*o++ = c[k];
+			col++;
+		}
+	}
+	*o++ = '~';
+	*o++ = '>';
+	*o++ = '\n';
+	return o - out;
+}
+
+static struct pagepart *addpart( struct tilepage *p, int input)
+{
+	struct pagepart *pp;
+	int room;
+
+	if (p->npart == p->partroom)
+	{	room = p->partroom ? 2 * p->partroom : 16;
+		if (!(pp = realloc( p->part, room * sizeof( *pp))))
+		{	p->failed = 1;
+			return NULL;
+		}
+		p->part = pp;
+		p->partroom = room;
+	}
+	pp = &p->part[p->npart++];
+	pp->input = input;
+	return pp;
+}
+
+/*********************************************/
+/* write the page to the output              */
+/* returns 0 on success, -1 on failure       */
+/*********************************************/
+int PageWrite( struct tilepage *p, struct tileinput *in, struct tileoutput *o)
+{
+	struct pagepart *pp;
+	int i;
+
+	if (p->failed)
+		o->failed = 1;
+	for (i = 0; i < p->npart && !o->failed; i++)
+	{	pp = &p->part[i];
+		if (pp->input)
+			OutputInput( o, in, p->seg + pp->off, pp->len);
+		else
+			OutputWrite( o, p->text + pp->off, pp->len);
+	}
+	return o->failed ? -1 : 0;
+}
+
+/* empty the page, keeping its memory for the next one */
+void PageReset( struct tilepage *p)
+{
+	p->ntext = 0;
+	p->npart = 0;
+	p->nseg = 0;
+	p->failed = 0;
+}
+
+void PageFree( struct tilepage *p)
+{
+	free( p->text);
+	free( p->part);
+	free( p->seg);
+	memset( p, 0, sizeof( *p));
+}
+
+/*********************************************/
+/* build pages 0..npages-1 with make(), on   */
+/* nthreads threads, and pass them to emit() */
+/* in order, on the calling thread, until    */
+/* emit() returns non-zero                   */
+/* returns 0 on success, -1 when emit()      */
+/* failed or there was no memory to start    */
+/*********************************************/
+int PageRun( int npages, int nthreads,
+	void (*make)( void *arg, struct tilepage *p, int n),
+	int (*emit)( void *arg, struct tilepage *p, int n), void *arg)
+{
+	struct pool pl;
+	struct tilepage one;
+	pthread_t *tid;
+	int i, n, s, nthr, rc;
+
+	if (nthreads > npages)
+		nthreads = npages;
+	if (nthreads <= 1)
+	{	memset( &one, 0, sizeof( one));
+		for (rc = n = 0; n < npages && !rc; n++)
+		{	PageReset( &one);
+			make( arg, &one, n);
+			rc = emit( arg, &one, n);
+		}
+		PageFree( &one);
+		return rc ? -1 : 0;
+	}
+
+	memset( &pl, 0, sizeof( pl));
+	pl.nslot = SLOTS_PER_THREAD * nthreads;
+	pl.npages = npages;
+	pl.make = make;
+	pl.arg = arg;
+	pl.slot = calloc( pl.nslot, sizeof( *pl.slot));
+	pl.job = malloc( pl.nslot * sizeof( *pl.job));
+	pl.done = calloc( pl.nslot, sizeof( *pl.done));
+	tid = malloc( nthreads * sizeof( *tid));
+	if (!pl.slot || !pl.job || !pl.done || !tid)
+	{	free( pl.slot);
+		free( pl.job);
+		free( pl.done);
+		free( tid);
+		return -1;
+	}
+	for (s = 0; s < pl.nslot; s++)
+		pl.job[s] = -1;
+	pthread_mutex_init( &pl.lock, NULL);
+	pthread_cond_init( &pl.cond, NULL);
+
+	for (nthr = 0; nthr < nthreads; nthr++)
+		if (pthread_create( &tid[nthr], NULL, worker, &pl))
+			break;
+
+	for (rc = n = 0; n < npages && !rc; n++)
+	{	s = n % pl.nslot;
+		pthread_mutex_lock( &pl.lock);
+		if (!nthr)
+		{	/* no threads to be had: build it ourselves */
+			pl.job[s] = n;
+			pl.next = n + 1;
+			pthread_mutex_unlock( &pl.lock);
+			PageReset( &pl.slot[s]);
+			make( arg, &pl.slot[s], n);
+			pthread_mutex_lock( &pl.lock);
+		} else
+			while (pl.job[s] != n || !pl.done[s])
+				pthread_cond_wait( &pl.cond, &pl.lock);
+		pthread_mutex_unlock( &pl.lock);
+
+		rc = emit( arg, &pl.slot[s], n);
+
+		pthread_mutex_lock( &pl.lock);
+		pl.job[s] = -1;
+		pl.done[s] = 0;
+		pl.written = n + 1;
+		if (rc)
+			pl.stop = 1;
+		pthread_cond_broadcast( &pl.cond);
+		pthread_mutex_unlock( &pl.lock);
+	}
+
+	for (i = 0; i < nthr; i++)
+		pthread_join( tid[i], NULL);
+	for (s = 0; s < pl.nslot; s++)
+		PageFree( &pl.slot[s]);
+	pthread_cond_destroy( &pl.cond);
+	pthread_mutex_destroy( &pl.lock);
+	free( pl.slot);
+	free( pl.job);
+	free( pl.done);
+	free( tid);
+	return rc ? -1 : 0;
+}
+
+/* take the next page, wait for its slot, and build it */
+static void *worker( void *arg)
+{
+	struct pool *pl = arg;
+	int n, s;
+
+	pthread_mutex_lock( &pl->lock);
+	while ((n = pl->next) < pl->npages && !pl->stop)
+	{	pl->next++;
+		s = n % pl->nslot;
+		/* its slot is free once the page before in it is written */
+		while (n >= pl->written + pl->nslot && !pl->stop)
+			pthread_cond_wait( &pl->cond, &pl->lock);
+		if (pl->stop)
+			break;
+		pl->job[s] = n;
+		pthread_mutex_unlock( &pl->lock);
+
+		PageReset( &pl->slot[s]);
+		pl->make( pl->arg, &pl->slot[s], n);
+
+		pthread_mutex_lock( &pl->lock);
+		pl->done[s] = 1;
+		pthread_cond_broadcast( &pl->cond);
+	}
+	pthread_mutex_unlock( &pl->lock);
+	return NULL;
+}
+
+/*********************************************/
+/* add text to the output                    */
+/*********************************************/
+void OutputPrintf( struct tileoutput *o, const char *fmt, ...)
+{
+	va_list ap;
+	size_t room;
+	char *b;
+	int n;
+
+	if (o->failed)
+		return;
+	for (;;)
+	{	room = o->bufroom - o->nbuf;
+		va_start( ap, fmt);
+		n = vsnprintf( o->buf + o->nbuf, room, fmt, ap);
+		va_end( ap);
+		if (n < 0)
+		{	o->failed = 1;
+			return;
+		}
+		if ((size_t)n < room)
+			break;
+		room = o->bufroom ? 2 * o->bufroom : OUTBUF;
+		while (room < o->nbuf + n + 1)
+			room *= 2;
+		if (!(b = realloc( o->buf, room)))
+		{	o->failed = 1;
+			return;
+		}
+		o->buf = b;
+		o->bufroom = room;
+	}
+	o->nbuf += n;
+	if (o->nbuf >= OUTBUF)
+		OutputFlush( o);
+}
+
+/* add bytes to the output, large ones go out directly */
+void OutputWrite( struct tileoutput *o, const char *buf, size_t len)
+{
+	char *b;
+
+	if (o->failed)
+		return;
+	if (o->nbuf + len > OUTBUF)
+	{	if (OutputFlush( o))
+			return;
+		if (len >= OUTBUF)
+		{	rawwrite( o, buf, len);
+			return;
+		}
+	}
+	if (o->nbuf + len > o->bufroom)
+	{	if (!(b = realloc( o->buf, OUTBUF)))
+		{	o->failed = 1;
+			return;
+		}
+		o->buf = b;
+		o->bufroom = OUTBUF;
+	}
+	memcpy( o->buf + o->nbuf, buf, len);
+	o->nbuf += len;
+}
+
+/*********************************************/
+/* add ranges of the input to the output,    */
+/* not through user space where possible     */
+/*********************************************/
+void OutputInput( struct tileoutput *o, struct tileinput *in,
+	struct tilesegment *seg, int nseg)
+{
+	int i;
+
+	if (OutputFlush( o))
+		return;
+	for (i = 0; i < nseg; i++)
+		o->pos += seg[i].len;
+	if (o->fd >= 0)
+	{	if (InputWriteSegments( in, seg, nseg, o->fd, &o->copy))
+			o->failed = 1;
+		return;
+	}
+	for (i = 0; i < nseg; i++)
+		if (o->write( o->arg, in->data + seg[i].off, seg[i].len))
+		{	o->failed = 1;
+			return;
+		}
+}
+
+/* bytes of output so far, the buffered ones too */
+size_t OutputTell( struct tileoutput *o)
+{
+	return o->pos + o->nbuf;
+}
+
+/*********************************************/
+/* write out the buffered text               */
+/* returns 0 on success, -1 on failure       */
+/*********************************************/
+int OutputFlush( struct tileoutput *o)
+{
+	if (o->failed)
+		return -1;
+	if (o->nbuf)
+		rawwrite( o, o->buf, o->nbuf);
+	o->nbuf = 0;
+	return o->failed ? -1 : 0;
+}
+
+static void rawwrite( struct tileoutput *o, const char *buf, size_t len)
+{
+	ssize_t w;
+
+	o->pos += len;
+	if (o->fd < 0)
+	{	if (o->write( o->arg, buf, len))
+			o->failed = 1;
+		return;
+	}
+	for (; len > 0; buf += w, len -= w)
+		if ((w = write( o->fd, buf, len)) < 0)
+		{	if (errno != EINTR)
+			{	o->failed = 1;
+				return;
+			}
+			w = 0;
+		}
+}
+
+void OutputClose( struct tileoutput *o)
+{
+	free( o->buf);
+	o->buf = NULL;
+	o->nbuf = o->bufroom = 0;
+}
@@ -0,0 +1,59 @@
+/*
+#  tilepage - output pages for the tile.c freesewing program
+#
+#  A page is built in memory first: its own text, and the ranges
+#  of the input it copies. Pages can be built by several threads
+#  at once, and are written out in page order, to a file descriptor
+#  or through a callback.
+*/
+
+/* where the output goes: a file descriptor, or a callback */
+struct tileoutput
+{	int fd;			/* -1 to use write() instead */
+	int (*write)( void *arg, const char *buf, size_t len);
+	void *arg;
+	char *buf;		/* text not written yet */
+	size_t nbuf, bufroom;
+	size_t pos;		/* bytes passed on, not counting buf */
+	int copy;		/* how input ranges go to fd, 0 not known yet */
+	int failed;		/* a write failed, or ran out of memory */
+};
+
+/* a stretch of the page: text, or ranges of the input */
+struct pagepart
+{	int input;		/* seg[off..off+len], else text[off..off+len] */
+	size_t off;
+	size_t len;
+};
+
+struct tilepage
+{	int row, col;		/* the tile on it, row 0 is the cover page */
+	int page;		/* number in the output */
+
+	char *text;
+	size_t ntext, textroom;
+	struct pagepart *part;
+	int npart, partroom;
+	struct tilesegment *seg;	/* input ranges of all input parts */
+	int nseg, segroom;
+	int failed;		/* ran out of memory building it */
+};
+
+void PagePrintf( struct tilepage *p, const char *fmt, ...);
+void PageInput( struct tilepage *p, struct tilesegment *seg, int nseg);
+void PageDeflate( struct tilepage *p, struct tileinput *in,
+	struct tilesegment *seg, int nseg, int binary);
+int PageWrite( struct tilepage *p, struct tileinput *in, struct tileoutput *o);
+void PageReset( struct tilepage *p);
+void PageFree( struct tilepage *p);
+int PageRun( int npages, int nthreads,
+	void (*make)( void *arg, struct tilepage *p, int n),
+	int (*emit)( void *arg, struct tilepage *p, int n), void *arg);
+
+void OutputPrintf( struct tileoutput *o, const char *fmt, ...);
+void OutputWrite( struct tileoutput *o, const char *buf, size_t len);
+void OutputInput( struct tileoutput *o, struct tileinput *in,
+	struct tilesegment *seg, int nseg);
+size_t OutputTell( struct tileoutput *o);
+int OutputFlush( struct tileoutput *o);
+void OutputClose( struct tileoutput *o);
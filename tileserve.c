@@ -0,0 +1,391 @@
+/*
+#  tileserve - the tile.c freesewing program as a server
+#
+#  Listens on a unix domain socket, and runs one tile job for each
+#  connection. The language files and prologs are shared by all
+#  jobs, through one struct tilecache, so only the first job of a
+#  kind reads or formats them. A fixed number of threads runs the
+#  jobs; connections wait in a queue of twice that size, and when
+#  the queue is full no more are accepted, which leaves new clients
+#  waiting in the listen backlog of the socket.
+#
+#  A request is a list of lines, like the command line options:
+#	-p3x3A4
+#	-t My pattern
+#  and ends with the input, either as a file of the server:
+#	file /path/to/pattern.ps
+#  or as the next <size> bytes on the connection, with an optional
+#  name for the comments in the output:
+#	data <size> [name]
+#  The reply is "OK" on a line, and then the poster up to the end of
+#  the connection; or "ERROR <code>" on a line with the reason below
+#  it. A poster that does not end in %%EOF was cut short by an error.
+#  A request cannot give -X, as the server would write that file;
+#  its -j and -v are ignored, and its data is at most SPOOLMAX bytes,
+#  as is compressed input, data or file, once decompressed.
+#  A line of a request is at most LINEMAX bytes, and a client that
+#  sends or reads nothing for IDLEMAX seconds loses its connection.
+#
+# --------------------------------------------------------------
+#  Tile is a fork of 'poster' by Jos T.J. van Eijndhoven
+#  <J.T.J.v.Eijndhoven@ele.tue.nl>
+#
+#  Forked by Joost De Cock for freesewing.org
+#
+#  Copyright (C) 1999 Jos T.J. van Eijndhoven
+#  Copyright (C) 2021 Joost De Cock
+# --------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "tile.h"
+#include "tileserve.h"
+
+/* connections waiting for a thread, per thread */
+#define QUEUE_PER_THREAD 2
+
+/* option lines in a request, and bytes in one of them */
+#define MAXLINES 64
+#define LINEMAX 4096
+
+/* seconds a client may leave its connection quiet, reading or */
+/* writing, before its job gives up and frees the thread */
+#ifndef IDLEMAX
+#define IDLEMAX 30
+#endif
+
+/* bytes of input a request may send, as much as tileinput.c */
+/* keeps in memory */
+#ifndef SPOOLMAX
+#define SPOOLMAX (64*1024*1024)
+#endif
+
+/* the options that name a file of the server, which a client */
+/* may not have it write */
+#define FILEFLAGS "X"
+
+struct server
+{	pthread_mutex_t lock;
+	pthread_cond_t notempty, notfull;
+	int *queue;		/* accepted connections */
+	int nqueue, head, count;
+	struct tileoptions *opt;
+	struct tilecache *cache;
+};
+
+/* one connection */
+struct request
+{	int fd;
+	FILE *in;
+	char *line[ MAXLINES];
+	int nline;
+	char *file;		/* the input, */
+	char *data;		/* or its bytes, */
+	size_t size;
+	char *name;		/* and a name for them */
+	int started;		/* the OK line is sent */
+};
+
+static void *worker( void *arg);
+static void serve( struct server *s, int fd);
+static int readrequest( struct request *r, struct tileoptions *opt,
+	char *error, size_t room);
+static int option( struct tileoptions *opt, char *line);
+static int reply( void *arg, const char *buf, size_t len);
+static int sendall( int fd, const char *buf, size_t len);
+
+/*********************************************/
+/* serve on the socket at path until killed  */
+/* returns non-zero when it cannot start     */
+/*********************************************/
+int ServeRun( char *path, struct tileoptions *opt)
+{
+	struct server s;
+	struct sockaddr_un addr;
+	struct stat st;
+	pthread_t *threads;
+	int nthreads, lfd, fd, i;
+
+	nthreads = opt->nthreads < 1 ? 1 : opt->nthreads;
+
+	if (strlen( path) >= sizeof( addr.sun_path))
+	{	fprintf( stderr, "%s: socket name '%s' is too long!\n",
+			opt->creator, path);
+		return 1;
+	}
+	memset( &addr, 0, sizeof( addr));
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, path);
+
+	/* a socket left by an earlier server, but nothing else */
+	if (!lstat( path, &st) && S_ISSOCK( st.st_mode))
+		unlink( path);
+
+	if ((lfd = socket( AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	    bind( lfd, (struct sockaddr *)&addr, sizeof( addr)) ||
+	    listen( lfd, nthreads * QUEUE_PER_THREAD))
+	{	fprintf( stderr, "%s: cannot listen on '%s': %s\n",
+			opt->creator, path, strerror( errno));
+		return 1;
+	}
+
+	/* a client that goes away should not take the server along */
+	signal( SIGPIPE, SIG_IGN);
+
+	memset( &s, 0, sizeof( s));
+	pthread_mutex_init( &s.lock, NULL);
+	pthread_cond_init( &s.notempty, NULL);
+	pthread_cond_init( &s.notfull, NULL);
+	s.nqueue = nthreads * QUEUE_PER_THREAD;
+	s.opt = opt;
+	if (!(s.queue = malloc( s.nqueue * sizeof( *s.queue))) ||
+	    !(threads = malloc( nthreads * sizeof( *threads))) ||
+	    !(s.cache = TileCacheNew()))
+	{	fprintf( stderr, "%s: out of memory!\n", opt->creator);
+		return 1;
+	}
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create( threads + i, NULL, worker, &s))
+		{	fprintf( stderr, "%s: cannot start threads!\n", opt->creator);
+			return 1;
+		}
+	if (opt->verbose)
+		fprintf( stderr, "Serving on '%s' with %d threads\n", path, nthreads);
+
+	for (;;)
+	{	/* accept no more than the queue holds */
+		pthread_mutex_lock( &s.lock);
+		while (s.count == s.nqueue)
+			pthread_cond_wait( &s.notfull, &s.lock);
+		pthread_mutex_unlock( &s.lock);
+
+		if ((fd = accept( lfd, NULL, NULL)) < 0)
+		{	if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			fprintf( stderr, "%s: accept failed: %s\n",
+				opt->creator, strerror( errno));
+			return 1;
+		}
+
+		pthread_mutex_lock( &s.lock);
+		s.queue[ (s.head + s.count) % s.nqueue] = fd;
+		s.count++;
+		pthread_cond_signal( &s.notempty);
+		pthread_mutex_unlock( &s.lock);
+	}
+}
+
+static void *worker( void *arg)
+{
+	struct server *s = arg;
+	int fd;
+
+	for (;;)
+	{	pthread_mutex_lock( &s->lock);
+		while (s->count == 0)
+			pthread_cond_wait( &s->notempty, &s->lock);
+		fd = s->queue[ s->head];
+		s->head = (s->head + 1) % s->nqueue;
+		s->count--;
+		pthread_cond_signal( &s->notfull);
+		pthread_mutex_unlock( &s->lock);
+
+		serve( s, fd);
+	}
+	return NULL;
+}
+
+/*********************************************/
+/* one job for the client on fd              */
+/*********************************************/
+static void serve( struct server *s, int fd)
+{
+	struct tileoptions opt;
+	struct request r;
+	struct tilejob *j;
+	struct timeval tv;
+	char error[ 256], head[ 32];
+	const char *why;
+	int rc, i;
+
+	memset( &r, 0, sizeof( r));
+	r.fd = fd;
+	tv.tv_sec = IDLEMAX;
+	tv.tv_usec = 0;
+	setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv));
+	setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof( tv));
+	if (!(r.in = fdopen( fd, "r")))
+	{	close( fd);
+		return;
+	}
+	opt = *s->opt;
+	j = NULL;
+	why = error;
+
+	rc = readrequest( &r, &opt, error, sizeof( error));
+	/* whatever the request says: the threads are the pool's, */
+	/* one for each job, -v is for the server, and compressed */
+	/* input unpacks to no more than a request may send */
+	opt.nthreads = 1;
+	opt.verbose = 0;
+	opt.maxinput = SPOOLMAX;
+	if (rc)
+		;
+	else if (!(j = TileNew( &opt)))
+	{	rc = TILE_ENOMEM;
+		snprintf( error, sizeof( error), "%s: out of memory!", opt.creator);
+	} else
+	{	TileUseCache( j, s->cache);
+		TileOutputCallback( j, reply, &r);
+		if (r.data)
+			rc = TileInputMemory( j, r.data, r.size, r.name);
+		else
+			rc = TileInputFile( j, r.file);
+		if (!rc)
+			rc = TileRun( j);
+		why = TileError( j);
+	}
+
+	if (rc && !r.started)
+	{	snprintf( head, sizeof( head), "ERROR %d\n", rc);
+		if (!sendall( fd, head, strlen( head)) &&
+		    !sendall( fd, why, strlen( why)))
+			sendall( fd, "\n", 1);
+	}
+	if (s->opt->verbose)
+		fprintf( stderr, "%s: %s\n", r.file ? r.file : r.name ? r.name : "request",
+			rc ? why : "done");
+
+	TileFree( j);
+	for (i = 0; i < r.nline; i++)
+		free( r.line[i]);
+	free( r.data);
+	fclose( r.in);
+}
+
+/*********************************************/
+/* read the options, up to the input line    */
+/* returns 0, or an error code with the      */
+/* reason in error                           */
+/*********************************************/
+static int readrequest( struct request *r, struct tileoptions *opt,
+	char *error, size_t room)
+{
+	char *line;
+	size_t n;
+
+	for (;;)
+	{	if (!(line = malloc( LINEMAX + 1)))
+		{	snprintf( error, room, "%s: out of memory!", opt->creator);
+			return TILE_ENOMEM;
+		}
+		if (!fgets( line, LINEMAX + 1, r->in) || !(n = strlen( line)))
+		{	free( line);
+			snprintf( error, room, "Request ends before its input!");
+			return TILE_EUSAGE;
+		}
+		if (line[n-1] != '\n' && !feof( r->in))
+		{	free( line);
+			snprintf( error, room, "Request line longer than %d bytes!", LINEMAX);
+			return TILE_EUSAGE;
+		}
+		if (line[n-1] == '\n')
+			line[--n] = '\0';
+		if (n && line[n-1] == '\r')
+			line[--n] = '\0';
+		if (r->nline == MAXLINES)
+		{	free( line);
+			snprintf( error, room, "Too many lines in request!");
+			return TILE_EUSAGE;
+		}
+		/* kept, the options point into it */
+		r->line[ r->nline++] = line;
+
+		if (!strncmp( line, "file ", 5))
+		{	r->file = line + 5;
+			return TILE_OK;
+		}
+		if (!strncmp( line, "data ", 5))
+		{	r->size = strtoul( line + 5, &r->name, 10);
+			while (*r->name == ' ' || *r->name == '\t')
+				r->name++;
+			if (!*r->name)
+				r->name = "request";
+			if (r->size > SPOOLMAX)
+			{	snprintf( error, room, "Request input of %lu bytes is more than "
+					"the %lu allowed!", (unsigned long)r->size,
+					(unsigned long)SPOOLMAX);
+				return TILE_EINPUT;
+			}
+			if (!(r->data = malloc( r->size ? r->size : 1)))
+			{	snprintf( error, room, "%s: out of memory!", opt->creator);
+				return TILE_ENOMEM;
+			}
+			if (fread( r->data, 1, r->size, r->in) != r->size)
+			{	snprintf( error, room, "Request ends before its input!");
+				return TILE_EINPUT;
+			}
+			return TILE_OK;
+		}
+		if (line[0] == '-' && line[1] && strchr( FILEFLAGS, line[1]))
+		{	snprintf( error, room, "Option '%.64s' is not allowed in a request!", line);
+			return TILE_EUSAGE;
+		}
+		if (line[0] && option( opt, line))
+		{	snprintf( error, room, "Unknown option '%.64s' in request!", line);
+			return TILE_EUSAGE;
+		}
+	}
+}
+
+/* one option line, like on the command line */
+static int option( struct tileoptions *opt, char *line)
+{
+	char *arg;
+
+	if (line[0] != '-' || !line[1])
+		return 1;
+	for (arg = line + 2; *arg == ' ' || *arg == '\t'; arg++);
+	return TileOption( opt, line[1], arg);
+}
+
+/* the output callback of the jobs */
+static int reply( void *arg, const char *buf, size_t len)
+{
+	struct request *r = arg;
+
+	if (!r->started)
+	{	if (sendall( r->fd, "OK\n", 3))
+			return -1;
+		r->started = 1;
+	}
+	return sendall( r->fd, buf, len);
+}
+
+static int sendall( int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{	if ((n = write( fd, buf, len)) < 0)
+		{	if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
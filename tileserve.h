@@ -0,0 +1,9 @@
+/*
+#  tileserve - the tile.c freesewing program as a server
+#
+#  Runs tile jobs for clients of a local (unix domain) socket,
+#  with opt as the defaults of every job, and opt->nthreads
+#  jobs at the same time.
+*/
+
+int ServeRun( char *path, struct tileoptions *opt);